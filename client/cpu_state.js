@@ -0,0 +1,45 @@
+const os = require('os');
+
+const LITTLE_ENDIAN = os.endianness() === 'LE';
+const BYTE_FIELDS = ['a', 'x', 'y', 'sp', 'status', 'curr_opcode', 'cycles'];
+const WORD_FIELDS = ['pc', 'addr_abs', 'addr_rel'];
+
+/**
+ * Read-only view over the live CPU struct of a machine, exported by get_cpu_state_buffer.
+ * Nothing is copied or allocated on a read, so it is fine to poll it as often as you like.
+ * @param layout field offsets as returned by get_cpu_layout()
+ * @param machine the Machine to look at
+ */
+class CpuState {
+    constructor(layout, machine) {
+        this.layout = layout;
+        this.view = new DataView(machine.get_cpu_state_buffer());
+    }
+
+    get cycle_count() {
+        return Number(this.view.getBigUint64(this.layout.cycle_count, LITTLE_ENDIAN));
+    }
+
+    // Called by JSON.stringify, gives the same shape as get_cpu_state plus the cycle count
+    toJSON() {
+        const state = {};
+        BYTE_FIELDS.forEach(field => state[field] = this[field]);
+        WORD_FIELDS.forEach(field => state[field] = this[field]);
+        state.cycle_count = this.cycle_count;
+        return state;
+    }
+}
+
+BYTE_FIELDS.forEach(field => Object.defineProperty(CpuState.prototype, field, {
+    get() {
+        return this.view.getUint8(this.layout[field]);
+    }
+}));
+
+WORD_FIELDS.forEach(field => Object.defineProperty(CpuState.prototype, field, {
+    get() {
+        return this.view.getUint16(this.layout[field], LITTLE_ENDIAN);
+    }
+}));
+
+module.exports = { CpuState };
@@ -1,13 +1,303 @@
+// Size of the fixed part of the packed state returned by /step?n=N, pages follow it
+const PACKED_STATE_SIZE = 24;
+
+/**
+ * Decode the packed state returned by /step?n=N (layout documented at cpu_step_n in wrapper.c).
+ */
+function decodePackedState(buffer) {
+    const view = new DataView(buffer);
+    const nPages = view.getUint8(7);
+    const pages = [];
+    for (let i = 0; i < nPages; i++) {
+        pages.push(new Uint8Array(buffer, PACKED_STATE_SIZE + i * 0x100, 0x100));
+    }
+    return {
+        cpu: {
+            a: view.getUint8(0),
+            x: view.getUint8(1),
+            y: view.getUint8(2),
+            sp: view.getUint8(3),
+            status: view.getUint8(4),
+            curr_opcode: view.getUint8(5),
+            cycles: view.getUint8(6),
+            pc: view.getUint16(8, true),
+            addr_abs: view.getUint16(10, true),
+            addr_rel: view.getUint16(12, true),
+            cycle_count: Number(view.getBigUint64(16, true)),
+        },
+        pages
+    };
+}
+
+// Disassembly rows all have this height (see .disassembly-line in style.css), which is what lets us
+// work out which rows are visible without rendering the others
+const DISASSEMBLY_ROW_HEIGHT = 18;
+// Lines fetched per request and rows rendered beyond each edge of the visible area
+const DISASSEMBLY_WINDOW = 256;
+const DISASSEMBLY_OVERSCAN = 8;
+
+// Codes of the named keys that have one, printable keys send their character code
+const KEY_CODES = { Backspace: 0x08, Tab: 0x09, Enter: 0x0D, Escape: 0x1B, Delete: 0x7F };
+
+function toHex(value, size = 2) {
+    if (!value) {
+        value = 0;
+    }
+    return value.toString(16).toUpperCase().padStart(size, '0');
+}
+
+/**
+ * A 16x16 table of bytes built once. Updates only touch the cells whose byte actually changed.
+ */
+class HexTable {
+    constructor(tbody) {
+        this.bytes = new Uint8Array(0x100);
+        this.cells = [];
+        this.labels = [];
+        this.highlighted = -1;
+        this.page = -1;
+
+        const rows = [];
+        for (let row = 0; row < 16; row++) {
+            const tr = document.createElement('tr');
+            const label = document.createElement('td');
+            label.appendChild(document.createElement('strong'));
+            tr.appendChild(label);
+            this.labels.push(label.firstChild);
+            for (let col = 0; col < 16; col++) {
+                const cell = document.createElement('td');
+                cell.textContent = '00';
+                cell.dataset.nonzero = 'false';
+                tr.appendChild(cell);
+                this.cells.push(cell);
+            }
+            rows.push(tr);
+        }
+        tbody.replaceChildren(...rows);
+    }
+
+    setPage(page) {
+        if (page === this.page) {
+            return;
+        }
+        this.page = page;
+        this.labels.forEach((label, row) => label.textContent = toHex(page * 0x100 + row * 0x10, 4));
+    }
+
+    update(bytes) {
+        for (let i = 0; i < 0x100; i++) {
+            if (bytes[i] !== this.bytes[i]) {
+                this.bytes[i] = bytes[i];
+                this.cells[i].textContent = toHex(bytes[i]);
+                this.cells[i].dataset.nonzero = bytes[i] !== 0;
+            }
+        }
+    }
+
+    highlight(index) {
+        if (index === this.highlighted) {
+            return;
+        }
+        this.cells[this.highlighted]?.classList.remove('sp-highlight');
+        this.cells[index]?.classList.add('sp-highlight');
+        this.highlighted = index;
+    }
+}
+
+/**
+ * The framebuffer device on a canvas with one canvas pixel per screen pixel (CSS scales it up).
+ * Only the rectangles in stream frames are painted, the rest of the canvas keeps what it had.
+ */
+class FramebufferView {
+    constructor(canvas) {
+        this.context = canvas.getContext('2d');
+        this.palette = [];
+    }
+
+    setLayout({ width, height, palette }) {
+        this.context.canvas.width = width;
+        this.context.canvas.height = height;
+        this.palette = palette.map(rgb => [rgb >> 16, (rgb >> 8) & 0xFF, rgb & 0xFF]);
+    }
+
+    paint({ x, y, width, height, pixels }) {
+        const indices = Uint8Array.from(atob(pixels), c => c.charCodeAt(0));
+        const image = this.context.createImageData(width, height);
+        indices.forEach((index, i) => {
+            const [r, g, b] = this.palette[index] || [0, 0, 0];
+            image.data.set([r, g, b, 0xFF], i * 4);
+        });
+        this.context.putImageData(image, x, y);
+    }
+}
+
+/**
+ * Virtualized disassembly listing. Only the rows in view (plus some overscan) exist in the DOM and
+ * the lines themselves are fetched from /disassembly a window at a time as they scroll into view,
+ * so the size of the program does not matter.
+ */
+class DisassemblyView {
+    constructor(container, { onToggle, onEdit }) {
+        this.container = container;
+        this.spacer = document.createElement('div');
+        this.spacer.className = 'disassembly-spacer';
+        container.replaceChildren(this.spacer);
+        this.rows = [];
+        this.current = -1;
+        this.breakpoints = {};
+        this.clear(0);
+
+        let frameRequested = false;
+        container.addEventListener('scroll', () => {
+            if (!frameRequested) {
+                frameRequested = true;
+                requestAnimationFrame(() => {
+                    frameRequested = false;
+                    this.render();
+                });
+            }
+        });
+        const addressOf = (event) => {
+            const row = event.target.closest('.disassembly-line');
+            return row && row.dataset.address !== '' ? parseInt(row.dataset.address) : undefined;
+        };
+        container.addEventListener('click', (event) => {
+            const address = addressOf(event);
+            if (address !== undefined) {
+                onToggle(address);
+            }
+        });
+        container.addEventListener('contextmenu', (event) => {
+            const address = addressOf(event);
+            if (address !== undefined) {
+                event.preventDefault();
+                onEdit(address);
+            }
+        });
+    }
+
+    clear(total) {
+        // Responses to requests made before a reload are recognized by an older generation
+        this.generation = (this.generation || 0) + 1;
+        this.total = total;
+        this.lines = new Map();
+        this.indexOf = new Map();
+        this.pending = new Set();
+        this.spacer.style.height = `${total * DISASSEMBLY_ROW_HEIGHT}px`;
+    }
+
+    // Start over with the window returned by /loadRom or /loadFile
+    load(window) {
+        this.clear(window.total);
+        this.container.scrollTop = 0;
+        this.addWindow(window);
+    }
+
+    addWindow({ total, first, lines }) {
+        if (total !== this.total) {
+            this.clear(total);
+        }
+        lines.forEach((line, i) => {
+            this.lines.set(first + i, line);
+            this.indexOf.set(line.address, first + i);
+        });
+        this.render();
+    }
+
+    async fetchWindow(params) {
+        const generation = this.generation;
+        const res = await fetch('/disassembly?' + new URLSearchParams(params));
+        const window = await res.json();
+        if (generation === this.generation) {
+            this.addWindow(window);
+        }
+        return window;
+    }
+
+    request(index) {
+        const first = index - index % DISASSEMBLY_WINDOW;
+        if (!this.pending.has(first)) {
+            this.pending.add(first);
+            this.fetchWindow({ first, count: DISASSEMBLY_WINDOW });
+        }
+    }
+
+    setBreakpoints(breakpoints) {
+        this.breakpoints = breakpoints;
+        this.render();
+    }
+
+    // Highlight the line at `address` and scroll it into view, fetching its window if needed
+    async reveal(address) {
+        this.current = address;
+        let index = this.indexOf.get(address);
+        if (index === undefined && this.total > 0) {
+            const window = await this.fetchWindow({ around: address });
+            index = window.index;
+            // Remember it even when address is not the start of a line, so we do not ask again
+            this.indexOf.set(address, index);
+        }
+        if (index !== undefined && index >= 0) {
+            const top = index * DISASSEMBLY_ROW_HEIGHT;
+            const view = this.container;
+            if (top < view.scrollTop || top + DISASSEMBLY_ROW_HEIGHT > view.scrollTop + view.clientHeight) {
+                view.scrollTop = top - view.clientHeight / 2;
+            }
+        }
+        this.render();
+    }
+
+    render() {
+        const view = this.container;
+        const first = Math.max(0, Math.floor(view.scrollTop / DISASSEMBLY_ROW_HEIGHT) - DISASSEMBLY_OVERSCAN);
+        const end = Math.min(this.total,
+            Math.ceil((view.scrollTop + view.clientHeight) / DISASSEMBLY_ROW_HEIGHT) + DISASSEMBLY_OVERSCAN);
+
+        while (this.rows.length < end - first) {
+            const row = document.createElement('div');
+            row.className = 'disassembly-line';
+            this.spacer.appendChild(row);
+            this.rows.push(row);
+        }
+
+        this.rows.forEach((row, i) => {
+            const index = first + i;
+            row.hidden = index >= end;
+            if (row.hidden) {
+                return;
+            }
+            const line = this.lines.get(index);
+            if (!line) {
+                this.request(index);
+            }
+            if (row.index !== index || row.line !== line) {
+                row.index = index;
+                row.line = line;
+                row.style.transform = `translateY(${index * DISASSEMBLY_ROW_HEIGHT}px)`;
+                row.textContent = line ? line.line : '';
+                row.dataset.address = line ? line.address : '';
+            }
+            const address = line ? line.address : -1;
+            row.classList.toggle('current', address === this.current);
+            row.classList.toggle('breakpoint', address in this.breakpoints);
+            row.title = this.breakpoints[address] ?? '';
+        });
+    }
+}
+
+// Imperative views, kept out of the Alpine state so they are not made reactive
+const views = {};
+
 document.addEventListener('alpine:init', () => {
     Alpine.data('emulator', () => ({
         cpu: {},
         memoryPage: 0x00,
         stackPage: 0x01,
-        pageData: [],
-        stackData: [],
-        disassembly: [],
-        pcToLineIndex: {},
         loadedProgramName: null,
+        running: false,
+        stepCount: 1,
+        // pc -> condition ('' when unconditional), mirrors the native breakpoints of our session
+        breakpoints: {},
 
         // status bitmasks
         FLAG_C: (1 << 0),
@@ -21,25 +311,101 @@ document.addEventListener('alpine:init', () => {
 
         // Called on startup by alpine
         async init() {
+            await this.$nextTick();
+            views.memory = new HexTable(this.$refs.memoryTable);
+            views.stack = new HexTable(this.$refs.stackTable);
+            views.stack.setPage(this.stackPage);
+            views.framebuffer = new FramebufferView(this.$refs.framebuffer);
+            views.disassembly = new DisassemblyView(this.$refs.disassembly, {
+                onToggle: (address) => this.toggleBreakpoint(address),
+                onEdit: (address) => this.editBreakpointCondition(address),
+            });
+
             await this.getCpuState();
             await this.loadPage(this.memoryPage);
+            await this.loadStackPage();
+            await this.loadBreakpoints();
+            // The session may already have a program loaded (e.g. after a page reload)
+            const res = await fetch(`/disassembly?around=${this.cpu.pc}`);
+            views.disassembly.load(await res.json());
+            this.scrollToCurrentLine();
+            this.connectStream();
         },
 
-        isFlagSet(flag) {
-            return (this.cpu.status & flag) ? 1 : 0;
+        // Live updates pushed by the server while the emulator runs, WebSocket with an SSE fallback
+        connectStream() {
+            const onFrame = (data) => this.applyStreamFrame(JSON.parse(data));
+            const fallbackToSse = () => {
+                const source = new EventSource('/stream');
+                source.onmessage = (event) => onFrame(event.data);
+            };
+
+            if (!window.WebSocket) {
+                fallbackToSse();
+                return;
+            }
+            const scheme = location.protocol === 'https:' ? 'wss' : 'ws';
+            const socket = new WebSocket(`${scheme}://${location.host}/stream`);
+            let opened = false;
+            socket.onopen = () => {
+                opened = true;
+                views.socket = socket;
+            };
+            socket.onmessage = (event) => onFrame(event.data);
+            socket.onclose = () => {
+                views.socket = null;
+                if (!opened) {
+                    fallbackToSse();
+                }
+            };
         },
 
-        isSpPosition(index) {
-            // SP points to 0x01XX, so the offset within the stack page is the low byte
-            const spOffset = this.cpu.sp & 0xFF;
-            return index === spOffset;
+        applyStreamFrame(frame) {
+            if (frame.cpu) {
+                this.cpu = {...this.cpu, ...frame.cpu};
+            }
+            if (frame.pages) {
+                for (const [page, data] of Object.entries(frame.pages)) {
+                    const bytes = Uint8Array.from(atob(data), c => c.charCodeAt(0));
+                    if (parseInt(page) === this.memoryPage) {
+                        views.memory.update(bytes);
+                    }
+                    if (parseInt(page) === this.stackPage) {
+                        views.stack.update(bytes);
+                    }
+                }
+            }
+            if (frame.framebuffer) {
+                if (frame.framebuffer.palette) {
+                    views.framebuffer.setLayout(frame.framebuffer);
+                }
+                frame.framebuffer.rects.forEach(rect => views.framebuffer.paint(rect));
+            }
+            if (frame.cpu) {
+                this.scrollToCurrentLine();
+            }
         },
 
-        hex(value, size = 2) {
-            if (!value) {
-                value = 0;
+        // The key code the program reads from $FF, over the stream socket when there is one
+        sendKey(event) {
+            const code = event.key.length === 1 ? event.key.charCodeAt(0) : KEY_CODES[event.key];
+            if (code === undefined || code > 0xFF) {
+                return;
+            }
+            event.preventDefault();
+            if (views.socket) {
+                views.socket.send(JSON.stringify({ key: code }));
+            } else {
+                fetch(`/key/${code}`, { method: 'POST' });
             }
-            return value.toString(16).toUpperCase().padStart(size, '0');
+        },
+
+        isFlagSet(flag) {
+            return (this.cpu.status & flag) ? 1 : 0;
+        },
+
+        hex(value, size = 2) {
+            return toHex(value, size);
         },
 
         getProgramDescription() {
@@ -102,22 +468,80 @@ document.addEventListener('alpine:init', () => {
 
             await this.getCpuState();
 
-            // Retrieve the disassembled result
-            this.disassembly = disassemblyResponse.json();
-            this.disassembly.forEach((line, index) => {
-                this.pcToLineIndex[line.pc] = index;
-            })
+            // Only the first window of the disassembly, the rest is fetched as it scrolls into view
+            views.disassembly.load(await disassemblyResponse.json());
+            this.scrollToCurrentLine();
 
             await this.loadPage(this.memoryPage);
             await this.loadStackPage();
         },
 
         async step() {
-            const cpuRes = await fetch('/step');
-            this.cpu = await cpuRes.json();
+            // One round trip for the registers, the memory page and the stack page
+            const n = Math.max(1, parseInt(this.stepCount) || 1);
+            const res = await fetch(`/step?n=${n}&pages=${this.memoryPage},${this.stackPage}`);
+            const state = decodePackedState(await res.arrayBuffer());
+            this.cpu = state.cpu;
+            views.memory.update(state.pages[0]);
+            views.stack.update(state.pages[1]);
+
+            this.scrollToCurrentLine();
+        },
+
+        async run() {
+            this.running = true;
+            try {
+                // Runs free when there are no breakpoints at all
+                const res = await fetch('/run?until=bp');
+                if (res.ok) {
+                    this.cpu = (await res.json()).cpu;
+                }
+            } finally {
+                this.running = false;
+            }
             await this.loadPage(this.memoryPage);
             await this.loadStackPage();
+            this.scrollToCurrentLine();
+        },
+
+        setBreakpoints(list) {
+            this.breakpoints = Object.fromEntries(list.map(bp => [bp.pc, bp.condition ?? '']));
+            views.disassembly.setBreakpoints({...this.breakpoints});
+        },
+
+        async loadBreakpoints() {
+            const res = await fetch('/breakpoints');
+            this.setBreakpoints(await res.json());
+        },
+
+        async toggleBreakpoint(address) {
+            const res = address in this.breakpoints
+                ? await fetch('/breakpoints/' + address, { method: 'DELETE' })
+                : await fetch('/breakpoints/' + address, { method: 'POST' });
+            this.setBreakpoints(await res.json());
+        },
+
+        // e.g. A==$10 && [$0200]!=0, an empty condition makes it unconditional
+        async editBreakpointCondition(address) {
+            const condition = prompt(`Break at ${this.hex(address, 4)} when`, this.breakpoints[address] ?? '');
+            if (condition === null) {
+                return;
+            }
+            const res = await fetch('/breakpoints/' + address, {
+                method: 'POST',
+                body: condition,
+                headers: {'Content-Type': 'text/plain'}
+            });
+            if (!res.ok) {
+                alert(await res.text());
+                return;
+            }
+            this.setBreakpoints(await res.json());
+        },
 
+        async pause() {
+            const res = await fetch('/pause');
+            this.cpu = await res.json();
             this.scrollToCurrentLine();
         },
 
@@ -134,13 +558,14 @@ document.addEventListener('alpine:init', () => {
             this.memoryPage = page;
             const res = await fetch('/memory/' + page);
             const buffer = await res.arrayBuffer();
-            this.pageData = new Uint8Array(buffer);
+            views.memory.setPage(page);
+            views.memory.update(new Uint8Array(buffer));
         },
 
         async loadStackPage() {
             const res = await fetch('/memory/' + this.stackPage);
             const buffer = await res.arrayBuffer();
-            this.stackData = new Uint8Array(buffer);
+            views.stack.update(new Uint8Array(buffer));
         },
 
         async nmi() {
@@ -155,18 +580,11 @@ document.addEventListener('alpine:init', () => {
             this.scrollToCurrentLine();
         },
 
+        // Follow the pc in the disassembly and the sp in the stack table
         scrollToCurrentLine() {
-            this.$nextTick(() => {
-                // Scroll the current disassembly line into view
-                const currentLine = document.querySelector('.disassembly-line.current');
-                if (currentLine) {
-                    currentLine.scrollIntoView({ behavior: 'smooth', block: 'nearest' });
-                }
-            });
-        },
-
-        isCurrentLine(address) {
-            return address === this.cpu.pc;
+            // SP points to 0x01XX, so the offset within the stack page is the low byte
+            views.stack.highlight(this.cpu.sp & 0xFF);
+            views.disassembly.reveal(this.cpu.pc);
         }
     }))
 });
\ No newline at end of file
@@ -1,87 +1,285 @@
 const emulator = require('./build/Release/m6502_emulator.node');
 const express = require('express');
 const path = require('path');
+const { SessionPool } = require('./sessions');
+const { attachStream } = require('./stream');
+
+// The core logs to stderr, LOG_LEVEL=debug also shows interrupts
+if (process.env.LOG_LEVEL) {
+    emulator.set_log_level(process.env.LOG_LEVEL);
+}
 
 const app = express();
 const port = 3000;
 
-// Load up the emulator with a stupid program
-const reset = function() {
-    emulator.cpu_init();
-    emulator.cpu_reset();
+// One machine per browser session, see sessions.js
+const sessions = new SessionPool(emulator);
+app.use(sessions.middleware());
+
+// Upper bound for a single free run so a runaway program eventually hands control back
+const MAX_RUN_CYCLES = 1_000_000_000;
+// Stepping blocks the event loop, so n is capped like MAX_STEP_N in wrapper.c (use /run for more)
+const MAX_STEP_N = 100000;
+
+// Disassembly is served in windows, the client only ever shows a screenful of it
+const DISASSEMBLY_WINDOW = 256;
+const MAX_DISASSEMBLY_WINDOW = 4096;
+
+/**
+ * Lines [first, first + count) of the disassembly or, when `around` is given, the window centered
+ * on the line holding that address (its index is included in the answer).
+ */
+const disassemblyWindow = function(machine, { first = 0, count = DISASSEMBLY_WINDOW, around } = {}) {
+    const total = machine.get_disassembly_size();
+    let index;
+    if (around !== undefined) {
+        index = machine.find_disassembly_line(around);
+        first = Math.max(0, index - Math.floor(count / 2));
+    }
+    const lines = total > 0 ? machine.get_disassembly(first, count) : [];
+    return { total, first, index, lines };
 }
 
 // Expose emulator endpoints -----
 app.get('/cpu', (req, res) => {
-    const cpuState = emulator.get_cpu_state();
-    return res.json(cpuState);
+    return res.json(req.session.cpu);
 });
 
-app.get('/reset', (req, res) => {
-    reset();
+app.get('/reset', async (req, res) => {
+    await req.session.pause();
+    req.session.reset();
     return res.status(200).send();
 })
 
 app.get('/step', (req, res) => {
-    emulator.cpu_step();
-    const cpuState = emulator.get_cpu_state();
-    return res.json(cpuState);
+    const { machine, cpu } = req.session;
+    if (req.session.activeRun) {
+        return res.status(409).send('Emulator is running');
+    }
+    if (req.query.n === undefined) {
+        machine.cpu_step();
+        return res.json(cpu);
+    }
+
+    // Batched stepping, answers with the packed state (see cpu_step_n in wrapper.c) and the requested pages
+    const n = parseInt(req.query.n);
+    const pages = req.query.pages ? req.query.pages.split(',').map(p => parseInt(p)) : [];
+    if (isNaN(n) || n < 0 || n > MAX_STEP_N || pages.some(p => isNaN(p) || p < 0 || p > 0xFF)) {
+        return res.status(400).send(`Invalid n (at most ${MAX_STEP_N}) or pages`);
+    }
+    const packed = machine.cpu_step_n(n, pages);
+    return res.type('application/octet-stream').send(packed);
+});
+
+app.get('/run', async (req, res) => {
+    const session = req.session;
+    if (session.activeRun) {
+        return res.status(409).send('Emulator is already running');
+    }
+    const cycles = req.query.cycles ? parseInt(req.query.cycles) : MAX_RUN_CYCLES;
+    if (req.query.until === 'bp') {
+        // Stop at the first breakpoint whose condition holds, checked natively on every instruction
+        const executed = await session.startRun(session.machine.cpu_run_to_breakpoint(cycles));
+        return res.json({ executed, breakpoint: session.machine.breakpoint_hit(), cpu: session.cpu });
+    }
+    const executed = await session.startRun(session.machine.cpu_run(cycles));
+    return res.json({ executed, cpu: session.cpu });
+});
+
+app.get('/runUntil', async (req, res) => {
+    const session = req.session;
+    if (session.activeRun) {
+        return res.status(409).send('Emulator is already running');
+    }
+    const pc = parseInt(req.query.pc);
+    const cycles = req.query.cycles ? parseInt(req.query.cycles) : MAX_RUN_CYCLES;
+    const executed = await session.startRun(session.machine.cpu_run_until(pc, cycles));
+    return res.json({ executed, cpu: session.cpu });
+});
+
+// GET /clock?hz=N paces later runs to N cycles per second (0 for flat out), answers with the pacer stats
+app.get('/clock', (req, res) => {
+    const machine = req.session.machine;
+    if (req.query.hz !== undefined) {
+        const hz = parseInt(req.query.hz);
+        if (isNaN(hz) || hz < 0 || hz > 0xFFFFFFFF) {
+            return res.status(400).send('Invalid hz');
+        }
+        machine.set_clock_hz(hz);
+    }
+    return res.json(machine.get_pacer_stats());
+});
+
+app.get('/pause', async (req, res) => {
+    await req.session.pause();
+    return res.json(req.session.cpu);
+});
+
+// GET /disassembly?first=N&count=N or /disassembly?around=<address>&count=N
+app.get('/disassembly', (req, res) => {
+    const count = req.query.count ? parseInt(req.query.count) : DISASSEMBLY_WINDOW;
+    const first = req.query.first ? parseInt(req.query.first) : 0;
+    const around = req.query.around !== undefined ? parseInt(req.query.around) : undefined;
+    if (isNaN(count) || count <= 0 || count > MAX_DISASSEMBLY_WINDOW || isNaN(first) || first < 0 ||
+        (around !== undefined && (isNaN(around) || around < 0 || around > 0xFFFF))) {
+        return res.status(400).send('Invalid disassembly window');
+    }
+    return res.json(disassemblyWindow(req.session.machine, { first, count, around }));
+});
+
+app.get('/breakpoints', (req, res) => {
+    return res.json(req.session.machine.get_breakpoints());
+});
+
+// Body is an optional condition, e.g. A==$10 && [$0200]!=0
+app.post('/breakpoints/:pc', express.text({ type: '*/*' }), (req, res) => {
+    const pc = parseInt(req.params.pc);
+    if (isNaN(pc) || pc < 0 || pc > 0xFFFF) {
+        return res.status(400).send('Invalid pc');
+    }
+    const condition = typeof req.body === 'string' ? req.body.trim() : '';
+    try {
+        req.session.machine.set_breakpoint(pc, condition);
+    } catch (e) {
+        return res.status(400).send(`Invalid condition: ${condition}`);
+    }
+    return res.json(req.session.machine.get_breakpoints());
+});
+
+app.delete('/breakpoints/:pc', (req, res) => {
+    const pc = parseInt(req.params.pc);
+    if (isNaN(pc) || pc < 0 || pc > 0xFFFF) {
+        return res.status(400).send('Invalid pc');
+    }
+    req.session.machine.clear_breakpoint(pc);
+    return res.json(req.session.machine.get_breakpoints());
+});
+
+app.delete('/breakpoints', (req, res) => {
+    req.session.machine.clear_breakpoints();
+    return res.json([]);
+});
+
+// Profile from the current pc on, restarting any running profile
+app.post('/profile', (req, res) => {
+    req.session.machine.profiler_start();
+    return res.json({ running: true });
+});
+
+app.delete('/profile', (req, res) => {
+    req.session.machine.profiler_stop();
+    return res.json({ running: false });
+});
+
+// ?format=collapsed (default, for flamegraph tools) or ?format=hotspots&limit=N
+app.get('/profile', (req, res) => {
+    const { machine } = req.session;
+    const profile = req.query.format === 'hotspots'
+        ? machine.get_profile_hotspots(parseInt(req.query.limit) || 0)
+        : machine.get_profile_collapsed();
+    if (profile === null) {
+        return res.status(404).send('Profiler is not running');
+    }
+    return res.type('text/plain').send(profile);
 });
 
 app.get('/memory/:page', (req, res) => {
     const page = parseInt(req.params.page);
-    const chunk = emulator.get_bus_page(page);
-    return res.send(Buffer.from(chunk));
+    if (isNaN(page) || page < 0 || page > 0xFF) {
+        return res.status(400).send('Invalid page');
+    }
+    return res.send(Buffer.from(req.session.page(page)));
 })
 
-app.post('/loadRom', express.text({ type: '*/*' }), (req, res) => {
+app.post('/loadRom', express.text({ type: '*/*' }), async (req, res) => {
+    const { machine } = req.session;
     // Clear bus and cpu state
-    emulator.cpu_init();
+    await req.session.pause();
+    machine.cpu_init();
 
     const rom = req.body;
     const len = rom.length;
-    emulator.load_rom(0x0600, len, rom);
+    machine.load_rom(0x0600, len, rom);
 
     // Call reset again to load the program into memory
-    emulator.cpu_reset();
+    machine.cpu_reset();
 
-    const disassembly = emulator.get_disassembly();
-    return res.json(disassembly);
+    // First window of the disassembly, around the reset vector
+    return res.json(disassemblyWindow(machine, { around: req.session.cpu.pc }));
 });
 
-app.post('/loadFile', express.text({ type: '*/*' }), (req, res) => {
+app.post('/loadFile', express.text({ type: '*/*' }), async (req, res) => {
+    const { machine } = req.session;
     // Clear bus and cpu state
-    emulator.cpu_init();
+    await req.session.pause();
+    machine.cpu_init();
 
     const file = req.body;
-    emulator.load_file(file);
+    machine.load_file(file);
 
     // Call reset again to load the program into memory
-    emulator.cpu_reset();
+    machine.cpu_reset();
+
+    // First window of the disassembly, around the reset vector
+    return res.json(disassemblyWindow(machine, { around: req.session.cpu.pc }));
+});
 
-    // Retrieve disassembled lines
-    const disassembly = emulator.get_disassembly();
-    return res.json(disassembly);
+// Output the program wrote to the console since the last call, in one response however much it is
+app.get('/console', (req, res) => {
+    return res.type('application/octet-stream').send(req.session.machine.acia_take_output());
+});
+
+// Body is queued for the program to read from the console
+app.post('/console', express.text({ type: '*/*' }), (req, res) => {
+    req.session.machine.acia_send_input(typeof req.body === 'string' ? req.body : '');
+    return res.status(204).end();
+});
+
+// Save-state of the session's machine (format in core/savestate.h), taken without stopping a run
+app.get('/state', (req, res) => {
+    res.setHeader('Content-Disposition', 'attachment; filename="6502.state"');
+    return res.type('application/octet-stream').send(req.session.machine.save_state());
+});
+
+// Carry on from a save-state in the body, a run in progress is paused first
+app.put('/state', express.raw({ type: '*/*', limit: '1mb' }), async (req, res) => {
+    await req.session.pause();
+    try {
+        req.session.machine.load_state(Buffer.isBuffer(req.body) ? req.body : Buffer.alloc(0));
+    } catch (e) {
+        return res.status(400).send(e.message);
+    }
+    return res.json(req.session.cpu);
+});
+
+// Key code for the program to read from $FF, for clients without the stream (it takes { key } too)
+app.post('/key/:code', (req, res) => {
+    const code = parseInt(req.params.code);
+    if (isNaN(code) || code < 0 || code > 0xFF) {
+        return res.status(400).send('Invalid key code');
+    }
+    if (!req.session.machine.push_key(code)) {
+        return res.status(503).send('Key queue is full');
+    }
+    return res.status(204).end();
 });
 
 app.get('/nmi', (req, res) => {
-    emulator.cpu_nmi();
-    const cpuState = emulator.get_cpu_state();
-    return res.json(cpuState);
+    req.session.machine.cpu_nmi();
+    return res.json(req.session.cpu);
 })
 
 app.get('/irq', (req, res) => {
-    emulator.cpu_irq();
-    const cpuState = emulator.get_cpu_state();
-    return res.json(cpuState);
+    req.session.machine.cpu_irq();
+    return res.json(req.session.cpu);
 })
 
-// Init on startup
-reset();
-
 // Serve static files
 app.use(express.static(path.join(__dirname)));
 app.use(express.text({ type: 'text/plain' }))
-app.listen(port, () => console.log(`Server running on port ${port}`));
+const server = app.listen(port, () => console.log(`Server running on port ${port}`));
+
+// Live state updates while the emulator runs, see stream.js
+attachStream(app, server, sessions);
 
 
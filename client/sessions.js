@@ -0,0 +1,173 @@
+const crypto = require('crypto');
+const { CpuState } = require('./cpu_state');
+
+/*
+ * Every browser session gets its own emulated machine, so concurrent debugging sessions never
+ * see each other's memory or registers. A machine is only allocated once a session actually
+ * touches the emulator. Sessions idle for longer than IDLE_TIMEOUT_MS are evicted and their
+ * machine is wiped and kept around for the next session instead of being freed.
+ */
+
+const SESSION_COOKIE = 'm6502_session';
+const IDLE_TIMEOUT_MS = 15 * 60 * 1000;
+const EVICTION_INTERVAL_MS = 60 * 1000;
+const MAX_SPARE_MACHINES = 32;
+// Every machine has a console (6551 ACIA) here, see GET/POST /console
+const ACIA_BASE = 0x5000;
+// And a 32x32 display where the easy6502 examples draw, streamed as dirty rectangles (see stream.js),
+// plus their random number ($FE) and key ($FF) ports
+const FRAMEBUFFER_BASE = 0x0200;
+
+const parseCookies = function(header) {
+    const cookies = {};
+    (header || '').split(';').forEach(pair => {
+        const index = pair.indexOf('=');
+        if (index > 0) {
+            cookies[pair.slice(0, index).trim()] = decodeURIComponent(pair.slice(index + 1).trim());
+        }
+    });
+    return cookies;
+}
+
+class Session {
+    constructor(id, pool) {
+        this.id = id;
+        this.pool = pool;
+        this._machine = null;
+        this._cpu = null;
+        this._memory = null;
+        // Promise of the batch currently running on the emulator thread (if any)
+        this.activeRun = null;
+        // Open stream connections, a session with a live view is never considered idle
+        this.subscribers = 0;
+        this.lastSeen = Date.now();
+    }
+
+    get machine() {
+        if (!this._machine) {
+            this._machine = this.pool.acquireMachine();
+            this._cpu = new CpuState(this.pool.layout, this._machine);
+            this._memory = this._machine.get_memory_view();
+        }
+        return this._machine;
+    }
+
+    // Zero-copy view of the cpu registers, always up to date
+    get cpu() {
+        this.machine;
+        return this._cpu;
+    }
+
+    // Zero-copy views of the whole address space, see get_memory_view in wrapper.c
+    get memory() {
+        this.machine;
+        return this._memory;
+    }
+
+    // The 256 bytes of `page`, a view into the machine memory rather than a copy
+    page(page) {
+        return this.memory.ram.subarray(page * 0x100, (page + 1) * 0x100);
+    }
+
+    touch() {
+        this.lastSeen = Date.now();
+    }
+
+    startRun(promise) {
+        this.activeRun = promise.finally(() => this.activeRun = null);
+        return this.activeRun;
+    }
+
+    // Interrupt a free run (if any) and wait until the emulator is handed back to us
+    async pause() {
+        if (this.activeRun) {
+            this.machine.cpu_pause();
+            await this.activeRun;
+        }
+    }
+
+    reset() {
+        this.machine.cpu_init();
+        this.machine.cpu_reset();
+    }
+}
+
+class SessionPool {
+    constructor(emulator) {
+        this.emulator = emulator;
+        this.layout = emulator.get_cpu_layout();
+        this.framebufferLayout = emulator.get_framebuffer_layout();
+        this.sessions = new Map();
+        this.spare = [];
+        setInterval(() => this.evictIdle(), EVICTION_INTERVAL_MS).unref();
+    }
+
+    acquireMachine() {
+        // Recycling unmaps devices, so spare machines need theirs mapped again too
+        const machine = this.spare.pop() || new this.emulator.Machine();
+        machine.attach_acia(ACIA_BASE);
+        machine.attach_framebuffer(FRAMEBUFFER_BASE);
+        machine.attach_easy6502();
+        return machine;
+    }
+
+    /**
+     * The session of the cookie sent with `req`. A new session is started when there is none,
+     * its cookie is set on `res` when given (WebSocket upgrades have no response to set it on).
+     */
+    fromRequest(req, res) {
+        const id = parseCookies(req.headers.cookie)[SESSION_COOKIE];
+        let session = id && this.sessions.get(id);
+        if (!session) {
+            session = new Session(crypto.randomUUID(), this);
+            this.sessions.set(session.id, session);
+            if (res) {
+                res.setHeader('Set-Cookie', `${SESSION_COOKIE}=${session.id}; Path=/; HttpOnly; SameSite=Strict`);
+            }
+        }
+        session.touch();
+        return session;
+    }
+
+    // Express middleware making the session available as req.session
+    middleware() {
+        return (req, res, next) => {
+            req.session = this.fromRequest(req, res);
+            next();
+        };
+    }
+
+    evictIdle() {
+        const now = Date.now();
+        for (const session of this.sessions.values()) {
+            if (session.subscribers > 0 || now - session.lastSeen < IDLE_TIMEOUT_MS) {
+                continue;
+            }
+            if (session.activeRun) {
+                // Nobody is watching, stop it and collect it on the next round
+                session.machine.cpu_pause();
+                continue;
+            }
+            this.sessions.delete(session.id);
+            this.release(session);
+        }
+    }
+
+    release(session) {
+        const machine = session._machine;
+        session._machine = null;
+        session._cpu = null;
+        session._memory = null;
+        if (!machine) {
+            return;
+        }
+        if (this.spare.length < MAX_SPARE_MACHINES) {
+            machine.recycle();
+            this.spare.push(machine);
+        } else {
+            machine.destroy();
+        }
+    }
+}
+
+module.exports = { SessionPool, FRAMEBUFFER_BASE };
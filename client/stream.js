@@ -0,0 +1,343 @@
+const crypto = require('crypto');
+const { FRAMEBUFFER_BASE } = require('./sessions');
+
+/*
+ * Pushes emulator state to the browser while it runs, over a WebSocket or, when that is not
+ * available, Server-Sent Events. Both carry the same JSON frames:
+ *
+ *   { cpu: { <changed register fields> }, pages: { <page>: <base64 of the 256 bytes> },
+ *     framebuffer: { palette: [0xRRGGBB, ...], width, height,
+ *                    rects: [{ x, y, width, height, pixels: <base64, one colour index per pixel> }] } }
+ *
+ * Any key is left out when nothing changed and no frame is sent at all when the emulator is
+ * idle. Pages come from the native dirty-page bitmap and framebuffer rectangles from the dirty
+ * spans of the framebuffer device, so a frame only carries what was written since the previous
+ * frame of that subscriber, however many instructions ran in between. The palette and size are
+ * only in the first frame. A subscriber follows the machine of the session its request belongs to.
+ *
+ * WebSocket clients may send { fps: N } to change their frame rate and { key: <code> } to queue a
+ * key for the easy6502 key port, which skips an HTTP round trip per key press.
+ */
+
+const WS_GUID = '258EAFA5-E914-47DA-95CA-C5AB0DC85B11';
+const WS_OPCODE_TEXT = 0x1;
+const WS_OPCODE_CLOSE = 0x8;
+const WS_OPCODE_PING = 0x9;
+const WS_OPCODE_PONG = 0xA;
+
+const DEFAULT_FPS = 60;
+const MAX_FPS = 120;
+const N_PAGES = 0x100;
+// Pending rectangles of a subscriber beyond this are merged into their bounding box
+const MAX_PENDING_RECTS = 32;
+
+const clampFps = function(fps) {
+    fps = parseInt(fps);
+    if (isNaN(fps) || fps <= 0) {
+        return DEFAULT_FPS;
+    }
+    return Math.min(fps, MAX_FPS);
+}
+
+// Encode a single unfragmented, unmasked server -> client frame
+const encodeWsFrame = function(opcode, payload) {
+    let header;
+    if (payload.length < 126) {
+        header = Buffer.from([0x80 | opcode, payload.length]);
+    } else if (payload.length < 0x10000) {
+        header = Buffer.alloc(4);
+        header[0] = 0x80 | opcode;
+        header[1] = 126;
+        header.writeUInt16BE(payload.length, 2);
+    } else {
+        header = Buffer.alloc(10);
+        header[0] = 0x80 | opcode;
+        header[1] = 127;
+        header.writeBigUInt64BE(BigInt(payload.length), 2);
+    }
+    return Buffer.concat([header, payload]);
+}
+
+/**
+ * Pull complete client -> server frames off the front of `buffer`. Returns the frames and
+ * whatever is left over (a partial frame waiting for more data).
+ */
+const decodeWsFrames = function(buffer) {
+    const frames = [];
+    while (buffer.length >= 2) {
+        const opcode = buffer[0] & 0x0F;
+        const masked = (buffer[1] & 0x80) !== 0;
+        let length = buffer[1] & 0x7F;
+        let offset = 2;
+        if (length === 126) {
+            if (buffer.length < 4) break;
+            length = buffer.readUInt16BE(2);
+            offset = 4;
+        } else if (length === 127) {
+            if (buffer.length < 10) break;
+            length = Number(buffer.readBigUInt64BE(2));
+            offset = 10;
+        }
+        const maskOffset = offset;
+        if (masked) {
+            offset += 4;
+        }
+        if (buffer.length < offset + length) break;
+
+        const payload = Buffer.from(buffer.subarray(offset, offset + length));
+        if (masked) {
+            for (let i = 0; i < payload.length; i++) {
+                payload[i] ^= buffer[maskOffset + (i & 3)];
+            }
+        }
+        frames.push({ opcode, payload });
+        buffer = buffer.subarray(offset + length);
+    }
+    return { frames, rest: buffer };
+}
+
+class Subscriber {
+    constructor(session, send, close, fps) {
+        this.session = session;
+        this.send = send;
+        this.close = close;
+        this.fps = clampFps(fps);
+        this.lastCpu = {};
+        this.pendingPages = new Set();
+        this.pendingRects = [];
+        this.sentLayout = false;
+        this.nextFrameAt = 0;
+    }
+}
+
+class StateStream {
+    constructor(sessions) {
+        this.sessions = sessions;
+        this.subscribers = new Set();
+        // Write generation of every streamed session as of its last sample
+        this.generations = new WeakMap();
+        this.timer = null;
+    }
+
+    add(subscriber) {
+        // Start with a key frame, every page holding anything at all
+        const session = subscriber.session;
+        for (let page = 0; page < N_PAGES; page++) {
+            if (session.page(page).some(b => b !== 0)) {
+                subscriber.pendingPages.add(page);
+            }
+        }
+        // and the whole screen
+        const { width, height } = this.sessions.framebufferLayout;
+        subscriber.pendingRects.push({ x: 0, y: 0, width, height });
+        subscriber.session.subscribers++;
+        this.subscribers.add(subscriber);
+        this.reschedule();
+    }
+
+    remove(subscriber) {
+        if (this.subscribers.delete(subscriber)) {
+            subscriber.session.subscribers--;
+            subscriber.session.touch();
+        }
+        this.reschedule();
+    }
+
+    // Sample at the rate of the most demanding subscriber, not at all without any
+    reschedule() {
+        clearInterval(this.timer);
+        this.timer = null;
+        if (this.subscribers.size === 0) {
+            return;
+        }
+        const fps = Math.max(...[...this.subscribers].map(s => s.fps));
+        this.timer = setInterval(() => this.sample(), 1000 / fps);
+    }
+
+    sample() {
+        // The dirty bitmap and rectangles are consumed once per machine and shared by all its
+        // subscribers. They are not even looked at while the write generation stays the same.
+        const dirtyBySession = new Map();
+        const now = Date.now();
+        for (const subscriber of this.subscribers) {
+            const session = subscriber.session;
+            if (!dirtyBySession.has(session)) {
+                const generation = session.memory.generation[0];
+                const changed = this.generations.get(session) !== generation;
+                this.generations.set(session, generation);
+                dirtyBySession.set(session, changed ? {
+                    pages: session.machine.take_dirty_pages(),
+                    rects: session.machine.framebuffer_take_dirty() || []
+                } : { pages: [], rects: [] });
+            }
+            const dirty = dirtyBySession.get(session);
+            dirty.pages.forEach(page => subscriber.pendingPages.add(page));
+            this.addRects(subscriber, dirty.rects);
+            if (now >= subscriber.nextFrameAt) {
+                subscriber.nextFrameAt = now + 1000 / subscriber.fps;
+                this.flush(subscriber);
+            }
+        }
+    }
+
+    addRects(subscriber, rects) {
+        const { width, height } = this.sessions.framebufferLayout;
+        if (rects.some(r => r.width === width && r.height === height)) {
+            // e.g. after a reset, nothing else is worth sending
+            subscriber.pendingRects = [{ x: 0, y: 0, width, height }];
+            return;
+        }
+        const pending = subscriber.pendingRects;
+        pending.push(...rects);
+        if (pending.length > MAX_PENDING_RECTS) {
+            const x = Math.min(...pending.map(r => r.x));
+            const y = Math.min(...pending.map(r => r.y));
+            const width = Math.max(...pending.map(r => r.x + r.width)) - x;
+            const height = Math.max(...pending.map(r => r.y + r.height)) - y;
+            subscriber.pendingRects = [{ x, y, width, height }];
+        }
+    }
+
+    // Colour indices of the pixels in `rect`, read from the machine memory as it is now
+    framebufferRect(session, rect) {
+        const stride = this.sessions.framebufferLayout.width;
+        const pixels = Buffer.alloc(rect.width * rect.height);
+        for (let row = 0; row < rect.height; row++) {
+            const start = FRAMEBUFFER_BASE + (rect.y + row) * stride + rect.x;
+            const line = session.memory.ram.subarray(start, start + rect.width);
+            for (let col = 0; col < rect.width; col++) {
+                pixels[row * rect.width + col] = line[col] & 0x0F;
+            }
+        }
+        return { ...rect, pixels: pixels.toString('base64') };
+    }
+
+    flush(subscriber) {
+        const frame = {};
+
+        const session = subscriber.session;
+        const state = session.cpu.toJSON();
+        const changed = {};
+        let anyChanged = false;
+        for (const [field, value] of Object.entries(state)) {
+            if (subscriber.lastCpu[field] !== value) {
+                changed[field] = value;
+                anyChanged = true;
+            }
+        }
+        if (anyChanged) {
+            frame.cpu = changed;
+            subscriber.lastCpu = state;
+        }
+
+        if (subscriber.pendingPages.size > 0) {
+            frame.pages = {};
+            for (const page of subscriber.pendingPages) {
+                frame.pages[page] = Buffer.from(session.page(page)).toString('base64');
+            }
+            subscriber.pendingPages.clear();
+        }
+
+        if (subscriber.pendingRects.length > 0) {
+            frame.framebuffer = { rects: subscriber.pendingRects.map(rect => this.framebufferRect(session, rect)) };
+            if (!subscriber.sentLayout) {
+                Object.assign(frame.framebuffer, this.sessions.framebufferLayout);
+                subscriber.sentLayout = true;
+            }
+            subscriber.pendingRects = [];
+        }
+
+        if (frame.cpu || frame.pages || frame.framebuffer) {
+            subscriber.send(JSON.stringify(frame));
+        }
+    }
+
+    handleMessage(subscriber, message) {
+        let msg;
+        try {
+            msg = JSON.parse(message);
+        } catch (e) {
+            return;
+        }
+        if (msg.fps !== undefined) {
+            subscriber.fps = clampFps(msg.fps);
+            this.reschedule();
+        }
+        // Straight into the key queue, a running program sees it the next time it polls $FF
+        if (Number.isInteger(msg.key) && msg.key >= 0 && msg.key <= 0xFF) {
+            subscriber.session.machine.push_key(msg.key);
+        }
+    }
+
+    // Server-Sent Events fallback, GET /stream?fps=N
+    handleSse(req, res) {
+        res.writeHead(200, {
+            'Content-Type': 'text/event-stream',
+            'Cache-Control': 'no-cache',
+            'Connection': 'keep-alive'
+        });
+        const subscriber = new Subscriber(req.session, data => res.write(`data: ${data}\n\n`), () => res.end(),
+            req.query.fps);
+        req.on('close', () => this.remove(subscriber));
+        this.add(subscriber);
+    }
+
+    // WebSocket upgrade of /stream?fps=N
+    handleUpgrade(req, socket) {
+        const key = req.headers['sec-websocket-key'];
+        if (!key || (req.headers.upgrade || '').toLowerCase() !== 'websocket') {
+            socket.end('HTTP/1.1 400 Bad Request\r\n\r\n');
+            return;
+        }
+        const accept = crypto.createHash('sha1').update(key + WS_GUID).digest('base64');
+        socket.write('HTTP/1.1 101 Switching Protocols\r\n' +
+            'Upgrade: websocket\r\n' +
+            'Connection: Upgrade\r\n' +
+            `Sec-WebSocket-Accept: ${accept}\r\n\r\n`);
+        socket.setNoDelay(true);
+
+        const fps = new URL(req.url, 'http://localhost').searchParams.get('fps');
+        const subscriber = new Subscriber(
+            this.sessions.fromRequest(req, null),
+            data => socket.write(encodeWsFrame(WS_OPCODE_TEXT, Buffer.from(data))),
+            () => socket.end(encodeWsFrame(WS_OPCODE_CLOSE, Buffer.alloc(0))),
+            fps
+        );
+
+        let received = Buffer.alloc(0);
+        socket.on('data', chunk => {
+            const { frames, rest } = decodeWsFrames(Buffer.concat([received, chunk]));
+            received = rest;
+            for (const frame of frames) {
+                if (frame.opcode === WS_OPCODE_TEXT) {
+                    this.handleMessage(subscriber, frame.payload.toString());
+                } else if (frame.opcode === WS_OPCODE_PING) {
+                    socket.write(encodeWsFrame(WS_OPCODE_PONG, frame.payload));
+                } else if (frame.opcode === WS_OPCODE_CLOSE) {
+                    subscriber.close();
+                }
+            }
+        });
+        socket.on('close', () => this.remove(subscriber));
+        socket.on('error', () => this.remove(subscriber));
+        this.add(subscriber);
+    }
+}
+
+/**
+ * Serve /stream on `app` (SSE) and on `server` (WebSocket upgrade).
+ */
+const attachStream = function(app, server, sessions) {
+    const stream = new StateStream(sessions);
+    app.get('/stream', (req, res) => stream.handleSse(req, res));
+    server.on('upgrade', (req, socket) => {
+        if (new URL(req.url, 'http://localhost').pathname !== '/stream') {
+            socket.destroy();
+            return;
+        }
+        stream.handleUpgrade(req, socket);
+    });
+    return stream;
+}
+
+module.exports = { attachStream };
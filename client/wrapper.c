@@ -1,12 +1,86 @@
 // TODO: Fix ugly workaround
 #include "../core/dbg.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "/home/johan/.nvm/versions/node/v22.20.0/include/node/node_api.h"
+#include "/home/johan/.nvm/versions/node/v22.20.0/include/node/uv.h"
+#include "../core/acia.h"
+#include "../core/breakpoint.h"
 #include "../core/bus.h"
 #include "../core/cpu.h"
 #include "../core/disassembler.h"
+#include "../core/easy6502.h"
+#include "../core/framebuffer.h"
+#include "../core/log.h"
+#include "../core/machine.h"
+#include "../core/memory_map.h"
+#include "../core/pacer.h"
+#include "../core/profiler.h"
+#include "../core/savestate.h"
+#include "../core/stats.h"
+#include "../core/trace.h"
+#include "../core/via.h"
+
+/*
+ * Batches are run on the libuv thread pool in slices of this many cycles. The machine lock is
+ * released between slices so that state reads on the main thread never wait longer than one slice.
+ * Paced batches queue one pacer slice per work item instead and wait for the next one on a timer
+ * of the event loop, a pool thread sleeping through a paced run would starve the other machines.
+ */
+#define RUN_SLICE_CYCLES 20000
+#define NO_TARGET_PC (-1)
+#define UNTIL_BREAKPOINT (-2)
+
+/*
+ * Layout of the packed state returned by cpu_step_n (all multibyte values little-endian):
+ *  0: a, 1: x, 2: y, 3: sp, 4: status, 5: curr_opcode, 6: cycles, 7: number of pages
+ *  8: pc, 10: addr_abs, 12: addr_rel (u16), 14: reserved
+ * 16: total cycle count (u64)
+ * 24: the requested pages, 256 bytes each, in the order they were requested
+ */
+#define PACKED_STATE_SIZE 24
+#define PACKED_MAX_PAGES 16
+// cpu_step_n runs on the main thread with the machine locked, longer runs belong on cpu_run
+#define MAX_STEP_N 100000
+
+/*
+ * Native side of a JS Machine object. The JS object, every external buffer pointing into the
+ * machine and a running batch each hold a reference, the machine is freed with the last one.
+ */
+typedef struct MachineCtx {
+    Machine *machine;
+    // Guards every call into the core for this machine, whoever is making it
+    pthread_mutex_t lock;
+    // Only touched from the main thread
+    struct RunJob *active_job;
+    atomic_bool pause_requested;
+    atomic_int refs;
+    // Clock runs are paced to, 0 runs flat out. The stats of the last paced run are under lock
+    atomic_uint clock_hz;
+    PacerStats pacer_stats;
+} MachineCtx;
+
+typedef struct RunJob {
+    MachineCtx *ctx;
+    napi_env env;
+    napi_async_work work;
+    napi_deferred deferred;
+    uint64_t cycles;
+    int32_t until_pc;
+    uint64_t executed;
+    bool reached;
+    // Paced runs only, 0 runs the whole batch in one work item
+    uint32_t hz;
+    Pacer pacer;
+    uint64_t slice_ran;
+    uv_timer_t timer;
+} RunJob;
 
 static napi_value void_return(const napi_env env) {
     napi_value nv;
@@ -21,35 +95,386 @@ static void bind_unsigned_int_field(const napi_env env, const napi_value c_struc
     napi_set_named_property(env, c_struct, field_name, nv);
 }
 
-static napi_value bind_uint8_array(const napi_env env, const uint8_t *bus_chunk) {
+// Counters as js numbers, exact up to 2^53
+static void bind_counter_field(const napi_env env, const napi_value c_struct, const char *field_name,
+                                      const uint64_t field_value) {
+    napi_value nv;
+    napi_create_double(env, (double) field_value, &nv);
+    napi_set_named_property(env, c_struct, field_name, nv);
+}
+
+static void bind_string_field(const napi_env env, const napi_value c_struct, const char *field_name,
+                                     const char *field_value) {
+    napi_value nv;
+    napi_create_string_utf8(env, field_value, NAPI_AUTO_LENGTH, &nv);
+    napi_set_named_property(env, c_struct, field_name, nv);
+}
+
+static MachineCtx *retain_ctx(MachineCtx *ctx) {
+    atomic_fetch_add(&ctx->refs, 1);
+    return ctx;
+}
+
+static void release_ctx(MachineCtx *ctx) {
+    if (atomic_fetch_sub(&ctx->refs, 1) == 1) {
+        Machine_destroy(ctx->machine);
+        pthread_mutex_destroy(&ctx->lock);
+        free(ctx);
+    }
+}
+
+static void release_ctx_finalizer(napi_env env, void *data, void *hint) {
+    release_ctx(hint);
+}
+
+/**
+ * Fetch `this` and the arguments of a Machine method call.
+ * @return the native machine behind `this` or NULL if it has been destroyed
+ */
+static MachineCtx *get_machine_args(const napi_env env, const napi_callback_info info, size_t *argc,
+                                    napi_value *args) {
+    napi_value this_arg;
+    size_t no_args = 0;
+    const napi_status status = napi_get_cb_info(env, info, argc ? argc : &no_args, args, &this_arg, NULL);
+    check_return(status == napi_ok, "Failed to retrieve arguments, status=%u", NULL, status);
+
+    MachineCtx *ctx = NULL;
+    const napi_status unwrap_status = napi_unwrap(env, this_arg, (void **) &ctx);
+    check_return(unwrap_status == napi_ok && ctx, "Machine has been destroyed", NULL);
+    return ctx;
+}
+
+/**
+ * Wrap `size` bytes of machine memory in an external ArrayBuffer that keeps the machine alive.
+ */
+static napi_value bind_external_buffer(const napi_env env, MachineCtx *ctx, const void *data, const size_t size) {
     napi_value array_buffer;
-    napi_status status = napi_create_external_arraybuffer(
+    const napi_status status = napi_create_external_arraybuffer(
         env,
-        (void *) bus_chunk,
-        0x100,
-        NULL,
-        NULL,
+        (void *) data,
+        size,
+        release_ctx_finalizer,
+        retain_ctx(ctx),
         &array_buffer
     );
-    check_return(status == napi_ok, "Could not create external array buffer", NULL);
+    if (status != napi_ok) {
+        release_ctx(ctx);
+        log_err("Could not create external array buffer, status=%d", status);
+        return NULL;
+    }
+    return array_buffer;
+}
+
+static napi_value bind_typed_array(const napi_env env, MachineCtx *ctx, const napi_typedarray_type type,
+                                   const void *data, const size_t length, const size_t element_size) {
+    const napi_value array_buffer = bind_external_buffer(env, ctx, data, length * element_size);
+    check_return(array_buffer, "Could not create external array buffer", NULL);
 
     napi_value typed_array;
-    status = napi_create_typedarray(
+    const napi_status status = napi_create_typedarray(
         env,
-        napi_uint8_array,
-        0x100,
+        type,
+        length,
         array_buffer,
         0,
         &typed_array
     );
-    check_return(status == napi_ok, "Could not create external array buffer", NULL);
+    check_return(status == napi_ok, "Could not create typed array, status=%d", NULL, status);
 
     return typed_array;
 }
 
+static napi_value bind_uint8_array(const napi_env env, MachineCtx *ctx, const uint8_t *bus_chunk) {
+    return bind_typed_array(env, ctx, napi_uint8_array, bus_chunk, 0x100, sizeof(uint8_t));
+}
+
+static bool reject_if_running(const napi_env env, const MachineCtx *ctx) {
+    if (ctx->active_job) {
+        napi_throw_error(env, NULL, "Emulator is running, pause it first");
+        return true;
+    }
+    return false;
+}
+
+// Run up to `slice` cycles with the machine locked, true when the target of the job was reached
+static bool run_slice(RunJob *job, const uint64_t slice) {
+    MachineCtx *ctx = job->ctx;
+    bool reached;
+    uint64_t ran;
+    pthread_mutex_lock(&ctx->lock);
+    if (job->until_pc == NO_TARGET_PC) {
+        ran = CPU_run(ctx->machine, slice);
+        reached = false;
+    } else if (job->until_pc == UNTIL_BREAKPOINT) {
+        ran = CPU_run_to_breakpoint(ctx->machine, slice);
+        reached = Breakpoint_was_hit(ctx->machine);
+    } else {
+        ran = CPU_run_until(ctx->machine, (uint16_t) job->until_pc, slice);
+        reached = CPU_get_pc(ctx->machine) == job->until_pc;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    job->executed += ran;
+    job->slice_ran = ran;
+    return reached;
+}
+
+static bool run_is_done(const RunJob *job) {
+    return job->reached || job->executed >= job->cycles || atomic_load(&job->ctx->pause_requested);
+}
+
+static void run_execute(napi_env env, void *data) {
+    RunJob *job = data;
+    if (job->hz) {
+        if (!run_is_done(job)) {
+            const uint64_t remaining = job->cycles - job->executed;
+            const uint64_t slice = Pacer_slice_cycles(&job->pacer);
+            job->reached = run_slice(job, remaining < slice ? remaining : slice);
+        }
+        return;
+    }
+    while (!run_is_done(job)) {
+        const uint64_t remaining = job->cycles - job->executed;
+        job->reached = run_slice(job, remaining < RUN_SLICE_CYCLES ? remaining : RUN_SLICE_CYCLES);
+    }
+}
+
+static void store_pacer_stats(RunJob *job) {
+    pthread_mutex_lock(&job->ctx->lock);
+    job->ctx->pacer_stats = job->pacer.stats;
+    pthread_mutex_unlock(&job->ctx->lock);
+}
+
+static void free_paced_job(uv_handle_t *handle) {
+    free(handle->data);
+}
+
+static void run_complete(napi_env env, napi_status status, void *data);
+
+static bool queue_work(RunJob *job) {
+    napi_value resource_name;
+    napi_create_string_utf8(job->env, "m6502_run", NAPI_AUTO_LENGTH, &resource_name);
+    napi_status status = napi_create_async_work(job->env, NULL, resource_name, run_execute, run_complete, job,
+                                                &job->work);
+    check_return(status == napi_ok, "Could not create async work, status=%d", false, status);
+    status = napi_queue_async_work(job->env, job->work);
+    if (status != napi_ok) {
+        napi_delete_async_work(job->env, job->work);
+        log_err("Could not queue async work, status=%d", status);
+        return false;
+    }
+    return true;
+}
+
+// The wait after a paced slice is over, on to the next one
+static void next_slice(uv_timer_t *timer) {
+    RunJob *job = timer->data;
+    Pacer_resume(&job->pacer);
+    store_pacer_stats(job);
+
+    napi_handle_scope scope;
+    napi_open_handle_scope(job->env, &scope);
+    if (!queue_work(job)) {
+        // Settle the promise from a work item that has nothing left to do
+        atomic_store(&job->ctx->pause_requested, true);
+        queue_work(job);
+    }
+    napi_close_handle_scope(job->env, scope);
+}
+
+static void run_complete(const napi_env env, const napi_status status, void *data) {
+    RunJob *job = data;
+    napi_delete_async_work(env, job->work);
+    if (status == napi_ok && job->hz && !run_is_done(job)) {
+        const uint64_t delay_ns = Pacer_account(&job->pacer, job->slice_ran);
+        store_pacer_stats(job);
+        // Rounded up, waking early would run ahead of the clock
+        uv_timer_start(&job->timer, next_slice, (delay_ns + 999999) / 1000000, 0);
+        return;
+    }
+    job->ctx->active_job = NULL;
+
+    napi_value result;
+    if (status == napi_ok) {
+        napi_create_double(env, (double) job->executed, &result);
+        napi_resolve_deferred(env, job->deferred, result);
+    } else {
+        napi_value msg;
+        napi_create_string_utf8(env, "Run was cancelled", NAPI_AUTO_LENGTH, &msg);
+        napi_create_error(env, NULL, msg, &result);
+        napi_reject_deferred(env, job->deferred, result);
+    }
+
+    release_ctx(job->ctx);
+    if (job->hz) {
+        uv_close((uv_handle_t *) &job->timer, free_paced_job);
+    } else {
+        free(job);
+    }
+}
+
+/**
+ * Queue a batch on the thread pool and hand back a promise that resolves with the number of
+ * cycles executed once the batch is done, paused or has reached until_pc.
+ */
+static napi_value queue_run(const napi_env env, MachineCtx *ctx, const uint64_t cycles, const int32_t until_pc) {
+    napi_value promise;
+    RunJob *job = NULL;
+    try(!reject_if_running(env, ctx), "Run requested while already running");
+
+    job = calloc(1, sizeof(RunJob));
+    check_mem(job, goto catch);
+    job->env = env;
+    job->cycles = cycles;
+    job->until_pc = until_pc;
+    job->hz = atomic_load(&ctx->clock_hz);
+    if (job->hz) {
+        uv_loop_t *loop = NULL;
+        try(napi_get_uv_event_loop(env, &loop) == napi_ok, "Could not get the event loop");
+        uv_timer_init(loop, &job->timer);
+        job->timer.data = job;
+        Pacer_start(&job->pacer, job->hz);
+    }
+
+    const napi_status status = napi_create_promise(env, &job->deferred, &promise);
+    try(status == napi_ok, "Could not create promise, status=%d", status);
+
+    atomic_store(&ctx->pause_requested, false);
+    job->ctx = retain_ctx(ctx);
+    if (!queue_work(job)) {
+        release_ctx(ctx);
+        goto catch;
+    }
+
+    ctx->active_job = job;
+    return promise;
+catch:
+    if (job && job->hz) {
+        uv_close((uv_handle_t *) &job->timer, free_paced_job);
+    } else {
+        free(job);
+    }
+    return void_return(env);
+}
+
+static void put_u16(uint8_t *dst, const uint16_t value) {
+    dst[0] = value & 0xFF;
+    dst[1] = value >> 8;
+}
+
+static void pack_state(const Machine *m, uint8_t *dst, const uint8_t n_pages) {
+    const CPU *cpu = CPU_get_state(m);
+    dst[0] = cpu->a;
+    dst[1] = cpu->x;
+    dst[2] = cpu->y;
+    dst[3] = cpu->sp;
+    dst[4] = cpu->status;
+    dst[5] = cpu->curr_opcode;
+    dst[6] = cpu->cycles;
+    dst[7] = n_pages;
+    put_u16(&dst[8], cpu->pc);
+    put_u16(&dst[10], cpu->addr_abs);
+    put_u16(&dst[12], cpu->addr_rel);
+    put_u16(&dst[14], 0);
+
+    const uint64_t cycle_count = CPU_get_cycle_count(m);
+    for (int i = 0; i < 8; i++) {
+        dst[16 + i] = (cycle_count >> (i * 8)) & 0xFF;
+    }
+}
+
+static bool get_cycles_arg(const napi_env env, const napi_value arg, uint64_t *cycles) {
+    double value = 0;
+    const napi_status status = napi_get_value_double(env, arg, &value);
+    check_return(status == napi_ok, "Could not get cycles argument. status=%d.", false, status);
+    check_return(value >= 0, "Cycles must not be negative", false);
+    *cycles = (uint64_t) value;
+    return true;
+}
+
+static void machine_finalize(napi_env env, void *data, void *hint) {
+    release_ctx(data);
+}
+
+// new Machine(), allocates a fresh machine (~64KB) owned by the returned object
+napi_value machine_new(const napi_env env, const napi_callback_info info) {
+    napi_value this_arg;
+    MachineCtx *ctx = NULL;
+    const napi_status argc_result = napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL);
+    try(argc_result == napi_ok, "Failed to retrieve arguments, status=%u", argc_result);
+
+    ctx = calloc(1, sizeof(MachineCtx));
+    check_mem(ctx, goto catch);
+    ctx->machine = Machine_create();
+    check_mem(ctx->machine, goto catch);
+    pthread_mutex_init(&ctx->lock, NULL);
+    atomic_init(&ctx->pause_requested, false);
+    atomic_init(&ctx->refs, 1);
+    atomic_init(&ctx->clock_hz, 0);
+
+    const napi_status wrap_result = napi_wrap(env, this_arg, ctx, machine_finalize, NULL, NULL);
+    if (wrap_result != napi_ok) {
+        release_ctx(ctx);
+        ctx = NULL;
+    }
+    try(wrap_result == napi_ok, "Could not wrap machine, status=%d", wrap_result);
+    return this_arg;
+catch:
+    if (ctx) {
+        free(ctx);
+    }
+    napi_throw_error(env, NULL, "Error creating machine");
+    return void_return(env);
+}
+
+// Give up this object's hold on the machine early instead of waiting for the garbage collector
+napi_value destroy(const napi_env env, const napi_callback_info info) {
+    napi_value this_arg;
+    const napi_status argc_result = napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL);
+    try(argc_result == napi_ok, "Failed to retrieve arguments, status=%u", argc_result);
+
+    MachineCtx *ctx = NULL;
+    try(napi_unwrap(env, this_arg, (void **) &ctx) == napi_ok && ctx, "Machine already destroyed");
+    if (reject_if_running(env, ctx)) {
+        return void_return(env);
+    }
+    napi_remove_wrap(env, this_arg, NULL);
+    release_ctx(ctx);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error destroying machine");
+    return void_return(env);
+}
+
+// Wipe memory, disassembly and cpu so the machine can be handed to another session
+napi_value recycle(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    if (reject_if_running(env, ctx)) {
+        return void_return(env);
+    }
+    pthread_mutex_lock(&ctx->lock);
+    Machine_recycle(ctx->machine);
+    ctx->pacer_stats = (PacerStats){0};
+    pthread_mutex_unlock(&ctx->lock);
+    atomic_store(&ctx->clock_hz, 0);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error recycling machine");
+    return void_return(env);
+}
+
 napi_value cpu_init(const napi_env env, napi_callback_info info) {
-    BUS_init();
-    CPU_load_instructions();
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    if (reject_if_running(env, ctx)) {
+        return void_return(env);
+    }
+    pthread_mutex_lock(&ctx->lock);
+    BUS_init(ctx->machine);
+    pthread_mutex_unlock(&ctx->lock);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error initializing machine");
     return void_return(env);
 }
 
@@ -57,8 +482,9 @@ napi_value load_rom(const napi_env env, const napi_callback_info info) {
     // Requires arguments org and rom
     size_t argc = 3;
     napi_value args[3];
-    const napi_status argc_result = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
-    try(argc_result == napi_ok, "Failed to retrieve arguments, status=%u", argc_result);
+    char *rom = NULL;
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
     try(argc == 3, "Wrong amount of arguments, expected: 3, got %lu", argc);
 
     // Retrieve org arg
@@ -76,19 +502,26 @@ napi_value load_rom(const napi_env env, const napi_callback_info info) {
 
     // Retrieve the rom string itself
 
-    char *rom = calloc(rom_size + 1, sizeof(char));
+    rom = calloc(rom_size + 1, sizeof(char));
     try(rom, "Could not allocate rom");
     const napi_value rom_arg = args[2];
     const napi_status rom_result = napi_get_value_string_utf8(env, rom_arg, rom, rom_size + 1, NULL);
     try(rom_result == napi_ok, "Could not get the rom, return code=%d", rom_result);
 
-    BUS_load_ROM_from_str((uint16_t) org, rom);
-    Disassembler_parse_section(org, org + rom_size - 1);
+    if (reject_if_running(env, ctx)) {
+        free(rom);
+        return void_return(env);
+    }
+    pthread_mutex_lock(&ctx->lock);
+    BUS_load_ROM_from_str(ctx->machine, (uint16_t) org, rom);
+    Disassembler_parse_section(ctx->machine, org, org + rom_size - 1);
+    pthread_mutex_unlock(&ctx->lock);
 
     // No need to return anything
     free(rom);
     return void_return(env);
 catch:
+    free(rom);
     napi_throw_error(env, NULL, "Error loading rom");
     return void_return(env);
 }
@@ -97,20 +530,28 @@ napi_value load_file(const napi_env env, const napi_callback_info info) {
     // Requires arguments org and rom
     size_t argc = 1;
     napi_value args[1];
-    const napi_status argc_result = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
-    try(argc_result == napi_ok, "Failed to retrieve arguments, status=%u", argc_result);
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
     try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
 
     // Retrieve the file arg
     const napi_value file_arg = args[0];
     char file_path[64];
-    const napi_status file_result = napi_get_value_string_utf8(env, file_arg, file_path, 64 + 1, NULL);
+    const napi_status file_result = napi_get_value_string_utf8(env, file_arg, file_path, 64, NULL);
     try(file_result == napi_ok, "Could not get the rom, return code=%d", file_result);
 
-    ROM rom;
+    if (reject_if_running(env, ctx)) {
+        return void_return(env);
+    }
+    ROM rom = {0};
     ROM_from_file(&rom, file_path);
-    BUS_load_ROM(&rom);
-    Disassembler_parse_rom(&rom);
+    try(rom.data, "Could not read rom file %s", file_path);
+    pthread_mutex_lock(&ctx->lock);
+    BUS_load_ROM(ctx->machine, &rom);
+    Disassembler_parse_rom(ctx->machine, &rom);
+    pthread_mutex_unlock(&ctx->lock);
+    free(rom.data);
+    free(rom.file);
 
     // Return the rom struct
     // napi_value rom_bind;
@@ -131,8 +572,8 @@ catch:
 napi_value disassemble(const napi_env env, const napi_callback_info info) {
     size_t argc = 2;
     napi_value args[2];
-    const napi_status argc_result = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
-    try(argc_result == napi_ok, "Failed to retrieve arguments, status=%u", argc_result);
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
     try(argc == 2, "Wrong amount of arguments, expected: 2, got %lu", argc);
 
     // Default to a small range if no args provided
@@ -144,7 +585,9 @@ napi_value disassemble(const napi_env env, const napi_callback_info info) {
         napi_get_value_uint32(env, args[1], &end);
     }
 
-    Disassembler_parse_section((uint16_t) start, (uint16_t) end);
+    pthread_mutex_lock(&ctx->lock);
+    Disassembler_parse_section(ctx->machine, (uint16_t) start, (uint16_t) end);
+    pthread_mutex_unlock(&ctx->lock);
     return void_return(env);
 catch:
     napi_throw_error(env, NULL, "Error loading rom");
@@ -152,19 +595,47 @@ catch:
 }
 
 napi_value cpu_reset(const napi_env env, napi_callback_info info) {
-    CPU_reset();
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    if (reject_if_running(env, ctx)) {
+        return void_return(env);
+    }
+    pthread_mutex_lock(&ctx->lock);
+    CPU_reset(ctx->machine);
+    pthread_mutex_unlock(&ctx->lock);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error resetting cpu");
     return void_return(env);
 }
 
+/**
+ * get_disassembly(first?, count?), lines [first, first + count) or all of them without arguments.
+ * Large roms disassemble to tens of thousands of lines, clients should fetch windows.
+ */
 napi_value get_disassembly(const napi_env env, napi_callback_info info) {
-    SourceCode *code = Disassembler_get_code();
+    size_t argc = 2;
+    napi_value args[2];
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    SourceCode *code = Disassembler_get_code(ctx->machine);
     try(code, "Code is null");
-    try(code->lines, "Code is empty");
+
+    uint32_t first = 0;
+    uint32_t count = code->n_lines;
+    if (argc == 2) {
+        const napi_status first_result = napi_get_value_uint32(env, args[0], &first);
+        const napi_status count_result = napi_get_value_uint32(env, args[1], &count);
+        try(first_result == napi_ok && count_result == napi_ok, "Could not get the window arguments");
+    } else {
+        try(code->lines, "Code is empty");
+    }
+    const uint32_t end = first + count < code->n_lines ? first + count : code->n_lines;
 
     napi_value result;
     napi_create_array(env, &result);
 
-    for (uint16_t i = 0; i < code->n_lines; i++) {
+    for (uint32_t i = first; i < end; i++) {
         napi_value source_line;
         napi_create_object(env, &source_line);
 
@@ -175,7 +646,7 @@ napi_value get_disassembly(const napi_env env, napi_callback_info info) {
         napi_create_string_utf8(env, code->lines[i].line, NAPI_AUTO_LENGTH, &line_text);
         napi_set_named_property(env, source_line, "line", line_text);
 
-        napi_set_element(env, result, i, source_line);
+        napi_set_element(env, result, i - first, source_line);
     }
 
     return result;
@@ -184,9 +655,46 @@ catch:
     return void_return(env);
 }
 
+napi_value get_disassembly_size(const napi_env env, napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    napi_value nv;
+    napi_create_uint32(env, Disassembler_get_code(ctx->machine)->n_lines, &nv);
+    return nv;
+catch:
+    napi_throw_error(env, NULL, "Error getting disassembly size");
+    return void_return(env);
+}
+
+// Index of the disassembly line holding an address, -1 if it is before the first line
+napi_value find_disassembly_line(const napi_env env, napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
+
+    uint32_t address = 0;
+    const napi_status result = napi_get_value_uint32(env, args[0], &address);
+    try(result == napi_ok && address <= 0xFFFF, "Invalid address argument");
+
+    napi_value nv;
+    napi_create_int32(env, Disassembler_find_line(ctx->machine, (uint16_t) address), &nv);
+    return nv;
+catch:
+    napi_throw_error(env, NULL, "Error finding disassembly line");
+    return void_return(env);
+}
+
 napi_value get_cpu_state(const napi_env env, napi_callback_info info) {
-    const CPU *cpu = CPU_get_state();
-    try(cpu, "CPU is null");
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+
+    // Take a consistent snapshot, a batch may be running on the thread pool
+    pthread_mutex_lock(&ctx->lock);
+    const CPU snapshot = *CPU_get_state(ctx->machine);
+    pthread_mutex_unlock(&ctx->lock);
+    const CPU *cpu = &snapshot;
 
     napi_value cpu_bind;
     napi_create_object(env, &cpu_bind);
@@ -204,16 +712,52 @@ napi_value get_cpu_state(const napi_env env, napi_callback_info info) {
 
     return cpu_bind;
 catch:
-    napi_throw_error(env, NULL, "Error loading rom");
+    napi_throw_error(env, NULL, "Error getting cpu state");
     return void_return(env);
 }
 
+/**
+ * Expose the live CPU struct (registers + cycle count) as an external ArrayBuffer. Reading it
+ * costs nothing, but while a batch is running fields may belong to different instructions,
+ * use get_cpu_state for a consistent snapshot. Decode it with the offsets from get_cpu_layout.
+ */
+napi_value get_cpu_state_buffer(const napi_env env, napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    const napi_value array_buffer = bind_external_buffer(env, ctx, CPU_get_state(ctx->machine), sizeof(CPU));
+    try(array_buffer, "Could not create external array buffer");
+    return array_buffer;
+catch:
+    napi_throw_error(env, NULL, "Error getting cpu state buffer");
+    return void_return(env);
+}
+
+napi_value get_cpu_layout(const napi_env env, napi_callback_info info) {
+    napi_value layout;
+    napi_create_object(env, &layout);
+
+    bind_unsigned_int_field(env, layout, "size", sizeof(CPU));
+    bind_unsigned_int_field(env, layout, "a", offsetof(CPU, a));
+    bind_unsigned_int_field(env, layout, "x", offsetof(CPU, x));
+    bind_unsigned_int_field(env, layout, "y", offsetof(CPU, y));
+    bind_unsigned_int_field(env, layout, "sp", offsetof(CPU, sp));
+    bind_unsigned_int_field(env, layout, "status", offsetof(CPU, status));
+    bind_unsigned_int_field(env, layout, "pc", offsetof(CPU, pc));
+    bind_unsigned_int_field(env, layout, "addr_abs", offsetof(CPU, addr_abs));
+    bind_unsigned_int_field(env, layout, "addr_rel", offsetof(CPU, addr_rel));
+    bind_unsigned_int_field(env, layout, "curr_opcode", offsetof(CPU, curr_opcode));
+    bind_unsigned_int_field(env, layout, "cycles", offsetof(CPU, cycles));
+    bind_unsigned_int_field(env, layout, "cycle_count", offsetof(CPU, cycle_count));
+
+    return layout;
+}
+
 napi_value get_bus_page(const napi_env env, const napi_callback_info info) {
     // Retrieve page arg
     size_t argc = 1;
     napi_value args[1];
-    const napi_status argc_result = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
-    try(argc_result == napi_ok, "Failed to retrieve arguments, status=%u", argc_result);
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
     try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
 
     uint32_t page = 0;
@@ -221,9 +765,9 @@ napi_value get_bus_page(const napi_env env, const napi_callback_info info) {
     const napi_status result = napi_get_value_uint32(env, page_arg, &page);
     try(result == napi_ok, "Could not get page argument. status=%d.", result);
 
-    const uint8_t *bus_chunk = BUS_get_page((uint8_t) page);
+    const uint8_t *bus_chunk = BUS_get_page(ctx->machine, (uint8_t) page);
 
-    const napi_value typed_array = bind_uint8_array(env, bus_chunk);
+    const napi_value typed_array = bind_uint8_array(env, ctx, bus_chunk);
     try(typed_array, "Typed array is null");
     return typed_array;
 catch:
@@ -231,57 +775,1043 @@ catch:
     return void_return(env);
 }
 
+/**
+ * Zero-copy views of the whole machine memory, valid for as long as the machine lives (loading
+ * or resetting only rewrites the contents):
+ *  ram:         Uint8Array(65536)
+ *  dirty_pages: Uint8Array(32), one bit per page written since the last take_dirty_pages
+ *  generation:  Uint32Array(1), changes with every write, nothing needs scanning while it stays put
+ * The views are read without the lock, while a batch is running they may lag behind a little.
+ */
+napi_value get_memory_view(const napi_env env, napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    Machine *m = ctx->machine;
+
+    const napi_value ram = bind_typed_array(env, ctx, napi_uint8_array, BUS_get_page(m, 0), RAM_SIZE,
+                                            sizeof(uint8_t));
+    try(ram, "Could not bind ram");
+    const napi_value dirty_pages = bind_typed_array(env, ctx, napi_uint8_array, m->dirty_pages,
+                                                    BUS_DIRTY_BITMAP_SIZE, sizeof(uint8_t));
+    try(dirty_pages, "Could not bind dirty pages");
+    const napi_value generation = bind_typed_array(env, ctx, napi_uint32_array, &m->generation, 1,
+                                                   sizeof(uint32_t));
+    try(generation, "Could not bind generation");
+
+    napi_value view;
+    napi_create_object(env, &view);
+    napi_set_named_property(env, view, "ram", ram);
+    napi_set_named_property(env, view, "dirty_pages", dirty_pages);
+    napi_set_named_property(env, view, "generation", generation);
+    return view;
+catch:
+    napi_throw_error(env, NULL, "Error getting memory view");
+    return void_return(env);
+}
+
+napi_value take_dirty_pages(const napi_env env, napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+
+    uint8_t bitmap[BUS_DIRTY_BITMAP_SIZE];
+    pthread_mutex_lock(&ctx->lock);
+    BUS_take_dirty_pages(ctx->machine, bitmap);
+    pthread_mutex_unlock(&ctx->lock);
+
+    napi_value pages;
+    napi_create_array(env, &pages);
+    uint32_t n_pages = 0;
+    for (uint32_t page = 0; page <= 0xFF; page++) {
+        if (bitmap[page >> 3] & (1 << (page & 7))) {
+            napi_value nv;
+            napi_create_uint32(env, page, &nv);
+            napi_set_element(env, pages, n_pages++, nv);
+        }
+    }
+    return pages;
+catch:
+    napi_throw_error(env, NULL, "Error getting dirty pages");
+    return void_return(env);
+}
+
 napi_value cpu_step(const napi_env env, napi_callback_info info) {
-    CPU_step();
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    if (reject_if_running(env, ctx)) {
+        return void_return(env);
+    }
+    pthread_mutex_lock(&ctx->lock);
+    CPU_step(ctx->machine);
+    pthread_mutex_unlock(&ctx->lock);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error stepping cpu");
+    return void_return(env);
+}
+
+napi_value cpu_step_n(const napi_env env, const napi_callback_info info) {
+    // Requires the number of instructions, optionally followed by an array of pages to include
+    size_t argc = 2;
+    napi_value args[2];
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc >= 1, "Wrong amount of arguments, expected: 1 or 2, got %lu", argc);
+
+    uint32_t n = 0;
+    const napi_status n_result = napi_get_value_uint32(env, args[0], &n);
+    try(n_result == napi_ok, "Could not get n argument. status=%d.", n_result);
+    try(n <= MAX_STEP_N, "Too many instructions requested: %u, at most %u", n, MAX_STEP_N);
+
+    uint8_t pages[PACKED_MAX_PAGES];
+    uint32_t n_pages = 0;
+    if (argc == 2) {
+        const napi_status len_result = napi_get_array_length(env, args[1], &n_pages);
+        try(len_result == napi_ok, "Pages must be an array, status=%d", len_result);
+        try(n_pages <= PACKED_MAX_PAGES, "Too many pages requested: %u", n_pages);
+        for (uint32_t i = 0; i < n_pages; i++) {
+            napi_value element;
+            uint32_t page = 0;
+            napi_get_element(env, args[1], i, &element);
+            const napi_status page_result = napi_get_value_uint32(env, element, &page);
+            try(page_result == napi_ok && page <= 0xFF, "Invalid page at index %u", i);
+            pages[i] = (uint8_t) page;
+        }
+    }
+
+    if (reject_if_running(env, ctx)) {
+        return void_return(env);
+    }
+
+    napi_value buffer;
+    uint8_t *data = NULL;
+    const napi_status buffer_result = napi_create_buffer(env, PACKED_STATE_SIZE + n_pages * 0x100,
+                                                         (void **) &data, &buffer);
+    try(buffer_result == napi_ok, "Could not create buffer, status=%d", buffer_result);
+
+    pthread_mutex_lock(&ctx->lock);
+    CPU_step_n(ctx->machine, n);
+    pack_state(ctx->machine, data, (uint8_t) n_pages);
+    for (uint32_t i = 0; i < n_pages; i++) {
+        memcpy(&data[PACKED_STATE_SIZE + i * 0x100], BUS_get_page(ctx->machine, pages[i]), 0x100);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return buffer;
+catch:
+    napi_throw_error(env, NULL, "Error stepping cpu");
     return void_return(env);
 }
 
 napi_value cpu_nmi(const napi_env env, napi_callback_info info) {
-    CPU_nmi();
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    // Interrupts are allowed while running, they are serviced between two slices
+    pthread_mutex_lock(&ctx->lock);
+    CPU_nmi(ctx->machine);
+    pthread_mutex_unlock(&ctx->lock);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error raising nmi");
     return void_return(env);
 }
 
 napi_value cpu_irq(const napi_env env, napi_callback_info info) {
-    CPU_irq();
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    pthread_mutex_lock(&ctx->lock);
+    CPU_irq(ctx->machine);
+    pthread_mutex_unlock(&ctx->lock);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error raising irq");
+    return void_return(env);
+}
+
+// Map a 6522 VIA at `base` (16 registers), it stays until the machine is recycled
+napi_value attach_via(const napi_env env, const napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
+    uint32_t base = 0;
+    try(napi_get_value_uint32(env, args[0], &base) == napi_ok && base <= 0xFFFF, "Invalid base address");
+    pthread_mutex_lock(&ctx->lock);
+    const Via *via = Via_attach(ctx->machine, base);
+    pthread_mutex_unlock(&ctx->lock);
+    try(via, "Could not map a VIA at %04X", base);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error attaching VIA");
+    return void_return(env);
+}
+
+// Map a 6551 ACIA console at `base` (4 registers), its output is kept for acia_take_output
+napi_value attach_acia(const napi_env env, const napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
+    uint32_t base = 0;
+    try(napi_get_value_uint32(env, args[0], &base) == napi_ok && base <= 0xFFFF, "Invalid base address");
+    pthread_mutex_lock(&ctx->lock);
+    const Acia *acia = Acia_attach(ctx->machine, base);
+    pthread_mutex_unlock(&ctx->lock);
+    try(acia, "Could not map an ACIA at %04X", base);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error attaching ACIA");
+    return void_return(env);
+}
+
+// Everything the program wrote to the ACIA since the last call as a Buffer, null without an ACIA
+napi_value acia_take_output(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    uint8_t *output = malloc(ACIA_OUTPUT_SIZE);
+    check_mem(output, goto catch);
+
+    pthread_mutex_lock(&ctx->lock);
+    Acia *acia = Acia_get(ctx->machine);
+    const size_t size = acia ? Acia_take_output(acia, output, ACIA_OUTPUT_SIZE) : 0;
+    pthread_mutex_unlock(&ctx->lock);
+
+    napi_value result;
+    if (acia) {
+        napi_create_buffer_copy(env, size, output, NULL, &result);
+    } else {
+        napi_get_null(env, &result);
+    }
+    free(output);
+    return result;
+catch:
+    napi_throw_error(env, NULL, "Error taking ACIA output");
+    return void_return(env);
+}
+
+// Queue a string for the program to read from the ACIA
+napi_value acia_send_input(const napi_env env, const napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    char *input = NULL;
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
+    size_t length = 0;
+    try(napi_get_value_string_utf8(env, args[0], NULL, 0, &length) == napi_ok, "Input is not a string");
+    input = malloc(length + 1);
+    check_mem(input, goto catch);
+    napi_get_value_string_utf8(env, args[0], input, length + 1, &length);
+
+    pthread_mutex_lock(&ctx->lock);
+    Acia *acia = Acia_get(ctx->machine);
+    const bool queued = acia && Acia_send_input(ctx->machine, acia, (const uint8_t *) input, length);
+    pthread_mutex_unlock(&ctx->lock);
+    try(queued, "No ACIA to send input to");
+    free(input);
+    return void_return(env);
+catch:
+    free(input);
+    napi_throw_error(env, NULL, "Error sending ACIA input");
+    return void_return(env);
+}
+
+// Map the easy6502 ports, random numbers at $FE and the key queue behind $FF
+napi_value attach_easy6502(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    pthread_mutex_lock(&ctx->lock);
+    const Easy6502 *ports = Easy6502_attach(ctx->machine);
+    pthread_mutex_unlock(&ctx->lock);
+    try(ports, "Could not map the easy6502 ports");
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error attaching easy6502 ports");
+    return void_return(env);
+}
+
+/*
+ * Queue a key code for the program to read from $FF, returns false when the queue is full. Does
+ * not take the machine lock, so a running batch sees the key the next time the program polls.
+ */
+napi_value push_key(const napi_env env, const napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
+    uint32_t key = 0;
+    try(napi_get_value_uint32(env, args[0], &key) == napi_ok && key <= 0xFF, "Invalid key code");
+    // Devices are only mapped and unmapped on this thread, so looking them up needs no lock either
+    Easy6502 *ports = Easy6502_get(ctx->machine);
+    try(ports, "No easy6502 ports to send the key to");
+
+    napi_value result;
+    napi_get_boolean(env, Easy6502_push_key(ports, key), &result);
+    return result;
+catch:
+    napi_throw_error(env, NULL, "Error pushing key");
+    return void_return(env);
+}
+
+// The save-state of the machine as a Buffer (format in savestate.h), also while it runs
+napi_value save_state(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+
+    // A running batch only holds the lock for a slice, the state is taken between two of them
+    pthread_mutex_lock(&ctx->lock);
+    const size_t size = SaveState_size(ctx->machine);
+    void *data = NULL;
+    napi_value buffer;
+    const napi_status status = napi_create_buffer(env, size, &data, &buffer);
+    const size_t saved = status == napi_ok ? SaveState_save(ctx->machine, data, size) : 0;
+    pthread_mutex_unlock(&ctx->lock);
+    try(saved == size, "Could not save the machine state");
+    return buffer;
+catch:
+    napi_throw_error(env, NULL, "Error saving state");
     return void_return(env);
 }
 
+// Restore the machine from a Buffer made by save_state, throws if it does not check out
+napi_value load_state(const napi_env env, const napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
+    if (reject_if_running(env, ctx)) {
+        return void_return(env);
+    }
+    void *data = NULL;
+    size_t size = 0;
+    try(napi_get_buffer_info(env, args[0], &data, &size) == napi_ok, "Save-state is not a Buffer");
+
+    pthread_mutex_lock(&ctx->lock);
+    const bool loaded = SaveState_load(ctx->machine, data, size);
+    pthread_mutex_unlock(&ctx->lock);
+    try(loaded, "Could not load the save-state");
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error loading state");
+    return void_return(env);
+}
+
+// Map a 32x32 framebuffer at `base` (1 KB), its dirty area is read with framebuffer_take_dirty
+napi_value attach_framebuffer(const napi_env env, const napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
+    uint32_t base = 0;
+    try(napi_get_value_uint32(env, args[0], &base) == napi_ok && base <= 0xFFFF, "Invalid base address");
+    pthread_mutex_lock(&ctx->lock);
+    const Framebuffer *fb = Framebuffer_attach(ctx->machine, base);
+    pthread_mutex_unlock(&ctx->lock);
+    try(fb, "Could not map a framebuffer at %04X", base);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error attaching framebuffer");
+    return void_return(env);
+}
+
+/*
+ * The rectangles changed since the last call as [{x, y, width, height}, ...] in pixels, null
+ * without a framebuffer. The pixels themselves are read from the memory view.
+ */
+napi_value framebuffer_take_dirty(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+
+    FramebufferRect rects[FRAMEBUFFER_HEIGHT];
+    pthread_mutex_lock(&ctx->lock);
+    Framebuffer *fb = Framebuffer_get(ctx->machine);
+    const size_t n_rects = fb ? Framebuffer_take_dirty(fb, rects) : 0;
+    pthread_mutex_unlock(&ctx->lock);
+
+    napi_value result;
+    if (!fb) {
+        napi_get_null(env, &result);
+        return result;
+    }
+    napi_create_array_with_length(env, n_rects, &result);
+    for (size_t i = 0; i < n_rects; i++) {
+        napi_value rect;
+        napi_create_object(env, &rect);
+        bind_unsigned_int_field(env, rect, "x", rects[i].x);
+        bind_unsigned_int_field(env, rect, "y", rects[i].y);
+        bind_unsigned_int_field(env, rect, "width", rects[i].width);
+        bind_unsigned_int_field(env, rect, "height", rects[i].height);
+        napi_set_element(env, result, i, rect);
+    }
+    return result;
+catch:
+    napi_throw_error(env, NULL, "Error taking framebuffer dirty area");
+    return void_return(env);
+}
+
+// Size of the framebuffer and its colours as 0xRRGGBB, indexed by the low nibble of a pixel
+napi_value get_framebuffer_layout(const napi_env env, napi_callback_info info) {
+    napi_value layout;
+    napi_create_object(env, &layout);
+    bind_unsigned_int_field(env, layout, "width", FRAMEBUFFER_WIDTH);
+    bind_unsigned_int_field(env, layout, "height", FRAMEBUFFER_HEIGHT);
+
+    napi_value palette;
+    napi_create_array_with_length(env, FRAMEBUFFER_PALETTE_SIZE, &palette);
+    for (uint32_t i = 0; i < FRAMEBUFFER_PALETTE_SIZE; i++) {
+        napi_value colour;
+        napi_create_uint32(env, FRAMEBUFFER_PALETTE[i], &colour);
+        napi_set_element(env, palette, i, colour);
+    }
+    napi_set_named_property(env, layout, "palette", palette);
+    return layout;
+}
+
+napi_value cpu_run(const napi_env env, const napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
+
+    uint64_t cycles = 0;
+    try(get_cycles_arg(env, args[0], &cycles), "Invalid cycles argument");
+    return queue_run(env, ctx, cycles, NO_TARGET_PC);
+catch:
+    napi_throw_error(env, NULL, "Error starting run");
+    return void_return(env);
+}
+
+napi_value cpu_run_until(const napi_env env, const napi_callback_info info) {
+    size_t argc = 2;
+    napi_value args[2];
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc == 2, "Wrong amount of arguments, expected: 2, got %lu", argc);
+
+    uint32_t pc = 0;
+    const napi_status pc_result = napi_get_value_uint32(env, args[0], &pc);
+    try(pc_result == napi_ok, "Could not get pc argument. status=%d.", pc_result);
+    try(pc <= 0xFFFF, "pc out of range: %u", pc);
+
+    uint64_t max_cycles = 0;
+    try(get_cycles_arg(env, args[1], &max_cycles), "Invalid max cycles argument");
+    return queue_run(env, ctx, max_cycles, (int32_t) pc);
+catch:
+    napi_throw_error(env, NULL, "Error starting run");
+    return void_return(env);
+}
+
+napi_value cpu_run_to_breakpoint(const napi_env env, const napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
+
+    uint64_t max_cycles = 0;
+    try(get_cycles_arg(env, args[0], &max_cycles), "Invalid max cycles argument");
+    return queue_run(env, ctx, max_cycles, UNTIL_BREAKPOINT);
+catch:
+    napi_throw_error(env, NULL, "Error starting run");
+    return void_return(env);
+}
+
+// Whether the last cpu_run_to_breakpoint stopped on a breakpoint (rather than budget or pause)
+napi_value breakpoint_hit(const napi_env env, napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    napi_value nv;
+    napi_get_boolean(env, ctx && !ctx->active_job && Breakpoint_was_hit(ctx->machine), &nv);
+    return nv;
+}
+
+static bool get_pc_arg(const napi_env env, const napi_value arg, uint16_t *pc) {
+    uint32_t value = 0;
+    const napi_status status = napi_get_value_uint32(env, arg, &value);
+    check_return(status == napi_ok, "Could not get pc argument. status=%d.", false, status);
+    check_return(value <= 0xFFFF, "pc out of range: %u", false, value);
+    *pc = (uint16_t) value;
+    return true;
+}
+
+// set_breakpoint(pc, condition?), may be called while running
+napi_value set_breakpoint(const napi_env env, const napi_callback_info info) {
+    size_t argc = 2;
+    napi_value args[2];
+    char condition[256] = "";
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc >= 1, "Wrong amount of arguments, expected: 1 or 2, got %lu", argc);
+
+    uint16_t pc = 0;
+    try(get_pc_arg(env, args[0], &pc), "Invalid pc argument");
+
+    napi_valuetype condition_type = napi_undefined;
+    if (argc == 2) {
+        napi_typeof(env, args[1], &condition_type);
+    }
+    if (condition_type == napi_string) {
+        size_t length = 0;
+        napi_get_value_string_utf8(env, args[1], condition, sizeof(condition), &length);
+        try(length < sizeof(condition) - 1, "Condition too long");
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    const bool set = Breakpoint_set(ctx->machine, pc, condition);
+    pthread_mutex_unlock(&ctx->lock);
+    if (!set) {
+        napi_throw_error(env, NULL, "Invalid breakpoint condition");
+    }
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error setting breakpoint");
+    return void_return(env);
+}
+
+napi_value clear_breakpoint(const napi_env env, const napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
+
+    uint16_t pc = 0;
+    try(get_pc_arg(env, args[0], &pc), "Invalid pc argument");
+    pthread_mutex_lock(&ctx->lock);
+    Breakpoint_clear(ctx->machine, pc);
+    pthread_mutex_unlock(&ctx->lock);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error clearing breakpoint");
+    return void_return(env);
+}
+
+napi_value clear_breakpoints(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    pthread_mutex_lock(&ctx->lock);
+    Breakpoint_clear_all(ctx->machine);
+    pthread_mutex_unlock(&ctx->lock);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error clearing breakpoints");
+    return void_return(env);
+}
+
+// [{ pc, condition? }] in address order
+napi_value get_breakpoints(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+
+    napi_value result;
+    napi_create_array(env, &result);
+    uint32_t n = 0;
+    pthread_mutex_lock(&ctx->lock);
+    const Breakpoints *breakpoints = &ctx->machine->breakpoints;
+    for (uint32_t pc = 0; pc <= 0xFFFF; pc++) {
+        if (!Breakpoint_is_set(breakpoints, pc)) {
+            continue;
+        }
+        napi_value breakpoint;
+        napi_create_object(env, &breakpoint);
+        bind_unsigned_int_field(env, breakpoint, "pc", pc);
+        const BreakpointCondition *condition = Breakpoint_get_condition(ctx->machine, pc);
+        if (condition) {
+            napi_value expression;
+            napi_create_string_utf8(env, condition->expression, NAPI_AUTO_LENGTH, &expression);
+            napi_set_named_property(env, breakpoint, "condition", expression);
+        }
+        napi_set_element(env, result, n++, breakpoint);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return result;
+catch:
+    napi_throw_error(env, NULL, "Error getting breakpoints");
+    return void_return(env);
+}
+
+static napi_value create_stats_object(const napi_env env, const uint64_t *s) {
+    napi_value object;
+    napi_create_object(env, &object);
+    bind_counter_field(env, object, "executed", s[STAT_EXECUTED]);
+    bind_counter_field(env, object, "cycles", s[STAT_CYCLES]);
+    bind_counter_field(env, object, "page_crosses", s[STAT_PAGE_CROSSES]);
+    bind_counter_field(env, object, "branches_taken", s[STAT_BRANCHES_TAKEN]);
+    bind_counter_field(env, object, "branches_not_taken", s[STAT_BRANCHES_NOT_TAKEN]);
+    return object;
+}
+
+/*
+ * { opcodes: [{ opcode, name, addressing, executed, cycles, ... }], addressing: { ABX: { executed, ... } } }
+ * with only the opcodes and addressing modes that were executed, or null when the core was built
+ * without CPU_OPCODE_STATS
+ */
+napi_value get_opcode_stats(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+
+    napi_value result;
+    if (!Stats_enabled()) {
+        napi_get_null(env, &result);
+        return result;
+    }
+
+    napi_value opcodes, addressing;
+    napi_create_object(env, &result);
+    napi_create_array(env, &opcodes);
+    napi_create_object(env, &addressing);
+
+    // Copy under the lock, build the js objects after
+    uint64_t stats[256 * STAT_COUNT];
+    pthread_mutex_lock(&ctx->lock);
+    memcpy(stats, Stats_get(ctx->machine), sizeof(stats));
+    pthread_mutex_unlock(&ctx->lock);
+
+    uint32_t n = 0;
+    for (uint32_t opcode = 0; opcode <= 0xFF; opcode++) {
+        const uint64_t *s = &stats[opcode * STAT_COUNT];
+        if (!s[STAT_EXECUTED]) {
+            continue;
+        }
+        const Instruction *ins = CPU_get_instruction(opcode);
+        const char *mode = Stats_addressing_name(opcode);
+        napi_value entry = create_stats_object(env, s);
+        bind_unsigned_int_field(env, entry, "opcode", opcode);
+        bind_string_field(env, entry, "name", ins->name);
+        bind_string_field(env, entry, "addressing", mode);
+        napi_set_element(env, opcodes, n++, entry);
+
+        bool has_mode;
+        napi_has_named_property(env, addressing, mode, &has_mode);
+        if (has_mode) {
+            continue;
+        }
+        uint64_t totals[STAT_COUNT] = {0};
+        for (uint32_t other = opcode; other <= 0xFF; other++) {
+            if (strcmp(Stats_addressing_name(other), mode) == 0) {
+                for (int stat = 0; stat < STAT_COUNT; stat++) {
+                    totals[stat] += stats[other * STAT_COUNT + stat];
+                }
+            }
+        }
+        napi_set_named_property(env, addressing, mode, create_stats_object(env, totals));
+    }
+    napi_set_named_property(env, result, "opcodes", opcodes);
+    napi_set_named_property(env, result, "addressing", addressing);
+    return result;
+catch:
+    napi_throw_error(env, NULL, "Error getting opcode stats");
+    return void_return(env);
+}
+
+// The counters in the layout of resources/opcodes.csv, null when not compiled in
+napi_value get_opcode_stats_csv(const napi_env env, const napi_callback_info info) {
+    char *csv = NULL;
+    size_t size = 0;
+    FILE *file = NULL;
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+
+    napi_value result;
+    if (!Stats_enabled()) {
+        napi_get_null(env, &result);
+        return result;
+    }
+    file = open_memstream(&csv, &size);
+    try(file, "Could not open memory stream");
+    pthread_mutex_lock(&ctx->lock);
+    Stats_write_csv(ctx->machine, file);
+    pthread_mutex_unlock(&ctx->lock);
+    fclose(file);
+
+    napi_create_string_utf8(env, csv, size, &result);
+    free(csv);
+    return result;
+catch:
+    napi_throw_error(env, NULL, "Error getting opcode stats");
+    return void_return(env);
+}
+
+napi_value reset_opcode_stats(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    pthread_mutex_lock(&ctx->lock);
+    Stats_reset(ctx->machine);
+    pthread_mutex_unlock(&ctx->lock);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error resetting opcode stats");
+    return void_return(env);
+}
+
+// Copies of the per-address counters as { read, write, execute } Uint32Arrays, null when not compiled in
+napi_value get_memory_map(const napi_env env, const napi_callback_info info) {
+    static const char *names[MEMORY_ACCESS_COUNT] = {"read", "write", "execute"};
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+
+    napi_value result;
+    if (!MemoryMap_enabled()) {
+        napi_get_null(env, &result);
+        return result;
+    }
+    napi_create_object(env, &result);
+    for (int access = 0; access < MEMORY_ACCESS_COUNT; access++) {
+        void *data = NULL;
+        napi_value buffer, counters;
+        try(napi_create_arraybuffer(env, RAM_SIZE * sizeof(uint32_t), &data, &buffer) == napi_ok,
+            "Could not create array buffer");
+        pthread_mutex_lock(&ctx->lock);
+        memcpy(data, MemoryMap_get(ctx->machine, access), RAM_SIZE * sizeof(uint32_t));
+        pthread_mutex_unlock(&ctx->lock);
+        napi_create_typedarray(env, napi_uint32_array, RAM_SIZE, buffer, 0, &counters);
+        napi_set_named_property(env, result, names[access], counters);
+    }
+    return result;
+catch:
+    napi_throw_error(env, NULL, "Error getting memory map");
+    return void_return(env);
+}
+
+// lcov tracefile of the current disassembly, null when not compiled in
+napi_value get_coverage_lcov(const napi_env env, const napi_callback_info info) {
+    char *lcov = NULL;
+    size_t size = 0;
+    FILE *file = NULL;
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+
+    napi_value result;
+    if (!MemoryMap_enabled()) {
+        napi_get_null(env, &result);
+        return result;
+    }
+    file = open_memstream(&lcov, &size);
+    try(file, "Could not open memory stream");
+    pthread_mutex_lock(&ctx->lock);
+    MemoryMap_write_lcov(ctx->machine, "disassembly.asm", file);
+    pthread_mutex_unlock(&ctx->lock);
+    fclose(file);
+
+    napi_create_string_utf8(env, lcov, size, &result);
+    free(lcov);
+    return result;
+catch:
+    napi_throw_error(env, NULL, "Error getting coverage");
+    return void_return(env);
+}
+
+napi_value reset_memory_map(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    pthread_mutex_lock(&ctx->lock);
+    MemoryMap_reset(ctx->machine);
+    pthread_mutex_unlock(&ctx->lock);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error resetting memory map");
+    return void_return(env);
+}
+
+// Start (or restart) profiling from the current pc
+napi_value profiler_start(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    pthread_mutex_lock(&ctx->lock);
+    const bool started = Profiler_start(ctx->machine);
+    pthread_mutex_unlock(&ctx->lock);
+    try(started, "Could not start profiler");
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error starting profiler");
+    return void_return(env);
+}
+
+napi_value profiler_stop(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    pthread_mutex_lock(&ctx->lock);
+    Profiler_stop(ctx->machine);
+    pthread_mutex_unlock(&ctx->lock);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error stopping profiler");
+    return void_return(env);
+}
+
+/*
+ * The profile as text, collapsed stacks with `collapsed` true, the hottest `limit` instructions
+ * otherwise (see Profiler_write_hotspots). null when the profiler is not running.
+ */
+static napi_value write_profile(const napi_env env, MachineCtx *ctx, const bool collapsed, const uint32_t limit) {
+    napi_value result;
+    char *text = NULL;
+    size_t size = 0;
+    FILE *file = open_memstream(&text, &size);
+    check_return(file, "Could not open memory stream", NULL);
+
+    pthread_mutex_lock(&ctx->lock);
+    const bool written = collapsed
+                             ? Profiler_write_collapsed(ctx->machine, file)
+                             : Profiler_write_hotspots(ctx->machine, file, limit);
+    pthread_mutex_unlock(&ctx->lock);
+    fclose(file);
+
+    if (written) {
+        napi_create_string_utf8(env, text, size, &result);
+    } else {
+        napi_get_null(env, &result);
+    }
+    free(text);
+    return result;
+}
+
+napi_value get_profile_collapsed(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    napi_value result = write_profile(env, ctx, true, 0);
+    try(result, "Could not write profile");
+    return result;
+catch:
+    napi_throw_error(env, NULL, "Error getting profile");
+    return void_return(env);
+}
+
+// Takes an optional limit, 0 or none for every executed instruction
+napi_value get_profile_hotspots(const napi_env env, const napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    uint32_t limit = 0;
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    if (argc > 0) {
+        napi_get_value_uint32(env, args[0], &limit);
+    }
+    napi_value result = write_profile(env, ctx, false, limit);
+    try(result, "Could not write profile");
+    return result;
+catch:
+    napi_throw_error(env, NULL, "Error getting profile");
+    return void_return(env);
+}
+
+// Record every executed instruction to the file at the given path, see core/trace.h
+napi_value trace_start(const napi_env env, const napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    char path[1024];
+    size_t length = 0;
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
+    try(napi_get_value_string_utf8(env, args[0], path, sizeof(path), &length) == napi_ok, "Path is not a string");
+    try(length < sizeof(path) - 1, "Path too long");
+
+    pthread_mutex_lock(&ctx->lock);
+    const bool started = Trace_start(ctx->machine, path);
+    pthread_mutex_unlock(&ctx->lock);
+    try(started, "Could not start trace to %s", path);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error starting trace");
+    return void_return(env);
+}
+
+// Finish the trace, returns { records, blocks, bytes, dropped_records }
+napi_value trace_stop(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    pthread_mutex_lock(&ctx->lock);
+    const TraceStats stats = Trace_stop(ctx->machine);
+    pthread_mutex_unlock(&ctx->lock);
+
+    napi_value result;
+    napi_create_object(env, &result);
+    bind_counter_field(env, result, "records", stats.records);
+    bind_counter_field(env, result, "blocks", stats.blocks);
+    bind_counter_field(env, result, "bytes", stats.bytes);
+    bind_counter_field(env, result, "dropped_records", stats.dropped_records);
+    return result;
+catch:
+    napi_throw_error(env, NULL, "Error stopping trace");
+    return void_return(env);
+}
+
+napi_value cpu_pause(const napi_env env, napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    if (ctx->active_job) {
+        // Stop the slice loop and interrupt the slice in flight
+        atomic_store(&ctx->pause_requested, true);
+        CPU_pause(ctx->machine);
+        // A paced run waiting for its next slice finds out right away
+        RunJob *job = ctx->active_job;
+        if (job->hz && uv_is_active((uv_handle_t *) &job->timer)) {
+            uv_timer_start(&job->timer, next_slice, 0, 0);
+        }
+    }
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error pausing cpu");
+    return void_return(env);
+}
+
+napi_value cpu_is_running(const napi_env env, napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    napi_value nv;
+    napi_get_boolean(env, ctx && ctx->active_job != NULL, &nv);
+    return nv;
+}
+
+// Pace runs to `hz` cycles per second from the next run on, 0 runs as fast as possible
+napi_value set_clock_hz(const napi_env env, const napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    MachineCtx *ctx = get_machine_args(env, info, &argc, args);
+    try(ctx, "Machine is null");
+    try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
+    uint32_t hz = 0;
+    try(napi_get_value_uint32(env, args[0], &hz) == napi_ok, "Could not get hz argument");
+    atomic_store(&ctx->clock_hz, hz);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error setting clock");
+    return void_return(env);
+}
+
+// { hz, speed, cycles, slices, late_slices, resyncs, elapsed_ns, sleep_ns, max_lag_ns, oversleep_ns, drift_ns }
+// of the current or last paced run
+napi_value get_pacer_stats(const napi_env env, const napi_callback_info info) {
+    MachineCtx *ctx = get_machine_args(env, info, NULL, NULL);
+    try(ctx, "Machine is null");
+    pthread_mutex_lock(&ctx->lock);
+    const PacerStats s = ctx->pacer_stats;
+    pthread_mutex_unlock(&ctx->lock);
+    const uint32_t hz = atomic_load(&ctx->clock_hz);
+
+    napi_value result, nv;
+    napi_create_object(env, &result);
+    bind_unsigned_int_field(env, result, "hz", hz);
+    napi_create_double(env, hz ? Pacer_speed(&s, hz) : 0, &nv);
+    napi_set_named_property(env, result, "speed", nv);
+    bind_counter_field(env, result, "cycles", s.cycles);
+    bind_counter_field(env, result, "slices", s.slices);
+    bind_counter_field(env, result, "late_slices", s.late_slices);
+    bind_counter_field(env, result, "resyncs", s.resyncs);
+    bind_counter_field(env, result, "elapsed_ns", s.elapsed_ns);
+    bind_counter_field(env, result, "sleep_ns", s.sleep_ns);
+    bind_counter_field(env, result, "max_lag_ns", s.max_lag_ns);
+    bind_counter_field(env, result, "oversleep_ns", s.oversleep_ns);
+    napi_create_double(env, (double) s.drift_ns, &nv);
+    napi_set_named_property(env, result, "drift_ns", nv);
+    return result;
+catch:
+    napi_throw_error(env, NULL, "Error getting pacer stats");
+    return void_return(env);
+}
+
+// Level of the core's log for every machine: "trace", "debug", "info", "warn", "error" or "off"
+napi_value set_log_level(const napi_env env, const napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    char name[16];
+    size_t length = 0;
+    napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+    try(argc == 1, "Wrong amount of arguments, expected: 1, got %lu", argc);
+    try(napi_get_value_string_utf8(env, args[0], name, sizeof(name), &length) == napi_ok, "Level is not a string");
+    const int level = Log_parse_level(name);
+    try(level >= 0, "Unknown log level %s", name);
+    Log_set_level(level);
+    return void_return(env);
+catch:
+    napi_throw_error(env, NULL, "Error setting log level");
+    return void_return(env);
+}
+
+#define MACHINE_METHOD(name) {#name, NULL, name, NULL, NULL, NULL, napi_default, NULL}
+
 // Module initialization
 napi_value init(const napi_env env, const napi_value exports) {
-    napi_value fn_cpu_init;
-    napi_value fn_load_rom;
-    napi_value fn_cpu_reset;
-    napi_value fn_get_cpu_state;
-    napi_value fn_get_bus_page;
-    napi_value fn_cpu_step;
-    napi_value fn_disassemble;
-    napi_value fn_get_disassembly;
-    napi_value fn_load_file;
-    napi_value fn_cpu_nmi;
-    napi_value fn_cpu_irq;
-
-    napi_create_function(env, "cpu_init", NAPI_AUTO_LENGTH, cpu_init, NULL, &fn_cpu_init);
-    napi_create_function(env, "load_rom", NAPI_AUTO_LENGTH, load_rom, NULL, &fn_load_rom);
-    napi_create_function(env, "load_file", NAPI_AUTO_LENGTH, load_file, NULL, &fn_load_file);
-    napi_create_function(env, "cpu_reset", NAPI_AUTO_LENGTH, cpu_reset, NULL, &fn_cpu_reset);
-    napi_create_function(env, "get_cpu_state", NAPI_AUTO_LENGTH, get_cpu_state, NULL, &fn_get_cpu_state);
-    napi_create_function(env, "get_bus_page", NAPI_AUTO_LENGTH, get_bus_page, NULL, &fn_get_bus_page);
-    napi_create_function(env, "cpu_step", NAPI_AUTO_LENGTH, cpu_step, NULL, &fn_cpu_step);
-    napi_create_function(env, "disassemble", NAPI_AUTO_LENGTH, disassemble, NULL, &fn_disassemble);
-    napi_create_function(env, "get_disassembly", NAPI_AUTO_LENGTH, get_disassembly, NULL, &fn_get_disassembly);
-    napi_create_function(env, "cpu_nmi", NAPI_AUTO_LENGTH, cpu_nmi, NULL, &fn_cpu_nmi);
-    napi_create_function(env, "cpu_irq", NAPI_AUTO_LENGTH, cpu_irq, NULL, &fn_cpu_irq);
-    napi_set_named_property(env, exports, "cpu_init", fn_cpu_init);
-    napi_set_named_property(env, exports, "load_rom", fn_load_rom);
-    napi_set_named_property(env, exports, "load_file", fn_load_file);
-    napi_set_named_property(env, exports, "cpu_reset", fn_cpu_reset);
-    napi_set_named_property(env, exports, "get_cpu_state", fn_get_cpu_state);
-    napi_set_named_property(env, exports, "get_bus_page", fn_get_bus_page);
-    napi_set_named_property(env, exports, "cpu_step", fn_cpu_step);
-    napi_set_named_property(env, exports, "disassemble", fn_disassemble);
-    napi_set_named_property(env, exports, "get_disassembly", fn_get_disassembly);
-    napi_set_named_property(env, exports, "cpu_nmi", fn_cpu_nmi);
-    napi_set_named_property(env, exports, "cpu_irq", fn_cpu_irq);
+    // The instruction table is shared by every machine
+    CPU_load_instructions();
+
+    const napi_property_descriptor methods[] = {
+        MACHINE_METHOD(destroy),
+        MACHINE_METHOD(recycle),
+        MACHINE_METHOD(cpu_init),
+        MACHINE_METHOD(load_rom),
+        MACHINE_METHOD(load_file),
+        MACHINE_METHOD(cpu_reset),
+        MACHINE_METHOD(get_cpu_state),
+        MACHINE_METHOD(get_cpu_state_buffer),
+        MACHINE_METHOD(get_bus_page),
+        MACHINE_METHOD(get_memory_view),
+        MACHINE_METHOD(take_dirty_pages),
+        MACHINE_METHOD(cpu_step),
+        MACHINE_METHOD(cpu_step_n),
+        MACHINE_METHOD(disassemble),
+        MACHINE_METHOD(get_disassembly),
+        MACHINE_METHOD(get_disassembly_size),
+        MACHINE_METHOD(find_disassembly_line),
+        MACHINE_METHOD(cpu_nmi),
+        MACHINE_METHOD(cpu_irq),
+        MACHINE_METHOD(attach_via),
+        MACHINE_METHOD(attach_acia),
+        MACHINE_METHOD(acia_take_output),
+        MACHINE_METHOD(acia_send_input),
+        MACHINE_METHOD(attach_easy6502),
+        MACHINE_METHOD(push_key),
+        MACHINE_METHOD(attach_framebuffer),
+        MACHINE_METHOD(save_state),
+        MACHINE_METHOD(load_state),
+        MACHINE_METHOD(framebuffer_take_dirty),
+        MACHINE_METHOD(cpu_run),
+        MACHINE_METHOD(cpu_run_until),
+        MACHINE_METHOD(cpu_run_to_breakpoint),
+        MACHINE_METHOD(breakpoint_hit),
+        MACHINE_METHOD(set_breakpoint),
+        MACHINE_METHOD(clear_breakpoint),
+        MACHINE_METHOD(clear_breakpoints),
+        MACHINE_METHOD(get_breakpoints),
+        MACHINE_METHOD(get_opcode_stats),
+        MACHINE_METHOD(get_opcode_stats_csv),
+        MACHINE_METHOD(reset_opcode_stats),
+        MACHINE_METHOD(get_memory_map),
+        MACHINE_METHOD(get_coverage_lcov),
+        MACHINE_METHOD(reset_memory_map),
+        MACHINE_METHOD(profiler_start),
+        MACHINE_METHOD(profiler_stop),
+        MACHINE_METHOD(get_profile_collapsed),
+        MACHINE_METHOD(get_profile_hotspots),
+        MACHINE_METHOD(trace_start),
+        MACHINE_METHOD(trace_stop),
+        MACHINE_METHOD(cpu_pause),
+        MACHINE_METHOD(set_clock_hz),
+        MACHINE_METHOD(get_pacer_stats),
+        MACHINE_METHOD(cpu_is_running),
+    };
+
+    napi_value machine_class;
+    napi_define_class(env, "Machine", NAPI_AUTO_LENGTH, machine_new, NULL,
+                      sizeof(methods) / sizeof(methods[0]), methods, &machine_class);
+
+    napi_value fn_get_cpu_layout;
+    napi_create_function(env, "get_cpu_layout", NAPI_AUTO_LENGTH, get_cpu_layout, NULL, &fn_get_cpu_layout);
+    napi_set_named_property(env, exports, "Machine", machine_class);
+    napi_set_named_property(env, exports, "get_cpu_layout", fn_get_cpu_layout);
+
+    napi_value fn_get_framebuffer_layout;
+    napi_create_function(env, "get_framebuffer_layout", NAPI_AUTO_LENGTH, get_framebuffer_layout, NULL,
+                         &fn_get_framebuffer_layout);
+    napi_set_named_property(env, exports, "get_framebuffer_layout", fn_get_framebuffer_layout);
+
+    napi_value fn_set_log_level;
+    napi_create_function(env, "set_log_level", NAPI_AUTO_LENGTH, set_log_level, NULL, &fn_set_log_level);
+    napi_set_named_property(env, exports, "set_log_level", fn_set_log_level);
     return exports;
 }
 
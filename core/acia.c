@@ -0,0 +1,261 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "acia.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bus.h"
+#include "dbg.h"
+#include "events.h"
+
+#define INPUT_INITIAL_CAPACITY 256
+
+static bool rx_irq_enabled(const Acia *a) {
+    return (a->command & (ACIA_COMMAND_DTR | ACIA_COMMAND_IRD)) == ACIA_COMMAND_DTR;
+}
+
+static void set_irq(Machine *m, Acia *a, const bool irq) {
+    a->irq = irq;
+    Events_set_irq(m, EVENTS_IRQ_ACIA, irq);
+}
+
+static uint8_t status(const Acia *a) {
+    // TDRE only drops when the output has nowhere to go, DCD and DSR (bits 5, 6) read as connected
+    return (a->in_len ? ACIA_STATUS_RDRF : 0) |
+           (a->sink || a->out_len < ACIA_OUTPUT_SIZE ? ACIA_STATUS_TDRE : 0) |
+           (a->irq ? ACIA_STATUS_IRQ : 0);
+}
+
+static void transmit(Acia *a, const uint8_t data) {
+    if (a->out_len == ACIA_OUTPUT_SIZE) {
+        if (!a->sink) {
+            a->stats.dropped++;
+            return;
+        }
+        Acia_flush(a);
+    }
+    a->output[(a->out_head + a->out_len) % ACIA_OUTPUT_SIZE] = data;
+    a->out_len++;
+    a->stats.bytes_out++;
+}
+
+static uint8_t acia_peek(const Machine *m, const void *ctx, const uint16_t addr) {
+    const Acia *a = ctx;
+    switch ((AciaRegister) (addr & (ACIA_N_REGISTERS - 1))) {
+        case ACIA_DATA: return a->in_len ? a->input[a->in_head] : 0;
+        case ACIA_STATUS: return status(a);
+        case ACIA_COMMAND: return a->command;
+        case ACIA_CONTROL: return a->control;
+    }
+    return 0;
+}
+
+static uint8_t acia_read(Machine *m, void *ctx, const uint16_t addr) {
+    Acia *a = ctx;
+    const uint8_t data = acia_peek(m, a, addr);
+    switch ((AciaRegister) (addr & (ACIA_N_REGISTERS - 1))) {
+        case ACIA_DATA:
+            if (a->in_len) {
+                a->in_head++;
+                a->in_len--;
+                a->stats.bytes_in++;
+                // The next queued byte arrives in the receive register right away
+                if (a->in_len && rx_irq_enabled(a)) {
+                    set_irq(m, a, true);
+                }
+            }
+            break;
+        case ACIA_STATUS:
+            set_irq(m, a, false);
+            break;
+        default:
+            break;
+    }
+    return data;
+}
+
+static void acia_write(Machine *m, void *ctx, const uint16_t addr, const uint8_t data) {
+    Acia *a = ctx;
+    switch ((AciaRegister) (addr & (ACIA_N_REGISTERS - 1))) {
+        case ACIA_DATA:
+            transmit(a, data);
+            break;
+        case ACIA_STATUS:
+            // Programmed reset, the control register survives it
+            a->command &= 0xE0;
+            set_irq(m, a, false);
+            break;
+        case ACIA_COMMAND:
+            a->command = data;
+            set_irq(m, a, a->irq && rx_irq_enabled(a));
+            break;
+        case ACIA_CONTROL:
+            a->control = data;
+            break;
+    }
+}
+
+static void acia_reset(Machine *m, void *ctx) {
+    Acia *a = ctx;
+    a->command = 0;
+    a->control = 0;
+    set_irq(m, a, false);
+}
+
+static void acia_destroy(Machine *m, void *ctx) {
+    Acia *a = ctx;
+    Acia_flush(a);
+    Events_set_irq(m, EVENTS_IRQ_ACIA, false);
+    free(a->input);
+    free(a);
+}
+
+// What a save-state holds of the ACIA, followed by the input not read yet. The output is the host's.
+typedef struct SavedAcia {
+    uint8_t command;
+    uint8_t control;
+    uint8_t irq;
+    uint8_t reserved;
+    uint32_t in_len;
+} SavedAcia;
+
+static size_t acia_save(const Machine *m, const void *ctx, uint8_t *out) {
+    const Acia *a = ctx;
+    if (out) {
+        const SavedAcia saved = {
+            .command = a->command, .control = a->control, .irq = a->irq, .in_len = (uint32_t) a->in_len
+        };
+        memcpy(out, &saved, sizeof(saved));
+        if (a->in_len) {
+            memcpy(out + sizeof(saved), a->input + a->in_head, a->in_len);
+        }
+    }
+    return sizeof(SavedAcia) + a->in_len;
+}
+
+static bool acia_load(Machine *m, void *ctx, const uint8_t *data, const size_t size) {
+    Acia *a = ctx;
+    a->in_head = 0;
+    a->in_len = 0;
+    if (!data) {
+        acia_reset(m, a);
+        return true;
+    }
+    SavedAcia saved;
+    if (size < sizeof(saved)) {
+        return false;
+    }
+    memcpy(&saved, data, sizeof(saved));
+    if (size != sizeof(saved) + saved.in_len) {
+        return false;
+    }
+    a->command = saved.command;
+    a->control = saved.control;
+    // Queued with the receiver interrupt off, the saved line level is restored after
+    const uint8_t command = a->command;
+    a->command = 0;
+    const bool queued = Acia_send_input(m, a, data + sizeof(saved), saved.in_len);
+    a->command = command;
+    set_irq(m, a, saved.irq);
+    return queued;
+}
+
+Acia *Acia_attach(Machine *m, const uint16_t base) {
+    check_return(!Acia_get(m), "Machine already has an ACIA", NULL);
+    check_return(base <= 0xFFFF - (ACIA_N_REGISTERS - 1), "ACIA does not fit at %04X", NULL, base);
+
+    Acia *a = calloc(1, sizeof(Acia));
+    check_mem_return(a, NULL);
+
+    const Device device = {
+        .name = ACIA_DEVICE_NAME,
+        .start = base,
+        .end = base + ACIA_N_REGISTERS - 1,
+        .ctx = a,
+        .read = acia_read,
+        .peek = acia_peek,
+        .write = acia_write,
+        .reset = acia_reset,
+        .destroy = acia_destroy,
+        .save = acia_save,
+        .load = acia_load,
+    };
+    if (!BUS_map_device(m, &device)) {
+        free(a);
+        return NULL;
+    }
+    return a;
+}
+
+Acia *Acia_get(const Machine *m) {
+    const Device *d = BUS_find_device(m, ACIA_DEVICE_NAME);
+    return d ? d->ctx : NULL;
+}
+
+void Acia_set_output(Acia *a, FILE *file) {
+    Acia_flush(a);
+    a->sink = file;
+}
+
+void Acia_flush(Acia *a) {
+    if (!a->sink || !a->out_len) {
+        return;
+    }
+    // At most two writes, the ring may wrap
+    const size_t first = a->out_len < ACIA_OUTPUT_SIZE - a->out_head ? a->out_len : ACIA_OUTPUT_SIZE - a->out_head;
+    fwrite(&a->output[a->out_head], 1, first, a->sink);
+    fwrite(a->output, 1, a->out_len - first, a->sink);
+    fflush(a->sink);
+    a->out_head = 0;
+    a->out_len = 0;
+    a->stats.flushes++;
+}
+
+size_t Acia_take_output(Acia *a, uint8_t *buffer, const size_t size) {
+    size_t taken = 0;
+    while (taken < size && a->out_len) {
+        const size_t contiguous = ACIA_OUTPUT_SIZE - a->out_head;
+        size_t n = a->out_len < contiguous ? a->out_len : contiguous;
+        n = n < size - taken ? n : size - taken;
+        memcpy(buffer + taken, &a->output[a->out_head], n);
+        a->out_head = (a->out_head + n) % ACIA_OUTPUT_SIZE;
+        a->out_len -= n;
+        taken += n;
+    }
+    if (taken) {
+        a->stats.flushes++;
+    }
+    return taken;
+}
+
+bool Acia_send_input(Machine *m, Acia *a, const uint8_t *data, const size_t len) {
+    if (!len) {
+        return true;
+    }
+    if (a->in_head + a->in_len + len > a->in_capacity) {
+        // Reuse the consumed front first, grow only when that is not enough
+        if (a->in_len) {
+            memmove(a->input, a->input + a->in_head, a->in_len);
+        }
+        a->in_head = 0;
+        size_t capacity = a->in_capacity ? a->in_capacity : INPUT_INITIAL_CAPACITY;
+        while (a->in_len + len > capacity) {
+            capacity *= 2;
+        }
+        if (capacity != a->in_capacity) {
+            uint8_t *input = realloc(a->input, capacity);
+            check_mem_return(input, false);
+            a->input = input;
+            a->in_capacity = capacity;
+        }
+    }
+    memcpy(a->input + a->in_head + a->in_len, data, len);
+    a->in_len += len;
+    if (rx_irq_enabled(a)) {
+        set_irq(m, a, true);
+    }
+    return true;
+}
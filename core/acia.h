@@ -0,0 +1,98 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_ACIA_H
+#define INC_6502_EMULATOR_ACIA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct Machine Machine;
+
+#define ACIA_DEVICE_NAME "acia"
+#define ACIA_DEFAULT_BASE 0x5000
+#define ACIA_N_REGISTERS 4
+// Bytes written by the program that are kept before they have to go somewhere
+#define ACIA_OUTPUT_SIZE 65536
+
+typedef enum AciaRegister {
+    ACIA_DATA,
+    // Reads the status, writing it is a programmed reset
+    ACIA_STATUS,
+    ACIA_COMMAND,
+    ACIA_CONTROL,
+} AciaRegister;
+
+#define ACIA_STATUS_OVERRUN (1 << 2)
+#define ACIA_STATUS_RDRF (1 << 3)
+#define ACIA_STATUS_TDRE (1 << 4)
+#define ACIA_STATUS_IRQ (1 << 7)
+// DTR, enables the receiver interrupt unless IRD is set as well
+#define ACIA_COMMAND_DTR (1 << 0)
+#define ACIA_COMMAND_IRD (1 << 1)
+
+typedef struct AciaStats {
+    uint64_t bytes_out;
+    uint64_t bytes_in;
+    // Times output was handed to the host, each one a single write
+    uint64_t flushes;
+    // Bytes written while the output buffer was full and nobody drains it
+    uint64_t dropped;
+} AciaStats;
+
+/*
+ * 6551 style serial port as a console. Bytes the program writes to DATA go into a ring buffer
+ * instead of out one syscall at a time. With an output file the ring is written to it in one go
+ * whenever it fills up and on Acia_flush (the run loop calls that between batches). Without one
+ * the host drains it with Acia_take_output and the program sees TDRE drop while it is full, just
+ * like a real transmitter that is still busy.
+ *
+ * Input is a queue the host appends to, RDRF is set while it holds anything and reading DATA
+ * takes the next byte. With DTR set and IRD clear in the command register a byte arriving raises
+ * IRQ, reading the status register acknowledges it. There are no baud rates, framing or
+ * transmitter interrupts: bytes move as fast as the program moves them.
+ */
+typedef struct Acia {
+    uint8_t output[ACIA_OUTPUT_SIZE];
+    size_t out_head;
+    size_t out_len;
+    FILE *sink;
+    uint8_t *input;
+    size_t in_head;
+    size_t in_len;
+    size_t in_capacity;
+    uint8_t command;
+    uint8_t control;
+    bool irq;
+    AciaStats stats;
+} Acia;
+
+/**
+ * Map an ACIA's registers at base..base+3, a machine has at most one. Output is kept for
+ * Acia_take_output until Acia_set_output names a file.
+ * @return the ACIA, owned by the machine until its devices are unmapped, or NULL on failure
+ */
+Acia *Acia_attach(Machine *m, uint16_t base);
+
+// The machine's ACIA, NULL if none is mapped
+Acia *Acia_get(const Machine *m);
+
+// Write output to `file` (e.g. stdout) from now on, NULL to keep it for Acia_take_output
+void Acia_set_output(Acia *a, FILE *file);
+
+// Write what is buffered to the output file, if there is one
+void Acia_flush(Acia *a);
+
+// Move up to `size` buffered output bytes into `buffer`, returns how many
+size_t Acia_take_output(Acia *a, uint8_t *buffer, size_t size);
+
+/**
+ * Queue `len` bytes for the program to read.
+ * @return false if out of memory
+ */
+bool Acia_send_input(Machine *m, Acia *a, const uint8_t *data, size_t len);
+
+#endif //INC_6502_EMULATOR_ACIA_H
@@ -0,0 +1,32 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_ALU_H
+#define INC_6502_EMULATOR_ALU_H
+
+#include <stdint.h>
+
+#include "cpu.h"
+
+/*
+ * ADC and SBC outcomes for every accumulator, operand and carry, generated at build time by
+ * alu_gen.c. An entry holds the result in the low byte and the N, V, Z and C bits of the status
+ * register in the high byte. Binary SBC is binary ADC of the inverted operand, decimal mode has a
+ * table for each. Decimal mode follows the NMOS 6502, where N, V and Z come from the binary sum,
+ * unless the generator is built with CPU_MODEL_65C02. The 65C02 takes N and Z from the decimal
+ * result, and its decimal SBC produces a different result for invalid BCD operands.
+ */
+#define ALU_FLAGS (FLAG_N | FLAG_V | FLAG_Z | FLAG_C)
+
+typedef enum AluMode {
+    ALU_BINARY,
+    ALU_DECIMAL_ADC,
+    ALU_DECIMAL_SBC,
+    ALU_MODE_COUNT
+} AluMode;
+
+// Indexed by mode, carry, accumulator and operand
+extern const uint16_t ALU_table[ALU_MODE_COUNT][2][256][256];
+
+#endif //INC_6502_EMULATOR_ALU_H
@@ -0,0 +1,119 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+/*
+ * Writes the C source of ALU_table (see alu.h). Run by the build, the arithmetic below is the
+ * reference for what the emulated ADC and SBC do.
+ *
+ * usage: 6502_alu_gen OUTPUT.c
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "alu.h"
+
+static uint16_t entry(const uint8_t result, const bool n, const bool v, const bool z, const bool c) {
+    const uint8_t flags = (n ? FLAG_N : 0) | (v ? FLAG_V : 0) | (z ? FLAG_Z : 0) | (c ? FLAG_C : 0);
+    return (uint16_t) (result | flags << 8);
+}
+
+static uint16_t binary_adc(const uint8_t a, const uint8_t b, const uint8_t carry) {
+    const uint16_t sum = a + b + carry;
+    const bool v = (~(a ^ b) & (a ^ sum)) & 0x80;
+    return entry(sum & 0xFF, sum & 0x80, v, (sum & 0xFF) == 0, sum > 0xFF);
+}
+
+static uint16_t decimal_adc(const uint8_t a, const uint8_t b, const uint8_t carry) {
+    int lo = (a & 0x0F) + (b & 0x0F) + carry;
+    if (lo > 9) {
+        lo += 6;
+    }
+    int hi = (a >> 4) + (b >> 4) + (lo > 0x0F);
+    // V is taken before the high digit is adjusted
+    const bool v = (~(a ^ b) & (a ^ (hi << 4))) & 0x80;
+#ifdef CPU_MODEL_65C02
+    if (hi > 9) {
+        hi += 6;
+    }
+    const uint8_t result = (uint8_t) ((hi << 4) | (lo & 0x0F));
+    return entry(result, result & 0x80, v, result == 0, hi > 0x0F);
+#else
+    // So is N, Z comes from the binary sum
+    const bool n = hi & 0x08;
+    const bool z = ((a + b + carry) & 0xFF) == 0;
+    if (hi > 9) {
+        hi += 6;
+    }
+    return entry((uint8_t) ((hi << 4) | (lo & 0x0F)), n, v, z, hi > 0x0F);
+#endif
+}
+
+#ifdef CPU_MODEL_65C02
+static uint16_t decimal_sbc(const uint8_t a, const uint8_t b, const uint8_t carry) {
+    // C and V are those of the binary subtraction, N and Z come from the result
+    const uint16_t flags = binary_adc(a, b ^ 0xFF, carry) & ((FLAG_C | FLAG_V) << 8);
+    const int lo = (a & 0x0F) - (b & 0x0F) + carry - 1;
+    int difference = a - b + carry - 1;
+    if (difference < 0) {
+        difference -= 0x60;
+    }
+    if (lo < 0) {
+        difference -= 0x06;
+    }
+    const uint8_t result = (uint8_t) difference;
+    return flags | entry(result, result & 0x80, false, result == 0, false);
+}
+#else
+
+static uint16_t decimal_sbc(const uint8_t a, const uint8_t b, const uint8_t carry) {
+    // Flags are those of the binary subtraction
+    const uint16_t flags = binary_adc(a, b ^ 0xFF, carry) & 0xFF00;
+    int lo = (a & 0x0F) - (b & 0x0F) - (1 - carry);
+    int hi = (a >> 4) - (b >> 4);
+    if (lo & 0x10) {
+        lo -= 6;
+        hi--;
+    }
+    if (hi & 0x10) {
+        hi -= 6;
+    }
+    return flags | (uint8_t) ((hi << 4) | (lo & 0x0F));
+}
+#endif
+
+int main(const int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s OUTPUT.c\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    FILE *file = fopen(argv[1], "w");
+    if (!file) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    uint16_t (*const modes[ALU_MODE_COUNT])(uint8_t, uint8_t, uint8_t) = {binary_adc, decimal_adc, decimal_sbc};
+    fprintf(file, "// Generated by alu_gen.c, do not edit\n\n#include \"alu.h\"\n\n");
+    fprintf(file, "const uint16_t ALU_table[ALU_MODE_COUNT][2][256][256] = {\n");
+    for (int mode = 0; mode < ALU_MODE_COUNT; mode++) {
+        fprintf(file, "{\n");
+        for (int carry = 0; carry < 2; carry++) {
+            fprintf(file, "{\n");
+            for (int a = 0; a < 256; a++) {
+                fprintf(file, "{ // mode %d, carry %d, a %02X", mode, carry, a);
+                for (int b = 0; b < 256; b++) {
+                    fprintf(file, "%s0x%04X,", b % 16 ? "" : "\n", modes[mode](a, b, carry));
+                }
+                fprintf(file, "\n},\n");
+            }
+            fprintf(file, "},\n");
+        }
+        fprintf(file, "},\n");
+    }
+    fprintf(file, "};\n");
+    return fclose(file) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,421 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+/*
+ * Throughput benchmark of the core. Every workload is run through CPU_run in batches of a fixed
+ * number of cycles, the loop the CLI and the server run programs with, events and pause checks
+ * included. Each batch is timed on its own so we get a latency distribution on top of the
+ * averages, instructions come from CPU_get_instruction_count. --step adds a second series through
+ * CPU_step_n (batches of --batch-size instructions) to compare with, that is the single stepping
+ * path of the debugger rather than the one programs run on.
+ *
+ * Workloads are the example programs (the .txt files in resources/examples, loaded at $0600 like
+ * the web client does), the rom images (the .bin files there, mapped to the top of memory) and a
+ * few synthetic kernels hammering one part of the instruction set each.
+ *
+ * usage: 6502_bench [--examples DIR] [--batches N] [--batch-cycles N] [--step] [--batch-size N]
+ *                   [--filter NAME] [--json FILE] [--opcode-stats DIR] [--trace DIR]
+ *
+ * --opcode-stats writes DIR/<workload>.csv with the per-opcode counters of each workload (warmup
+ * included), only available when built with -DCPU_OPCODE_STATS=ON. --trace records the timed
+ * batches of each workload to DIR/<workload>.trace, DIR/<workload>.step.trace for the step series
+ * (see 6502_trace), to measure the tracing cost.
+ */
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bus.h"
+#include "cpu.h"
+#include "dbg.h"
+#include "machine.h"
+#include "rom.h"
+#include "stats.h"
+#include "trace.h"
+
+#ifndef BENCH_EXAMPLES_DIR
+#define BENCH_EXAMPLES_DIR "../resources/examples"
+#endif
+
+#define BENCH_PROGRAM_ORG 0x0600
+#define BENCH_MAX_WORKLOADS 64
+#define BENCH_DEFAULT_BATCHES 200
+#define BENCH_DEFAULT_BATCH_SIZE 100000
+#define BENCH_DEFAULT_BATCH_CYCLES 300000
+#define BENCH_WARMUP_BATCHES 5
+
+typedef enum WorkloadKind {
+    WORKLOAD_KERNEL,
+    WORKLOAD_EXAMPLE,
+    WORKLOAD_ROM,
+} WorkloadKind;
+
+typedef enum Series {
+    // CPU_run, batches of cycles
+    SERIES_RUN,
+    // CPU_step_n, batches of instructions
+    SERIES_STEP,
+} Series;
+
+static const char *series_names[] = {"run", "step"};
+
+typedef struct Workload {
+    char name[64];
+    WorkloadKind kind;
+    // Hex string for kernels, file path for examples and roms
+    char source[512];
+} Workload;
+
+typedef struct BenchResult {
+    uint64_t instructions;
+    uint64_t cycles;
+    double seconds;
+    double p50_batch_us;
+    double p99_batch_us;
+} BenchResult;
+
+/*
+ * Synthetic kernels, all endless loops at $0600. The assembly is in the comments so they can be
+ * checked against the disassembler.
+ */
+static const Workload kernels[] = {
+    {
+        // loop: CLC, ADC #$07, EOR #$5A, AND #$F0, ORA #$0F, ASL A, ROR A, SEC, SBC #$03, CMP #$40,
+        //       INX, DEY, JMP loop
+        "alu", WORKLOAD_KERNEL,
+        "18 69 07 49 5A 29 F0 09 0F 0A 6A 38 E9 03 C9 40 E8 88 4C 00 06"
+    },
+    {
+        // outer: LDX #$00; next: LDY #$00; inner: DEY, BMI +0, BPL +0, BNE inner,
+        //        DEX, BEQ outer, JMP next
+        "branch", WORKLOAD_KERNEL,
+        "A2 00 A0 00 88 30 00 10 00 D0 F9 CA F0 F2 4C 02 06"
+    },
+    {
+        // Pointers $0400 at $10 and $0500 at $12, then
+        // loop: LDY #$00; copy: LDA $0200,Y, STA $0300,Y, LDA ($10),Y, STA ($12),Y, INC $0200,
+        //       INY, BNE copy, JMP loop
+        "memory", WORKLOAD_KERNEL,
+        "A9 04 85 11 A9 05 85 13 A0 00 B9 00 02 99 00 03 B1 10 91 12 EE 00 02 C8 D0 F0 4C 08 06"
+    },
+    {
+        // loop: JSR sub, PHA, PHP, PLP, PLA, JMP loop
+        // sub:  PHA, TXA, PHA, PLA, TAX, PLA, RTS
+        "stack", WORKLOAD_KERNEL,
+        "20 0A 06 48 08 28 68 4C 00 06 48 8A 48 68 AA 68 60"
+    },
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    const double lhs = *(const double *) a;
+    const double rhs = *(const double *) b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static bool ends_with(const char *str, const char *suffix) {
+    const size_t len = strlen(str);
+    const size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(str + len - suffix_len, suffix) == 0;
+}
+
+static char *read_file(const char *path, long *size) {
+    FILE *file = fopen(path, "rb");
+    check_return(file, "Failed to open %s", NULL, path);
+
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+
+    // Zero terminated so text files can be used as strings right away
+    char *data = calloc(*size + 1, sizeof(char));
+    check_mem(data, {
+        fclose(file);
+        return NULL;
+    });
+    fread(data, 1, *size, file);
+    fclose(file);
+    return data;
+}
+
+/**
+ * The bytes of an example program, i.e. the hex pairs following its "Binary" heading, normalized
+ * to single spaces for BUS_load_ROM_from_str. Examples placing themselves with an origin directive
+ * (*=$XXXX) are the sources of the rom images and are left to those.
+ */
+static bool read_example(const char *path, char *hex, const size_t hex_size) {
+    long size = 0;
+    char *text = read_file(path, &size);
+    check_return(text, "Could not read example %s", false, path);
+
+    const char *binary = strstr(text, "Binary");
+    if (!binary || strstr(text, "*=")) {
+        free(text);
+        return false;
+    }
+
+    size_t len = 0;
+    const char *delimiters = " \t\r\n:-";
+    for (char *token = strtok((char *) binary + strlen("Binary"), delimiters); token;
+         token = strtok(NULL, delimiters)) {
+        char *end;
+        strtoul(token, &end, 16);
+        if (strlen(token) != 2 || *end != '\0' || len + 3 >= hex_size) {
+            continue;
+        }
+        len += snprintf(hex + len, hex_size - len, len ? " %s" : "%s", token);
+    }
+    free(text);
+    return len > 0;
+}
+
+static int collect_workloads(const char *examples_dir, Workload *workloads) {
+    int n = 0;
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        workloads[n++] = kernels[i];
+    }
+
+    // Sorted so runs are listed in the same order on every machine
+    struct dirent **entries;
+    const int n_entries = scandir(examples_dir, &entries, NULL, alphasort);
+    check_return(n_entries >= 0, "Could not open examples directory %s", n, examples_dir);
+    for (int i = 0; i < n_entries; i++) {
+        const char *file = entries[i]->d_name;
+        Workload *w = &workloads[n];
+        if (n < BENCH_MAX_WORKLOADS && (ends_with(file, ".txt") || ends_with(file, ".bin"))) {
+            const bool is_rom = ends_with(file, ".bin");
+            w->kind = is_rom ? WORKLOAD_ROM : WORKLOAD_EXAMPLE;
+            snprintf(w->name, sizeof(w->name), "%.*s", (int) (strlen(file) - 4), file);
+            snprintf(w->source, sizeof(w->source), "%s/%s", examples_dir, file);
+            if (is_rom) {
+                n++;
+            } else {
+                char hex[sizeof(w->source)];
+                if (read_example(w->source, hex, sizeof(hex))) {
+                    memcpy(w->source, hex, sizeof(hex));
+                    n++;
+                }
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return n;
+}
+
+// Map a rom image to the top of memory, its vectors end up where the cpu looks for them
+static bool load_rom_image(Machine *m, const char *path) {
+    ROM rom = {0};
+    ROM_from_file(&rom, path);
+    check_return(rom.data, "Could not read rom %s", false, path);
+    BUS_load_ROM(m, &rom);
+    free(rom.data);
+    free(rom.file);
+    return true;
+}
+
+static bool load_workload(Machine *m, const Workload *w) {
+    Machine_recycle(m);
+    if (w->kind == WORKLOAD_ROM) {
+        check_return(load_rom_image(m, w->source), "Could not load %s", false, w->name);
+    } else {
+        char hex[sizeof(w->source)];
+        memcpy(hex, w->source, sizeof(hex));
+        BUS_load_ROM_from_str(m, BENCH_PROGRAM_ORG, hex);
+        // Programs that run off their end into BRK start over instead of spinning in $0000
+        BUS_write(m, CPU_IRQ_LO, BENCH_PROGRAM_ORG & 0xFF);
+        BUS_write(m, CPU_IRQ_HI, BENCH_PROGRAM_ORG >> 8);
+    }
+    CPU_reset(m);
+    return true;
+}
+
+// One batch, `size` cycles for SERIES_RUN and instructions for SERIES_STEP
+static void run_batch(Machine *m, const Series series, const uint32_t size) {
+    if (series == SERIES_RUN) {
+        CPU_run(m, size);
+    } else {
+        CPU_step_n(m, size);
+    }
+}
+
+static BenchResult run_workload(Machine *m, const int batches, const Series series, const uint32_t batch_size,
+                                const char *trace_path) {
+    BenchResult result = {0};
+    double *latencies = calloc(batches, sizeof(double));
+    check_mem_return(latencies, result);
+
+    for (int i = 0; i < BENCH_WARMUP_BATCHES; i++) {
+        run_batch(m, series, batch_size);
+    }
+    if (trace_path && !Trace_start(m, trace_path)) {
+        free(latencies);
+        return result;
+    }
+
+    const uint64_t start_cycles = CPU_get_cycle_count(m);
+    const uint64_t start_instructions = CPU_get_instruction_count(m);
+    const double start = now_seconds();
+    for (int i = 0; i < batches; i++) {
+        const double batch_start = now_seconds();
+        run_batch(m, series, batch_size);
+        latencies[i] = now_seconds() - batch_start;
+    }
+    // Flushing the trace is part of its cost
+    Trace_stop(m);
+    result.seconds = now_seconds() - start;
+    result.cycles = CPU_get_cycle_count(m) - start_cycles;
+    result.instructions = CPU_get_instruction_count(m) - start_instructions;
+
+    qsort(latencies, batches, sizeof(double), compare_doubles);
+    result.p50_batch_us = latencies[(batches - 1) / 2] * 1e6;
+    result.p99_batch_us = latencies[(int) ((batches - 1) * 0.99)] * 1e6;
+    free(latencies);
+    return result;
+}
+
+static bool write_opcode_stats(const Machine *m, const char *dir, const char *name) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.csv", dir, name);
+    FILE *file = fopen(path, "w");
+    check_return(file, "Could not open %s", false, path);
+    const bool written = Stats_write_csv(m, file);
+    fclose(file);
+    return written;
+}
+
+// One row of the table and, with `json`, one entry of its workloads array
+static void report(const Workload *w, const Series series, const BenchResult *r, FILE *json, const bool first) {
+    const double cps = (double) r->cycles / r->seconds;
+    const double ns_per_cycle = r->seconds * 1e9 / (double) r->cycles;
+    const double ips = (double) r->instructions / r->seconds;
+    const double ns_per_instruction = r->seconds * 1e9 / (double) r->instructions;
+    printf("%-12s %6s %12.2f %10.2f %12.2f %10.2f %10.1f %10.1f\n", w->name, series_names[series], cps / 1e6,
+           ns_per_cycle, ips / 1e6, ns_per_instruction, r->p50_batch_us, r->p99_batch_us);
+    if (!json) {
+        return;
+    }
+    fprintf(json, "%s\n    {\"name\": \"%s\", \"series\": \"%s\", \"instructions\": %llu, \"cycles\": %llu, "
+            "\"seconds\": %.6f, \"instructions_per_second\": %.0f, \"cycles_per_second\": %.0f, "
+            "\"ns_per_instruction\": %.3f, \"ns_per_cycle\": %.3f, \"p50_batch_us\": %.2f, \"p99_batch_us\": %.2f}",
+            first ? "" : ",", w->name, series_names[series], (unsigned long long) r->instructions,
+            (unsigned long long) r->cycles, r->seconds, ips, cps, ns_per_instruction, ns_per_cycle, r->p50_batch_us,
+            r->p99_batch_us);
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [--examples DIR] [--batches N] [--batch-cycles N] [--step] [--batch-size N] "
+            "[--filter NAME] [--json FILE] [--opcode-stats DIR] [--trace DIR]\n", program);
+}
+
+int main(const int argc, char *argv[]) {
+    const char *examples_dir = BENCH_EXAMPLES_DIR;
+    const char *json_path = NULL;
+    const char *stats_dir = NULL;
+    const char *trace_dir = NULL;
+    const char *filter = NULL;
+    int batches = BENCH_DEFAULT_BATCHES;
+    uint32_t batch_cycles = BENCH_DEFAULT_BATCH_CYCLES;
+    uint32_t batch_size = BENCH_DEFAULT_BATCH_SIZE;
+    bool step = false;
+
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--examples") == 0 && has_value) {
+            examples_dir = argv[++i];
+        } else if (strcmp(argv[i], "--batches") == 0 && has_value) {
+            batches = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--batch-cycles") == 0 && has_value) {
+            batch_cycles = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--step") == 0) {
+            step = true;
+        } else if (strcmp(argv[i], "--batch-size") == 0 && has_value) {
+            batch_size = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--filter") == 0 && has_value) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && has_value) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--opcode-stats") == 0 && has_value) {
+            stats_dir = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && has_value) {
+            trace_dir = argv[++i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (batches <= 0 || batch_cycles == 0 || batch_size == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    check_return(!stats_dir || Stats_enabled(), "--opcode-stats needs a build with -DCPU_OPCODE_STATS=ON",
+            EXIT_FAILURE);
+
+    CPU_load_instructions();
+    Machine *m = Machine_create();
+    check_mem_return(m, EXIT_FAILURE);
+
+    static Workload workloads[BENCH_MAX_WORKLOADS];
+    const int n_workloads = collect_workloads(examples_dir, workloads);
+
+    FILE *json = NULL;
+    if (json_path) {
+        json = fopen(json_path, "w");
+        check(json, "Could not open %s", {
+            Machine_destroy(m);
+            return EXIT_FAILURE;
+        }, json_path);
+        fprintf(json, "{\n  \"batch_cycles\": %u,\n  \"batch_size\": %u,\n  \"batches\": %d,\n  \"workloads\": [",
+                batch_cycles, batch_size, batches);
+    }
+
+    printf("%-12s %6s %12s %10s %12s %10s %10s %10s\n", "workload", "series", "MHz", "ns/cycle", "MIPS",
+           "ns/instr", "p50 us", "p99 us");
+    bool first = true;
+    const int n_series = step ? 2 : 1;
+    for (int i = 0; i < n_workloads; i++) {
+        const Workload *w = &workloads[i];
+        if (filter && !strstr(w->name, filter)) {
+            continue;
+        }
+        for (int series = SERIES_RUN; series < n_series; series++) {
+            // Every series starts from the same state
+            if (!load_workload(m, w)) {
+                break;
+            }
+            char trace_path[1024];
+            if (trace_dir) {
+                snprintf(trace_path, sizeof(trace_path), "%s/%s%s.trace", trace_dir, w->name,
+                         series == SERIES_STEP ? ".step" : "");
+            }
+            const BenchResult r = run_workload(m, batches, series, series == SERIES_RUN ? batch_cycles : batch_size,
+                                               trace_dir ? trace_path : NULL);
+            if (!r.cycles) {
+                continue;
+            }
+            report(w, series, &r, json, first);
+            first = false;
+        }
+        if (stats_dir) {
+            write_opcode_stats(m, stats_dir, w->name);
+        }
+    }
+
+    if (json) {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+    }
+    Machine_destroy(m);
+    return EXIT_SUCCESS;
+}
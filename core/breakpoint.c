@@ -0,0 +1,447 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "breakpoint.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "bus.h"
+#include "cpu.h"
+#include "dbg.h"
+#include "machine.h"
+
+typedef enum BreakpointOp {
+    BP_OP_PUSH, // followed by a 16 bit little-endian value
+    BP_OP_REG, // followed by a BreakpointReg
+    BP_OP_FLAG, // followed by the flag mask
+    BP_OP_LOAD,
+    BP_OP_NOT,
+    BP_OP_INV,
+    BP_OP_ADD,
+    BP_OP_SUB,
+    BP_OP_BAND,
+    BP_OP_BOR,
+    BP_OP_XOR,
+    BP_OP_EQ,
+    BP_OP_NE,
+    BP_OP_LT,
+    BP_OP_LE,
+    BP_OP_GT,
+    BP_OP_GE,
+    BP_OP_AND,
+    BP_OP_OR,
+} BreakpointOp;
+
+typedef enum BreakpointReg {
+    BP_REG_A,
+    BP_REG_X,
+    BP_REG_Y,
+    BP_REG_SP,
+    BP_REG_P,
+    BP_REG_PC,
+} BreakpointReg;
+
+typedef struct Parser {
+    const char *expression;
+    const char *pos;
+    BreakpointCondition *out;
+    // Values on the stack at this point of the program, never allowed past BREAKPOINT_MAX_STACK
+    int depth;
+} Parser;
+
+static bool parse_or(Parser *p);
+
+static bool fail(const Parser *p, const char *reason) {
+    log_err("Invalid breakpoint condition '%s' at column %ld: %s", p->expression, (long) (p->pos - p->expression) + 1,
+            reason);
+    return false;
+}
+
+static bool emit(Parser *p, const uint8_t byte) {
+    if (p->out->length >= BREAKPOINT_MAX_CODE) {
+        return fail(p, "expression too long");
+    }
+    p->out->code[p->out->length++] = byte;
+    return true;
+}
+
+// Emit an op and account for what it does to the stack
+static bool emit_op(Parser *p, const BreakpointOp op, const int stack_effect) {
+    p->depth += stack_effect;
+    if (p->depth > BREAKPOINT_MAX_STACK) {
+        return fail(p, "expression nested too deeply");
+    }
+    return emit(p, op);
+}
+
+static void skip_spaces(Parser *p) {
+    while (isspace((unsigned char) *p->pos)) {
+        p->pos++;
+    }
+}
+
+// Consume `token` if the input continues with it
+static bool match(Parser *p, const char *token) {
+    skip_spaces(p);
+    const size_t len = strlen(token);
+    if (strncmp(p->pos, token, len) != 0) {
+        return false;
+    }
+    p->pos += len;
+    return true;
+}
+
+// Like match, but not when the next character would turn `c` into a two character operator
+static bool match_single(Parser *p, const char c, const char not_followed_by) {
+    skip_spaces(p);
+    if (p->pos[0] != c || p->pos[1] == not_followed_by) {
+        return false;
+    }
+    p->pos++;
+    return true;
+}
+
+static bool parse_number(Parser *p) {
+    int base = 10;
+    if (*p->pos == '$') {
+        base = 16;
+        p->pos++;
+    } else if (*p->pos == '%') {
+        base = 2;
+        p->pos++;
+    } else if (p->pos[0] == '0' && (p->pos[1] == 'x' || p->pos[1] == 'X')) {
+        base = 16;
+        p->pos += 2;
+    }
+
+    char *end;
+    const unsigned long value = strtoul(p->pos, &end, base);
+    if (end == p->pos) {
+        return fail(p, "number expected");
+    }
+    if (value > 0xFFFF) {
+        return fail(p, "number out of range");
+    }
+    p->pos = end;
+    return emit_op(p, BP_OP_PUSH, 1) && emit(p, value & 0xFF) && emit(p, value >> 8);
+}
+
+static bool parse_name(Parser *p) {
+    static const struct {
+        const char *name;
+        BreakpointOp op;
+        uint8_t operand;
+    } names[] = {
+        {"A", BP_OP_REG, BP_REG_A},
+        {"X", BP_OP_REG, BP_REG_X},
+        {"Y", BP_OP_REG, BP_REG_Y},
+        {"SP", BP_OP_REG, BP_REG_SP},
+        {"P", BP_OP_REG, BP_REG_P},
+        {"PC", BP_OP_REG, BP_REG_PC},
+        {"N", BP_OP_FLAG, FLAG_N},
+        {"V", BP_OP_FLAG, FLAG_V},
+        {"B", BP_OP_FLAG, FLAG_B},
+        {"D", BP_OP_FLAG, FLAG_D},
+        {"I", BP_OP_FLAG, FLAG_I},
+        {"Z", BP_OP_FLAG, FLAG_Z},
+        {"C", BP_OP_FLAG, FLAG_C},
+    };
+
+    const char *start = p->pos;
+    while (isalpha((unsigned char) *p->pos)) {
+        p->pos++;
+    }
+    const size_t len = p->pos - start;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strlen(names[i].name) == len && strncasecmp(start, names[i].name, len) == 0) {
+            return emit_op(p, names[i].op, 1) && emit(p, names[i].operand);
+        }
+    }
+    p->pos = start;
+    return fail(p, "unknown register or flag");
+}
+
+static bool parse_primary(Parser *p) {
+    skip_spaces(p);
+    if (match(p, "(")) {
+        if (!parse_or(p)) {
+            return false;
+        }
+        return match(p, ")") || fail(p, "')' expected");
+    }
+    if (match(p, "[")) {
+        if (!parse_or(p) || !emit_op(p, BP_OP_LOAD, 0)) {
+            return false;
+        }
+        return match(p, "]") || fail(p, "']' expected");
+    }
+    if (isalpha((unsigned char) *p->pos)) {
+        return parse_name(p);
+    }
+    return parse_number(p);
+}
+
+static bool parse_unary(Parser *p) {
+    if (match_single(p, '!', '=')) {
+        return parse_unary(p) && emit_op(p, BP_OP_NOT, 0);
+    }
+    if (match(p, "~")) {
+        return parse_unary(p) && emit_op(p, BP_OP_INV, 0);
+    }
+    return parse_primary(p);
+}
+
+static bool parse_additive(Parser *p) {
+    if (!parse_unary(p)) {
+        return false;
+    }
+    for (;;) {
+        BreakpointOp op;
+        if (match(p, "+")) {
+            op = BP_OP_ADD;
+        } else if (match(p, "-")) {
+            op = BP_OP_SUB;
+        } else {
+            return true;
+        }
+        if (!parse_unary(p) || !emit_op(p, op, -1)) {
+            return false;
+        }
+    }
+}
+
+static bool parse_bitwise(Parser *p) {
+    if (!parse_additive(p)) {
+        return false;
+    }
+    for (;;) {
+        BreakpointOp op;
+        if (match_single(p, '&', '&')) {
+            op = BP_OP_BAND;
+        } else if (match_single(p, '|', '|')) {
+            op = BP_OP_BOR;
+        } else if (match(p, "^")) {
+            op = BP_OP_XOR;
+        } else {
+            return true;
+        }
+        if (!parse_additive(p) || !emit_op(p, op, -1)) {
+            return false;
+        }
+    }
+}
+
+static bool parse_comparison(Parser *p) {
+    if (!parse_bitwise(p)) {
+        return false;
+    }
+    for (;;) {
+        BreakpointOp op;
+        // Two character operators first, "<" would also match the start of "<="
+        if (match(p, "==")) {
+            op = BP_OP_EQ;
+        } else if (match(p, "!=")) {
+            op = BP_OP_NE;
+        } else if (match(p, "<=")) {
+            op = BP_OP_LE;
+        } else if (match(p, ">=")) {
+            op = BP_OP_GE;
+        } else if (match(p, "<")) {
+            op = BP_OP_LT;
+        } else if (match(p, ">")) {
+            op = BP_OP_GT;
+        } else {
+            return true;
+        }
+        if (!parse_bitwise(p) || !emit_op(p, op, -1)) {
+            return false;
+        }
+    }
+}
+
+static bool parse_and(Parser *p) {
+    if (!parse_comparison(p)) {
+        return false;
+    }
+    while (match(p, "&&")) {
+        if (!parse_comparison(p) || !emit_op(p, BP_OP_AND, -1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parse_or(Parser *p) {
+    if (!parse_and(p)) {
+        return false;
+    }
+    while (match(p, "||")) {
+        if (!parse_and(p) || !emit_op(p, BP_OP_OR, -1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Breakpoint_compile(const char *const expression, BreakpointCondition *const condition) {
+    Parser p = {.expression = expression, .pos = expression, .out = condition};
+    condition->length = 0;
+    if (!parse_or(&p)) {
+        return false;
+    }
+    skip_spaces(&p);
+    if (*p.pos != '\0') {
+        return fail(&p, "unexpected input");
+    }
+    return true;
+}
+
+uint16_t Breakpoint_eval(const Machine *const m, const BreakpointCondition *const condition) {
+    // The compiler guarantees the program fits this stack and never underflows it
+    uint16_t stack[BREAKPOINT_MAX_STACK];
+    int top = -1;
+    const CPU *cpu = CPU_get_state(m);
+    const uint8_t *code = condition->code;
+
+    for (uint8_t ip = 0; ip < condition->length;) {
+        const BreakpointOp op = code[ip++];
+        uint16_t rhs;
+        switch (op) {
+            case BP_OP_PUSH:
+                stack[++top] = code[ip] | (code[ip + 1] << 8);
+                ip += 2;
+                continue;
+            case BP_OP_REG:
+                switch ((BreakpointReg) code[ip++]) {
+                    case BP_REG_A: stack[++top] = cpu->a; break;
+                    case BP_REG_X: stack[++top] = cpu->x; break;
+                    case BP_REG_Y: stack[++top] = cpu->y; break;
+                    case BP_REG_SP: stack[++top] = cpu->sp; break;
+                    case BP_REG_P: stack[++top] = cpu->status; break;
+                    case BP_REG_PC: stack[++top] = cpu->pc; break;
+                }
+                continue;
+            case BP_OP_FLAG:
+                stack[++top] = (cpu->status & code[ip++]) != 0;
+                continue;
+            case BP_OP_LOAD:
+                stack[top] = BUS_peek(m, stack[top]);
+                continue;
+            case BP_OP_NOT:
+                stack[top] = !stack[top];
+                continue;
+            case BP_OP_INV:
+                stack[top] = ~stack[top];
+                continue;
+            default:
+                break;
+        }
+
+        // Everything else is a binary operator
+        rhs = stack[top--];
+        uint16_t *lhs = &stack[top];
+        switch (op) {
+            case BP_OP_ADD: *lhs += rhs; break;
+            case BP_OP_SUB: *lhs -= rhs; break;
+            case BP_OP_BAND: *lhs &= rhs; break;
+            case BP_OP_BOR: *lhs |= rhs; break;
+            case BP_OP_XOR: *lhs ^= rhs; break;
+            case BP_OP_EQ: *lhs = *lhs == rhs; break;
+            case BP_OP_NE: *lhs = *lhs != rhs; break;
+            case BP_OP_LT: *lhs = *lhs < rhs; break;
+            case BP_OP_LE: *lhs = *lhs <= rhs; break;
+            case BP_OP_GT: *lhs = *lhs > rhs; break;
+            case BP_OP_GE: *lhs = *lhs >= rhs; break;
+            case BP_OP_AND: *lhs = *lhs && rhs; break;
+            case BP_OP_OR: *lhs = *lhs || rhs; break;
+            default: break;
+        }
+    }
+    return top >= 0 ? stack[top] : 0;
+}
+
+static BreakpointCondition *find_condition(const Breakpoints *breakpoints, const uint16_t pc) {
+    for (uint16_t i = 0; i < breakpoints->n_conditions; i++) {
+        if (breakpoints->conditions[i].pc == pc) {
+            return &breakpoints->conditions[i];
+        }
+    }
+    return NULL;
+}
+
+static void remove_condition(Breakpoints *breakpoints, const uint16_t pc) {
+    BreakpointCondition *condition = find_condition(breakpoints, pc);
+    if (!condition) {
+        return;
+    }
+    free(condition->expression);
+    // Order does not matter, fill the gap with the last one
+    *condition = breakpoints->conditions[--breakpoints->n_conditions];
+}
+
+bool Breakpoint_set(Machine *const m, const uint16_t pc, const char *const condition) {
+    Breakpoints *breakpoints = &m->breakpoints;
+    if (!condition || *condition == '\0') {
+        remove_condition(breakpoints, pc);
+        breakpoints->pcs[pc >> 3] |= 1 << (pc & 7);
+        return true;
+    }
+
+    BreakpointCondition compiled = {.pc = pc};
+    if (!Breakpoint_compile(condition, &compiled)) {
+        return false;
+    }
+    compiled.expression = strdup(condition);
+    check_mem_return(compiled.expression, false);
+
+    BreakpointCondition *existing = find_condition(breakpoints, pc);
+    if (existing) {
+        free(existing->expression);
+        *existing = compiled;
+    } else {
+        BreakpointCondition *conditions = realloc(breakpoints->conditions,
+                                                  (breakpoints->n_conditions + 1) * sizeof(BreakpointCondition));
+        if (!conditions) {
+            free(compiled.expression);
+        }
+        check_mem_return(conditions, false);
+        conditions[breakpoints->n_conditions++] = compiled;
+        breakpoints->conditions = conditions;
+    }
+    breakpoints->pcs[pc >> 3] |= 1 << (pc & 7);
+    return true;
+}
+
+void Breakpoint_clear(Machine *const m, const uint16_t pc) {
+    remove_condition(&m->breakpoints, pc);
+    m->breakpoints.pcs[pc >> 3] &= ~(1 << (pc & 7));
+}
+
+void Breakpoint_clear_all(Machine *const m) {
+    Breakpoints *breakpoints = &m->breakpoints;
+    for (uint16_t i = 0; i < breakpoints->n_conditions; i++) {
+        free(breakpoints->conditions[i].expression);
+    }
+    free(breakpoints->conditions);
+    breakpoints->conditions = NULL;
+    breakpoints->n_conditions = 0;
+    breakpoints->hit = false;
+    memset(breakpoints->pcs, 0, sizeof(breakpoints->pcs));
+}
+
+const BreakpointCondition *Breakpoint_get_condition(const Machine *const m, const uint16_t pc) {
+    return find_condition(&m->breakpoints, pc);
+}
+
+bool Breakpoint_condition_holds(const Machine *const m, const uint16_t pc) {
+    const BreakpointCondition *condition = find_condition(&m->breakpoints, pc);
+    return !condition || Breakpoint_eval(m, condition) != 0;
+}
+
+bool Breakpoint_was_hit(const Machine *const m) {
+    return m->breakpoints.hit;
+}
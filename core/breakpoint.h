@@ -0,0 +1,72 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_BREAKPOINT_H
+#define INC_6502_EMULATOR_BREAKPOINT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Machine Machine;
+
+// Limits of a compiled condition, checked by the compiler so evaluating never has to
+#define BREAKPOINT_MAX_CODE 64
+#define BREAKPOINT_MAX_STACK 16
+
+/*
+ * A condition compiled to postfix bytecode, e.g. `A==$10 && [$0200]!=0` becomes
+ * REG A, PUSH $10, EQ, PUSH $0200, LOAD, PUSH 0, NE, AND
+ */
+typedef struct BreakpointCondition {
+    char *expression;
+    uint8_t code[BREAKPOINT_MAX_CODE];
+    uint8_t length;
+    uint16_t pc;
+} BreakpointCondition;
+
+typedef struct Breakpoints {
+    // One bit per address, the only thing looked at on the hot path
+    uint8_t pcs[0x10000 / 8];
+    // Conditions of the breakpoints that have one, looked up once their pc bit is hit
+    BreakpointCondition *conditions;
+    uint16_t n_conditions;
+    // Whether the last CPU_run_to_breakpoint stopped on a breakpoint
+    bool hit;
+} Breakpoints;
+
+/**
+ * Compile a condition. Grammar, loosest binding first:
+ *   ||   &&   == != < <= > >=   & | ^   + -   ! ~ (unary)
+ * Operands are numbers ($hex, 0xhex, %binary or decimal), registers (A, X, Y, SP, PC, P),
+ * single flags (N, V, B, D, I, Z, C), [expr] for the byte at an address and (expr).
+ * Bitwise operators bind tighter than comparisons, so `P & 1 == 1` does what it looks like.
+ * @return false if the expression is invalid or too complex, the reason is logged
+ */
+bool Breakpoint_compile(const char *expression, BreakpointCondition *condition);
+
+// Evaluate a compiled condition against the current state of `m`
+uint16_t Breakpoint_eval(const Machine *m, const BreakpointCondition *condition);
+
+/**
+ * Break before executing the instruction at `pc`, only when `condition` holds if given (NULL
+ * or empty for unconditional). Replaces any breakpoint already at `pc`.
+ * @return false if the condition does not compile, the previous breakpoint is kept then
+ */
+bool Breakpoint_set(Machine *m, uint16_t pc, const char *condition);
+void Breakpoint_clear(Machine *m, uint16_t pc);
+void Breakpoint_clear_all(Machine *m);
+// The condition of the breakpoint at `pc` or NULL if it has none (or there is no breakpoint)
+const BreakpointCondition *Breakpoint_get_condition(const Machine *m, uint16_t pc);
+
+// Whether the last CPU_run_to_breakpoint stopped because of a breakpoint
+bool Breakpoint_was_hit(const Machine *m);
+
+static inline bool Breakpoint_is_set(const Breakpoints *breakpoints, const uint16_t pc) {
+    return breakpoints->pcs[pc >> 3] & (1 << (pc & 7));
+}
+
+// For a `pc` whose bit is set: whether its condition holds (always true without one)
+bool Breakpoint_condition_holds(const Machine *m, uint16_t pc);
+
+#endif //INC_6502_EMULATOR_BREAKPOINT_H
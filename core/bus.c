@@ -8,35 +8,43 @@
 #include <string.h>
 #include "cpu.h"
 #include "dbg.h"
+#include "machine.h"
 #include "rom.h"
 
 
-static uint8_t ram[RAM_SIZE];
+void BUS_init(Machine *const m) {
+    // Only pages that held anything actually change when cleared
+    for (int page = 0; page < RAM_SIZE / 0x100; page++) {
+        const uint8_t *data = &m->ram[page * 0x100];
+        if (data[0] != 0 || memcmp(data, data + 1, 0xFF) != 0) {
+            m->dirty_pages[page >> 3] |= 1 << (page & 7);
+        }
+    }
 
-void BUS_init(void) {
     // Set the default ram to NOOP to prevent calling non-existing IRQ handlers (since 0 == BRK)
-    memset(ram, 0, RAM_SIZE);
+    memset(m->ram, 0, RAM_SIZE);
+    m->generation++;
 }
 
-void BUS_load_ROM_from_str(const uint16_t org, char *rom) {
+void BUS_load_ROM_from_str(Machine *const m, const uint16_t org, char *rom) {
     // Load the program ROM
     const char *token = strtok(rom, " ");
     int i = 0;
     while (token != NULL) {
         const uint8_t value = (uint8_t) strtoul(token, NULL, 16);
-        BUS_write((org + i), value);
+        BUS_write(m, (org + i), value);
         token = strtok(NULL, " ");
         i++;
     }
 
     // Load reset vector (cheating for now)
-    BUS_write(CPU_RESET_LO, org & 0xFF);
-    BUS_write(CPU_RESET_HI, (org >> 8) & 0xFF);
+    BUS_write(m, CPU_RESET_LO, org & 0xFF);
+    BUS_write(m, CPU_RESET_HI, (org >> 8) & 0xFF);
 
     log_info("Rom loaded at 0x%04x", org);
 }
 
-void BUS_load_ROM(const ROM *const rom) {
+void BUS_load_ROM(Machine *const m, const ROM *const rom) {
     /*
      * This version does not manually load RESET vectors but assumes
      * that rom data has pc start at that address. We could, of course,
@@ -48,20 +56,102 @@ void BUS_load_ROM(const ROM *const rom) {
 
 
     for (int i = rom->start, j = 0; i <= rom->end; i++, j++) {
-        BUS_write(i, data[j]);
+        BUS_write(m, i, data[j]);
     }
     log_info("Rom loaded at 0x%04x", org);
 }
 
-uint8_t BUS_read(const uint16_t addr) {
-    return ram[addr];
+// The device mapped at `addr`, if any
+static const Device *device_at(const Machine *m, const uint16_t addr) {
+    const Device *d = m->io_pages[addr >> 8];
+    return d && addr >= d->start && addr <= d->end ? d : NULL;
+}
+
+uint8_t BUS_read(Machine *const m, const uint16_t addr) {
+    const Device *d = device_at(m, addr);
+    if (d) {
+        return d->read(m, d->ctx, addr);
+    }
+    return m->ram[addr];
+}
+
+uint8_t BUS_peek(const Machine *const m, const uint16_t addr) {
+    const Device *d = device_at(m, addr);
+    if (d) {
+        return d->peek(m, d->ctx, addr);
+    }
+    return m->ram[addr];
+}
+
+static void write_ram(Machine *m, const uint16_t addr, const uint8_t data) {
+    m->ram[addr] = data;
+    m->dirty_pages[addr >> 11] |= 1 << ((addr >> 8) & 7);
+    m->generation++;
+}
+
+void BUS_write(Machine *const m, const uint16_t addr, const uint8_t data) {
+    const Device *d = device_at(m, addr);
+    if (d) {
+        d->write(m, d->ctx, addr, data);
+        return;
+    }
+    write_ram(m, addr, data);
+}
+
+void BUS_write_ram(Machine *const m, const uint16_t addr, const uint8_t data) {
+    write_ram(m, addr, data);
+}
+
+void BUS_take_dirty_pages(Machine *const m, uint8_t *const bitmap) {
+    memcpy(bitmap, m->dirty_pages, BUS_DIRTY_BITMAP_SIZE);
+    memset(m->dirty_pages, 0, BUS_DIRTY_BITMAP_SIZE);
 }
 
-void BUS_write(const uint16_t addr, const uint8_t data) {
-    ram[addr] = data;
+uint32_t BUS_get_generation(const Machine *const m) {
+    return m->generation;
 }
 
-uint8_t *BUS_get_page(const uint8_t page) {
+uint8_t *BUS_get_page(Machine *const m, const uint8_t page) {
     log_debug("Page retrieved at: %d", page);
-    return &ram[page * 0x100];
+    return &m->ram[page * 0x100];
+}
+
+bool BUS_map_device(Machine *const m, const Device *device) {
+    check_return(device->start <= device->end, "Device %s ends before it starts", false, device->name);
+    check_return(m->n_devices < BUS_MAX_DEVICES, "No room for device %s", false, device->name);
+    for (int page = device->start >> 8; page <= device->end >> 8; page++) {
+        check_return(!m->io_pages[page], "Page %02X already has device %s", false, page, m->io_pages[page]->name);
+    }
+
+    Device *d = &m->devices[m->n_devices++];
+    *d = *device;
+    for (int page = d->start >> 8; page <= d->end >> 8; page++) {
+        m->io_pages[page] = d;
+    }
+    d->reset(m, d->ctx);
+    log_info("%s mapped at %04X-%04X", d->name, d->start, d->end);
+    return true;
+}
+
+void BUS_unmap_devices(Machine *const m) {
+    memset(m->io_pages, 0, sizeof(m->io_pages));
+    for (int i = 0; i < m->n_devices; i++) {
+        m->devices[i].destroy(m, m->devices[i].ctx);
+    }
+    m->n_devices = 0;
+}
+
+void BUS_reset_devices(Machine *const m) {
+    for (int i = 0; i < m->n_devices; i++) {
+        m->devices[i].reset(m, m->devices[i].ctx);
+    }
+}
+
+const Device *BUS_find_device(const Machine *const m, const char *name) {
+    for (int i = 0; i < m->n_devices; i++) {
+        if (strcmp(m->devices[i].name, name) == 0) {
+            return &m->devices[i];
+        }
+    }
+    return NULL;
 }
@@ -5,18 +5,75 @@
 #ifndef INC_6502_EMULATOR_BUS_H
 #define INC_6502_EMULATOR_BUS_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "rom.h"
 
+typedef struct Machine Machine;
+
 #define RAM_SIZE (64 * 1024)
-#define BUS_GET_ZERO_PAGE() (BUS_get_page(0))
+#define BUS_GET_ZERO_PAGE(m) (BUS_get_page((m), 0))
+// One bit per 256 byte page, bit (page & 7) of byte (page >> 3)
+#define BUS_DIRTY_BITMAP_SIZE (RAM_SIZE / 0x100 / 8)
+#define BUS_MAX_DEVICES 8
+
+/*
+ * A memory mapped device. Reads and writes in [start, end] go to the device instead of RAM, the
+ * RAM underneath is left alone. A page belongs to at most one device, so finding the device for
+ * an address is a single lookup and RAM accesses only pay for checking that there is none.
+ */
+typedef struct Device {
+    const char *name;
+    uint16_t start;
+    uint16_t end;
+    // Handed to the callbacks, owned by the device
+    void *ctx;
+    // A cpu read, may have side effects like acknowledging an interrupt
+    uint8_t (*read)(Machine *m, void *ctx, uint16_t addr);
+    // The value a read would return, without the side effects (debuggers, breakpoint conditions)
+    uint8_t (*peek)(const Machine *m, const void *ctx, uint16_t addr);
+    void (*write)(Machine *m, void *ctx, uint16_t addr, uint8_t data);
+    // Back to the power on state, on every CPU_reset
+    void (*reset)(Machine *m, void *ctx);
+    // Release ctx, when the device is unmapped
+    void (*destroy)(Machine *m, void *ctx);
+    /*
+     * Optional, the state a save-state carries for the device (see savestate.h). save copies it
+     * to `out` and returns its size, with `out` NULL it only returns the size. load gets back
+     * what save wrote, or NULL when the save-state has nothing for the device, and returns false
+     * when the data does not fit it.
+     */
+    size_t (*save)(const Machine *m, const void *ctx, uint8_t *out);
+    bool (*load)(Machine *m, void *ctx, const uint8_t *data, size_t size);
+} Device;
+
+void BUS_init(Machine *m);
+void BUS_load_ROM_from_str(Machine *m, uint16_t org, char *rom);
+void BUS_load_ROM(Machine *m, const ROM *rom);
+void BUS_write(Machine *m, uint16_t addr, uint8_t data);
+// Write RAM even where a device is mapped, for devices whose state lives in the RAM underneath
+void BUS_write_ram(Machine *m, uint16_t addr, uint8_t data);
 
-void BUS_init(void);
-void BUS_load_ROM_from_str(uint16_t org, char *rom);
-void BUS_load_ROM(const ROM *rom);
-void BUS_write(uint16_t addr, uint8_t data);
+// A cpu read, goes to the device when one is mapped at `addr`
+uint8_t BUS_read(Machine *m, uint16_t addr);
+// Same as BUS_read but never changes the state of a device
+uint8_t BUS_peek(const Machine *m, uint16_t addr);
+uint8_t *BUS_get_page(Machine *m, uint8_t page);
+// Changes with every write to memory (wraps around), equal values mean nothing was written
+uint32_t BUS_get_generation(const Machine *m);
+// Copy the bitmap of pages written since the last call into `bitmap` and clear it
+void BUS_take_dirty_pages(Machine *m, uint8_t *bitmap);
 
-uint8_t BUS_read(uint16_t addr);
-uint8_t *BUS_get_page(uint8_t page);
+/**
+ * Map a copy of `device`, its reset callback runs right away.
+ * @return false when all device slots are taken or one of its pages already has a device
+ */
+bool BUS_map_device(Machine *m, const Device *device);
+// Unmap and destroy every device, the address space is plain RAM again
+void BUS_unmap_devices(Machine *m);
+void BUS_reset_devices(Machine *m);
+// The mapped device called `name`, NULL if there is none
+const Device *BUS_find_device(const Machine *m, const char *name);
 
 #endif //INC_6502_EMULATOR_BUS_H
\ No newline at end of file
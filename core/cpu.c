@@ -1,113 +1,263 @@
 
 #include "cpu.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include "alu.h"
 #include "bus.h"
 #include "dbg.h"
 #include "disassembler.h"
+#include "machine.h"
 
 #define N_INSTRUCTIONS 256
 
+/*
+ * Read-modify-write instructions (ASL, LSR, ROL, ROR) on abs,X take a fixed 7 cycles on the NMOS
+ * part. The 65C02 takes 6 and adds one for crossing a page, like the loads.
+ */
+#ifdef CPU_MODEL_65C02
+#define SHIFT_PAGE_PENALTY 1
+#else
+#define SHIFT_PAGE_PENALTY 0
+#endif
+
 // =========================================================
 // Type definitions
 // =========================================================
-static CPU cpu;
+// Shared by all machines, never written after CPU_load_instructions
 static Instruction instructions[N_INSTRUCTIONS];
 
 
 // =========================================================
 // Private functions
 // =========================================================
-static void set_flag(const uint8_t flag, const bool b) {
+static void set_flag(Machine *m, const uint8_t flag, const bool b) {
     if (b) {
-        cpu.status |= flag;
+        m->cpu.status |= flag;
     } else {
-        cpu.status &= ~flag;
+        m->cpu.status &= ~flag;
     }
 }
 
-static bool get_flag(const uint8_t flag) {
-    return cpu.status & flag;
+static bool get_flag(const Machine *m, const uint8_t flag) {
+    return m->cpu.status & flag;
 }
 
-static void compare_register(const uint8_t reg) {
-    const uint16_t data = CPU_read(cpu.addr_abs);
+static void compare_register(Machine *m, const uint8_t reg) {
+    const uint16_t data = CPU_read(m, m->cpu.addr_abs);
     const uint16_t result = (uint16_t) reg - data;
-    set_flag(FLAG_C, reg >= data);
-    set_flag(FLAG_Z, (result & 0x00FF) == 0);
-    set_flag(FLAG_N, result & 0x80);
+    set_flag(m, FLAG_C, reg >= data);
+    set_flag(m, FLAG_Z, (result & 0x00FF) == 0);
+    set_flag(m, FLAG_N, result & 0x80);
 }
 
-static void branch_on_condition(bool condition) {
+static void branch_on_condition(Machine *m, bool condition) {
+    STATS_ADD(m, m->cpu.curr_opcode, condition ? STAT_BRANCHES_TAKEN : STAT_BRANCHES_NOT_TAKEN, 1);
     if (condition) {
-        cpu.cycles++;
-        cpu.addr_abs = cpu.pc + cpu.addr_rel;
+        m->cpu.cycles++;
+        m->cpu.addr_abs = m->cpu.pc + m->cpu.addr_rel;
 
         // Add a cycle if we crossed a page
-        if ((cpu.addr_abs & 0xFF00) != (cpu.pc & 0xFF00)) {
-            cpu.cycles++;
+        if ((m->cpu.addr_abs & 0xFF00) != (m->cpu.pc & 0xFF00)) {
+            m->cpu.cycles++;
         }
 
-        cpu.pc = cpu.addr_abs;
+        m->cpu.pc = m->cpu.addr_abs;
     }
 }
 
-static void hardware_interrupt(const uint16_t pc_lo, const uint16_t pc_hi) {
+// Straight from the bus, a vector fetch is not an access of the program so the memory map skips it
+static uint16_t read_vector(Machine *m, const uint16_t lo, const uint16_t hi) {
+    return (BUS_read(m, hi) << 8) | BUS_read(m, lo);
+}
+
+static void hardware_interrupt(Machine *m, const uint16_t pc_lo, const uint16_t pc_hi) {
     // Write hi and lo byte to stack (remember little-endian so reversed since we decrement sp)
-    CPU_write(CPU_STACK_PAGE + cpu.sp--, cpu.pc >> 8);
-    CPU_write(CPU_STACK_PAGE + cpu.sp--, cpu.pc & 0x00FF);
+    CPU_write(m, CPU_STACK_PAGE + m->cpu.sp--, m->cpu.pc >> 8);
+    CPU_write(m, CPU_STACK_PAGE + m->cpu.sp--, m->cpu.pc & 0x00FF);
 
     // Set B and U flag before pushing to stack
-    set_flag(FLAG_B, false);
-    set_flag(FLAG_U, true);
+    set_flag(m, FLAG_B, false);
+    set_flag(m, FLAG_U, true);
 
     // Push status register to the stack
-    CPU_write(CPU_STACK_PAGE + cpu.sp--, cpu.status);
+    CPU_write(m, CPU_STACK_PAGE + m->cpu.sp--, m->cpu.status);
 
     // Set I flag to true after copy (will be restored to 0 in RTI)
-    set_flag(FLAG_I, true);
+    set_flag(m, FLAG_I, true);
+#ifdef CPU_MODEL_65C02
+    // The 65C02 leaves decimal mode when taking an interrupt, the NMOS part keeps D as it was
+    set_flag(m, FLAG_D, false);
+#endif
 
     // Set pc to irq address (irq or nmi)
-    cpu.pc = (CPU_read(pc_hi) << 8) | (CPU_read(pc_lo) & 0x00FF);
+    m->cpu.pc = read_vector(m, pc_lo, pc_hi);
 
     // Interrupts takes ~7 cycles
-    cpu.cycles = 7;
+    m->cpu.cycles = 7;
 }
 
 /**
- * Used by both ADC and SBC because we can re-use all the logic except for the data in.
- * For ADC, data = the next byte read.
- * For SBC, we read the next byte but invert it to make it negative
- * @param data data from the bus (negated when used with SBC)
+ * Used by both ADC and SBC, the result and flags are looked up in ALU_table (see alu.h). The D
+ * flag only picks the table, so neither binary nor decimal mode branches. Binary SBC is ADC of
+ * the inverted operand, decimal SBC has a table of its own.
+ * @param data data from the bus
+ * @param subtract true for SBC
  */
-static void set_add_or_sub_result(const uint16_t data) {
-    const uint16_t a = cpu.a;
-    const uint16_t carry = get_flag(FLAG_C);
+static void set_add_or_sub_result(Machine *m, const uint8_t data, const bool subtract) {
+    const uint8_t decimal = (m->cpu.status & FLAG_D) >> 3;
+    const uint8_t carry = m->cpu.status & FLAG_C;
+    const uint8_t mode = decimal * (1 + subtract);
+    // 0xFF in binary mode, 0x00 in decimal mode
+    const uint8_t invert = subtract ? (uint8_t) (decimal - 1) : 0;
+
+    const uint16_t entry = ALU_table[mode][carry][m->cpu.a][data ^ invert];
+    m->cpu.a = entry & 0x00FF;
+    m->cpu.status = (m->cpu.status & ~ALU_FLAGS) | (entry >> 8);
+#ifdef CPU_MODEL_65C02
+    // The 65C02 spends an extra cycle fixing up N and Z in decimal mode
+    m->cpu.cycles += decimal;
+#endif
+}
 
-    // Store result as 16 bit since we need the carry flag
-    const uint16_t result = a + data + carry;
+/**
+ * Fetch, decode and execute the instruction at pc in one go.
+ * @return the number of cycles the instruction takes (including any penalty cycles)
+ */
+static uint8_t execute_instruction(Machine *m) {
+    const uint16_t pc = m->cpu.pc;
+    m->cpu.curr_opcode = CPU_read(m, m->cpu.pc++);
+    MEMORY_MAP_ADD(m, MEMORY_EXECUTE, pc);
+    if (m->tracer) {
+        Trace_record(m, pc, m->cpu.curr_opcode);
+    }
+
+    const Instruction *ins = &instructions[m->cpu.curr_opcode];
+    m->cpu.cycles = ins->cycles;
+    m->instruction_count++;
 
-    // set carry, zero and negative flags
-    set_flag(FLAG_C, result > 0xFF);
-    set_flag(FLAG_Z, (result & 0x00FF) == 0);
-    set_flag(FLAG_N, result & 0x80);
+    const uint8_t additional_cycle1 = ins->addressing(m);
+    const uint8_t additional_cycle2 = ins->opcode(m);
 
-    // check if we overflowed
-    const bool v = (~(a ^ data) & (a ^ result)) & 0x0080;
-    set_flag(FLAG_V, v);
+    m->cpu.cycles += (additional_cycle1 & additional_cycle2);
 
-    // Convert back to 8-bit and add to accumulator
-    cpu.a = result & 0x00FF;
+    STATS_ADD(m, m->cpu.curr_opcode, STAT_EXECUTED, 1);
+    STATS_ADD(m, m->cpu.curr_opcode, STAT_CYCLES, m->cpu.cycles);
+    STATS_ADD(m, m->cpu.curr_opcode, STAT_PAGE_CROSSES, additional_cycle1 & additional_cycle2);
+    if (m->profiler) {
+        Profiler_record(m, pc, m->cpu.curr_opcode, m->cpu.cycles);
+    }
+    return m->cpu.cycles;
 }
 
-static bool is_implied_addressing() {
-    return CPU_get_instruction(cpu.curr_opcode)->addressing == IMP;
+/**
+ * Burn the remaining cycles of the instruction in flight so that a batch run
+ * always starts on an instruction boundary.
+ */
+static void finish_instruction(Machine *m) {
+    m->cpu.cycle_count += m->cpu.cycles;
+    m->cpu.cycles = 0;
 }
 
+/**
+ * Let the device events that are due fire before the next instruction. An interrupt they cause
+ * is counted like an instruction.
+ */
+static void service_events(Machine *m) {
+    if (m->cpu.cycle_count >= m->events.next_cycle) {
+        Events_dispatch(m);
+        finish_instruction(m);
+    }
+}
+
+static bool is_implied_addressing(const Machine *m) {
+    return CPU_get_instruction(m->cpu.curr_opcode)->addressing == IMP;
+}
+
+#ifdef CPU_MODEL_65C02
+/*
+ * Changes the 65C02 makes to the NMOS table. The Rockwell/WDC bit instructions (RMB, SMB, BBR,
+ * BBS) and WDC's WAI and STP are not emulated. RMB and SMB become 2 byte and BBR and BBS 3 byte
+ * NOPs, so the code after them still decodes, WAI and STP 1 byte ones.
+ */
+static void load_65c02_instructions(void) {
+    // Opcodes without an instruction are NOPs, they never halt or do anything else like on the NMOS part
+    for (int i = 0; i <= 0xFF; i++) {
+        if (instructions[i].opcode != ILL) {
+            continue;
+        }
+        if ((i & 0x0F) == 0x02) {
+            instructions[i] = (Instruction){.name = "NOP", .addressing = IMM, .opcode = NOP, .cycles = 2};
+        } else if ((i & 0x0F) == 0x07) {
+            // RMB and SMB: zero page address
+            instructions[i] = (Instruction){.name = "NOP", .addressing = ZP0, .opcode = NOP, .cycles = 5};
+        } else if ((i & 0x0F) == 0x0F) {
+            // BBR and BBS: zero page address and branch offset, never taken
+            instructions[i] = (Instruction){.name = "NOP", .addressing = ABS, .opcode = NOP, .cycles = 5};
+        } else {
+            instructions[i] = (Instruction){.name = "NOP", .addressing = IMP, .opcode = NOP, .cycles = 1};
+        }
+    }
+    instructions[0x44] = (Instruction){.name = "NOP", .addressing = ZP0, .opcode = NOP, .cycles = 3};
+    instructions[0x54] = (Instruction){.name = "NOP", .addressing = ZPX, .opcode = NOP, .cycles = 4};
+    instructions[0xD4] = (Instruction){.name = "NOP", .addressing = ZPX, .opcode = NOP, .cycles = 4};
+    instructions[0xF4] = (Instruction){.name = "NOP", .addressing = ZPX, .opcode = NOP, .cycles = 4};
+    instructions[0x5C] = (Instruction){.name = "NOP", .addressing = ABS, .opcode = NOP, .cycles = 8};
+    instructions[0xDC] = (Instruction){.name = "NOP", .addressing = ABS, .opcode = NOP, .cycles = 4};
+    instructions[0xFC] = (Instruction){.name = "NOP", .addressing = ABS, .opcode = NOP, .cycles = 4};
+
+    // New addressing modes for existing instructions
+    instructions[0x72] = (Instruction){.name = "ADC", .addressing = ZPI, .opcode = ADC, .cycles = 5};
+    instructions[0x32] = (Instruction){.name = "AND", .addressing = ZPI, .opcode = AND, .cycles = 5};
+    instructions[0x89] = (Instruction){.name = "BIT", .addressing = IMM, .opcode = BIT_IMM, .cycles = 2};
+    instructions[0x34] = (Instruction){.name = "BIT", .addressing = ZPX, .opcode = BIT, .cycles = 4};
+    instructions[0x3C] = (Instruction){.name = "BIT", .addressing = ABX, .opcode = BIT, .cycles = 4};
+    instructions[0xD2] = (Instruction){.name = "CMP", .addressing = ZPI, .opcode = CMP, .cycles = 5};
+    instructions[0x3A] = (Instruction){.name = "DEC", .addressing = IMP, .opcode = DEA, .cycles = 2};
+    instructions[0x52] = (Instruction){.name = "EOR", .addressing = ZPI, .opcode = EOR, .cycles = 5};
+    instructions[0x1A] = (Instruction){.name = "INC", .addressing = IMP, .opcode = INA, .cycles = 2};
+    instructions[0x7C] = (Instruction){.name = "JMP", .addressing = IAX, .opcode = JMP, .cycles = 6};
+    instructions[0xB2] = (Instruction){.name = "LDA", .addressing = ZPI, .opcode = LDA, .cycles = 5};
+    instructions[0x12] = (Instruction){.name = "ORA", .addressing = ZPI, .opcode = ORA, .cycles = 5};
+    instructions[0xF2] = (Instruction){.name = "SBC", .addressing = ZPI, .opcode = SBC, .cycles = 5};
+    instructions[0x92] = (Instruction){.name = "STA", .addressing = ZPI, .opcode = STA, .cycles = 5};
+
+    // New instructions
+    instructions[0x80] = (Instruction){.name = "BRA", .addressing = REL, .opcode = BRA, .cycles = 2};
+    instructions[0xDA] = (Instruction){.name = "PHX", .addressing = IMP, .opcode = PHX, .cycles = 3};
+    instructions[0x5A] = (Instruction){.name = "PHY", .addressing = IMP, .opcode = PHY, .cycles = 3};
+    instructions[0xFA] = (Instruction){.name = "PLX", .addressing = IMP, .opcode = PLX, .cycles = 4};
+    instructions[0x7A] = (Instruction){.name = "PLY", .addressing = IMP, .opcode = PLY, .cycles = 4};
+    instructions[0x64] = (Instruction){.name = "STZ", .addressing = ZP0, .opcode = STZ, .cycles = 3};
+    instructions[0x74] = (Instruction){.name = "STZ", .addressing = ZPX, .opcode = STZ, .cycles = 4};
+    instructions[0x9C] = (Instruction){.name = "STZ", .addressing = ABS, .opcode = STZ, .cycles = 4};
+    instructions[0x9E] = (Instruction){.name = "STZ", .addressing = ABX, .opcode = STZ, .cycles = 5};
+    instructions[0x14] = (Instruction){.name = "TRB", .addressing = ZP0, .opcode = TRB, .cycles = 5};
+    instructions[0x1C] = (Instruction){.name = "TRB", .addressing = ABS, .opcode = TRB, .cycles = 6};
+    instructions[0x04] = (Instruction){.name = "TSB", .addressing = ZP0, .opcode = TSB, .cycles = 5};
+    instructions[0x0C] = (Instruction){.name = "TSB", .addressing = ABS, .opcode = TSB, .cycles = 6};
+
+    // Changed timings, see SHIFT_PAGE_PENALTY and IND
+    instructions[0x1E].cycles = 6;
+    instructions[0x3E].cycles = 6;
+    instructions[0x5E].cycles = 6;
+    instructions[0x7E].cycles = 6;
+    instructions[0x6C].cycles = 6;
+}
+#endif
+
 // =========================================================
 // Public functions
 // =========================================================
+const char *CPU_get_model(void) {
+#ifdef CPU_MODEL_65C02
+    return "65C02";
+#else
+    return "6502";
+#endif
+}
+
 void CPU_load_instructions(void) {
     // Start by filling the whole array with ILL opcodes then populate the legal ones
     for (int i = 0; i <= 0xFF; i++) {
@@ -145,8 +295,8 @@ void CPU_load_instructions(void) {
     instructions[0xD0] = (Instruction){.name = "BNE", .addressing = REL, .opcode = BNE, .cycles = 2};
     instructions[0x10] = (Instruction){.name = "BPL", .addressing = REL, .opcode = BPL, .cycles = 2};
     instructions[0x00] = (Instruction){.name = "BRK", .addressing = IMP, .opcode = BRK, .cycles = 7};
-    instructions[0x50] = (Instruction){.name = "BVC", .addressing = IMP, .opcode = BVC, .cycles = 2};
-    instructions[0x70] = (Instruction){.name = "BVS", .addressing = IMP, .opcode = BVS, .cycles = 2};
+    instructions[0x50] = (Instruction){.name = "BVC", .addressing = REL, .opcode = BVC, .cycles = 2};
+    instructions[0x70] = (Instruction){.name = "BVS", .addressing = REL, .opcode = BVS, .cycles = 2};
     instructions[0x18] = (Instruction){.name = "CLC", .addressing = IMP, .opcode = CLC, .cycles = 2};
     instructions[0xD8] = (Instruction){.name = "CLD", .addressing = IMP, .opcode = CLD, .cycles = 2};
     instructions[0x58] = (Instruction){.name = "CLI", .addressing = IMP, .opcode = CLI, .cycles = 2};
@@ -254,6 +404,7 @@ void CPU_load_instructions(void) {
     instructions[0x99] = (Instruction){.name = "STA", .addressing = ABY, .opcode = STA, .cycles = 5};
     instructions[0x81] = (Instruction){.name = "STA", .addressing = IZX, .opcode = STA, .cycles = 6};
     instructions[0x91] = (Instruction){.name = "STA", .addressing = IZY, .opcode = STA, .cycles = 6};
+    instructions[0x86] = (Instruction){.name = "STX", .addressing = ZP0, .opcode = STX, .cycles = 3};
     instructions[0x96] = (Instruction){.name = "STX", .addressing = ZPY, .opcode = STX, .cycles = 4};
     instructions[0x8E] = (Instruction){.name = "STX", .addressing = ABS, .opcode = STX, .cycles = 4};
     instructions[0x84] = (Instruction){.name = "STY", .addressing = ZP0, .opcode = STY, .cycles = 3};
@@ -266,91 +417,178 @@ void CPU_load_instructions(void) {
     instructions[0x9A] = (Instruction){.name = "TXS", .addressing = IMP, .opcode = TXS, .cycles = 2};
     instructions[0x98] = (Instruction){.name = "TYA", .addressing = IMP, .opcode = TYA, .cycles = 2};
 
-    log_info("Instructions loaded");
+#ifdef CPU_MODEL_65C02
+    load_65c02_instructions();
+#endif
+    log_info("%s instructions loaded", CPU_get_model());
 }
 
-uint8_t CPU_read(const uint16_t addr) {
-    return BUS_read(addr);
+uint8_t CPU_read(Machine *m, const uint16_t addr) {
+    MEMORY_MAP_ADD(m, MEMORY_READ, addr);
+    return BUS_read(m, addr);
 }
 
-void CPU_write(const uint16_t addr, const uint8_t data) {
-    BUS_write(addr, data);
+void CPU_write(Machine *m, const uint16_t addr, const uint8_t data) {
+    MEMORY_MAP_ADD(m, MEMORY_WRITE, addr);
+    BUS_write(m, addr, data);
 }
 
-const CPU *CPU_get_state(void) {
-    return &cpu;
+const CPU *CPU_get_state(const Machine *m) {
+    return &m->cpu;
 }
 
-uint16_t CPU_get_pc(void) {
-    return cpu.pc;
+uint16_t CPU_get_pc(const Machine *m) {
+    return m->cpu.pc;
+}
+
+uint64_t CPU_get_cycle_count(const Machine *m) {
+    return m->cpu.cycle_count;
+}
+
+uint64_t CPU_get_instruction_count(const Machine *m) {
+    return m->instruction_count;
 }
 
 // Emulate cpu start/reset
-void CPU_reset(void) {
-    cpu.a = 0;
-    cpu.x = 0;
-    cpu.y = 0;
+void CPU_reset(Machine *m) {
+    m->cpu.a = 0;
+    m->cpu.x = 0;
+    m->cpu.y = 0;
 
     /*
      * Set program counter start addr. This is acquired by reading the 2 bytes at reset vector hi|lo addresses
      */
-    const uint16_t reset_lo = CPU_read(CPU_RESET_LO);
-    const uint16_t reset_hi = CPU_read(CPU_RESET_HI);
-    const uint16_t pc_start = (reset_hi << 8) | reset_lo;
-    cpu.pc = pc_start;
-    cpu.sp = CPU_STACK_PTR_START;
+    m->cpu.pc = read_vector(m, CPU_RESET_LO, CPU_RESET_HI);
+    m->cpu.sp = CPU_STACK_PTR_START;
 
     // Set interrupt disabled and unused to 1
-    cpu.status = 0x00;
-    set_flag(FLAG_U, true);
+    m->cpu.status = 0x00;
+    set_flag(m, FLAG_U, true);
 
-    cpu.addr_abs = 0x0000;
-    cpu.addr_rel = 0x0000;
+    m->cpu.addr_abs = 0x0000;
+    m->cpu.addr_rel = 0x0000;
 
     // A 6502 reset takes ~8 cycles
-    cpu.cycles = 8;
+    m->cpu.cycles = 8;
+    m->cpu.cycle_count = 0;
+    m->instruction_count = 0;
+
+    // Devices reset with the cpu, and anything they had scheduled is relative to the old cycle count
+    Events_reset(m);
+    BUS_reset_devices(m);
 
     log_info("CPU started");
 }
 
 
 // Emulate interrupt requests that are only allowed if allowed (I flag == 0)
-void CPU_irq(void) {
-    if (get_flag(FLAG_I) == 1) {
+void CPU_irq(Machine *m) {
+    if (get_flag(m, FLAG_I) == 1) {
         // If disable interrupts are set, we are not allowed to run
         return;
     }
-    hardware_interrupt(CPU_IRQ_LO, CPU_IRQ_HI);
-    log_info("CPU IRQ requested, pc at: %04x", cpu.pc);
+    hardware_interrupt(m, CPU_IRQ_LO, CPU_IRQ_HI);
+    if (m->profiler) {
+        Profiler_interrupt(m, PROFILER_FRAME_IRQ, m->cpu.cycles);
+    }
+    log_debug("CPU IRQ requested, pc at: %04x", m->cpu.pc);
 }
 
 // Emulate non-maskable interrupts i.e., They will always run regardless of I flag
-void CPU_nmi(void) {
-    hardware_interrupt(CPU_NMI_LO, CPU_NMI_HI);
-    log_info("CPU NMI requested, pc at: %04x", cpu.pc);
+void CPU_nmi(Machine *m) {
+    hardware_interrupt(m, CPU_NMI_LO, CPU_NMI_HI);
+    if (m->profiler) {
+        Profiler_interrupt(m, PROFILER_FRAME_NMI, m->cpu.cycles);
+    }
+    log_debug("CPU NMI requested, pc at: %04x", m->cpu.pc);
 }
 
-void CPU_tick(void) {
-    if (cpu.cycles == 0) {
-        cpu.curr_opcode = CPU_read(cpu.pc++);
-
-        const Instruction *ins = &instructions[cpu.curr_opcode];
-        cpu.cycles = ins->cycles;
+void CPU_tick(Machine *m) {
+    if (m->cpu.cycles == 0 && m->cpu.cycle_count >= m->events.next_cycle) {
+        // May start an interrupt, which then takes the place of the next instruction
+        Events_dispatch(m);
+    }
+    if (m->cpu.cycles == 0) {
+        execute_instruction(m);
+    }
+    m->cpu.cycles--;
+    m->cpu.cycle_count++;
+}
 
-        const uint8_t additional_cycle1 = ins->addressing();
-        const uint8_t additional_cycle2 = ins->opcode();
+void CPU_step(Machine *m) {
+    while (m->cpu.cycles > 0) {
+        CPU_tick(m);
+    }
+    printf("PC=%04X, DATA=%s\n", m->cpu.pc, Disassembler_get_line_at(m, m->cpu.pc));
+    CPU_tick(m);
+}
 
-        cpu.cycles += (additional_cycle1 & additional_cycle2);
+void CPU_step_n(Machine *m, const uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        finish_instruction(m);
+        CPU_tick(m);
     }
-    cpu.cycles--;
 }
 
-void CPU_step(void) {
-    while (cpu.cycles > 0) {
-        CPU_tick();
+uint64_t CPU_run(Machine *m, const uint64_t cycles) {
+    const uint64_t start = m->cpu.cycle_count;
+    const uint64_t target = start + cycles;
+
+    finish_instruction(m);
+    while (m->cpu.cycle_count < target && !atomic_load_explicit(&m->pause_requested, memory_order_relaxed)) {
+        m->cpu.cycle_count += execute_instruction(m);
+        m->cpu.cycles = 0;
+        service_events(m);
     }
-    printf("PC=%04X, DATA=%s\n", cpu.pc, Disassembler_get_line_at(cpu.pc));
-    CPU_tick();
+
+    // A pause only ever applies to the batch it interrupted
+    atomic_store_explicit(&m->pause_requested, false, memory_order_relaxed);
+    return m->cpu.cycle_count - start;
+}
+
+uint64_t CPU_run_until(Machine *m, const uint16_t pc, const uint64_t max_cycles) {
+    const uint64_t start = m->cpu.cycle_count;
+    const uint64_t target = start + max_cycles;
+
+    /*
+     * Always execute at least one instruction, otherwise continuing from
+     * the address we stopped at last time would never get anywhere.
+     */
+    finish_instruction(m);
+    do {
+        m->cpu.cycle_count += execute_instruction(m);
+        m->cpu.cycles = 0;
+        service_events(m);
+    } while (m->cpu.pc != pc && m->cpu.cycle_count < target &&
+             !atomic_load_explicit(&m->pause_requested, memory_order_relaxed));
+
+    atomic_store_explicit(&m->pause_requested, false, memory_order_relaxed);
+    return m->cpu.cycle_count - start;
+}
+
+uint64_t CPU_run_to_breakpoint(Machine *m, const uint64_t max_cycles) {
+    const uint64_t start = m->cpu.cycle_count;
+    const uint64_t target = start + max_cycles;
+
+    m->breakpoints.hit = false;
+    finish_instruction(m);
+    do {
+        m->cpu.cycle_count += execute_instruction(m);
+        m->cpu.cycles = 0;
+        service_events(m);
+        // Checked before the budget, so splitting a run in several batches never skips a breakpoint
+        if (Breakpoint_is_set(&m->breakpoints, m->cpu.pc) && Breakpoint_condition_holds(m, m->cpu.pc)) {
+            m->breakpoints.hit = true;
+            break;
+        }
+    } while (m->cpu.cycle_count < target && !atomic_load_explicit(&m->pause_requested, memory_order_relaxed));
+
+    atomic_store_explicit(&m->pause_requested, false, memory_order_relaxed);
+    return m->cpu.cycle_count - start;
+}
+
+void CPU_pause(Machine *m) {
+    atomic_store_explicit(&m->pause_requested, true, memory_order_relaxed);
 }
 
 Instruction *CPU_get_instruction(const uint8_t opcode) {
@@ -363,21 +601,21 @@ Instruction *CPU_get_instruction(const uint8_t opcode) {
  ***********************************************************************
  */
 
-uint8_t ADC(void) {
-    const uint16_t data = CPU_read(cpu.addr_abs);
-    set_add_or_sub_result(data);
+uint8_t ADC(Machine *m) {
+    const uint8_t data = CPU_read(m, m->cpu.addr_abs);
+    set_add_or_sub_result(m, data, false);
     // May require an additional cycle
     return 1;
 }
 
-uint8_t AND(void) {
-    cpu.a &= CPU_read(cpu.addr_abs);
-    set_flag(FLAG_Z, cpu.a == 0);
-    set_flag(FLAG_N, cpu.a & 0x80);
+uint8_t AND(Machine *m) {
+    m->cpu.a &= CPU_read(m, m->cpu.addr_abs);
+    set_flag(m, FLAG_Z, m->cpu.a == 0);
+    set_flag(m, FLAG_N, m->cpu.a & 0x80);
     return 1;
 }
 
-uint8_t ASL(void) {
+uint8_t ASL(Machine *m) {
     uint16_t data = 0;
     uint16_t res = 0;
 
@@ -387,38 +625,38 @@ uint8_t ASL(void) {
      * byte from memory, but modify the accumulator directly.
      * If not then we DO want to read the next byte and write it back into memory.
      */
-    if (is_implied_addressing()) {
-        data = cpu.a;
+    if (is_implied_addressing(m)) {
+        data = m->cpu.a;
         res = data << 1;
-        cpu.a = res & 0x00FF;
+        m->cpu.a = res & 0x00FF;
     } else {
-        data = CPU_read(cpu.addr_abs);
+        data = CPU_read(m, m->cpu.addr_abs);
         res = data << 1;
-        CPU_write(cpu.addr_abs, res & 0x00FF);
+        CPU_write(m, m->cpu.addr_abs, res & 0x00FF);
     }
 
-    set_flag(FLAG_C, res > 0x00FF);
-    set_flag(FLAG_Z, (res & 0x00FF) == 0);
-    set_flag(FLAG_N, res & 0x80);
-    return 0;
+    set_flag(m, FLAG_C, res > 0x00FF);
+    set_flag(m, FLAG_Z, (res & 0x00FF) == 0);
+    set_flag(m, FLAG_N, res & 0x80);
+    return SHIFT_PAGE_PENALTY;
 }
 
-uint8_t BCC(void) {
-    branch_on_condition(get_flag(FLAG_C) == 0);
+uint8_t BCC(Machine *m) {
+    branch_on_condition(m, get_flag(m, FLAG_C) == 0);
     return 0;
 }
 
-uint8_t BCS(void) {
-    branch_on_condition(get_flag(FLAG_C) == 1);
+uint8_t BCS(Machine *m) {
+    branch_on_condition(m, get_flag(m, FLAG_C) == 1);
     return 0;
 }
 
-uint8_t BEQ(void) {
-    branch_on_condition(get_flag(FLAG_Z) == 1);
+uint8_t BEQ(Machine *m) {
+    branch_on_condition(m, get_flag(m, FLAG_Z) == 1);
     return 0;
 }
 
-uint8_t BIT(void) {
+uint8_t BIT(Machine *m) {
     /*
      * Used for setting N and V bits to whatever is in the memory location read.
      * If bit6 set, then set V flag.
@@ -426,205 +664,235 @@ uint8_t BIT(void) {
      * Kind of a poor mans version of SEC/CLC for bit 6 and/or 7 (that's how my brain thinks of them).
      * Extra confusion caused since flag Z is ACTUALLY set based on a real calculation with A
      */
-    const uint8_t data = CPU_read(cpu.addr_abs);
-    const uint8_t res = cpu.a & data;
-    set_flag(FLAG_Z, res == 0);
-    set_flag(FLAG_V, data & FLAG_V);
-    set_flag(FLAG_N, data & FLAG_N);
+    const uint8_t data = CPU_read(m, m->cpu.addr_abs);
+    const uint8_t res = m->cpu.a & data;
+    set_flag(m, FLAG_Z, res == 0);
+    set_flag(m, FLAG_V, data & FLAG_V);
+    set_flag(m, FLAG_N, data & FLAG_N);
+    // Only the 65C02 has BIT abs,X
+    return 1;
+}
+
+uint8_t BIT_IMM(Machine *m) {
+    // 65C02 BIT #imm only sets Z, there is no memory location for N and V to come from
+    set_flag(m, FLAG_Z, (m->cpu.a & CPU_read(m, m->cpu.addr_abs)) == 0);
     return 0;
 }
 
-uint8_t BMI(void) {
-    branch_on_condition(get_flag(FLAG_N) == 1);
+uint8_t BMI(Machine *m) {
+    branch_on_condition(m, get_flag(m, FLAG_N) == 1);
     return 0;
 }
 
-uint8_t BNE(void) {
-    branch_on_condition(get_flag(FLAG_Z) == 0);
+uint8_t BNE(Machine *m) {
+    branch_on_condition(m, get_flag(m, FLAG_Z) == 0);
     return 0;
 }
 
-uint8_t BPL(void) {
-    branch_on_condition(get_flag(FLAG_N) == 0);
+uint8_t BPL(Machine *m) {
+    branch_on_condition(m, get_flag(m, FLAG_N) == 0);
     return 0;
 }
 
-uint8_t BRK(void) {
-    set_flag(FLAG_I, true);
+uint8_t BRA(Machine *m) {
+    // Branch always (65C02)
+    branch_on_condition(m, true);
+    return 0;
+}
+
+uint8_t BRK(Machine *m) {
+    set_flag(m, FLAG_I, true);
 
     // Write hi and lo byte to stack (little-endian, reversed due to SP decrement)
-    CPU_write(CPU_STACK_PAGE + cpu.sp--, (cpu.pc >> 8) & 0x00FF);
-    CPU_write(CPU_STACK_PAGE + cpu.sp--, cpu.pc & 0x00FF);
+    CPU_write(m, CPU_STACK_PAGE + m->cpu.sp--, (m->cpu.pc >> 8) & 0x00FF);
+    CPU_write(m, CPU_STACK_PAGE + m->cpu.sp--, m->cpu.pc & 0x00FF);
 
     // Set B flag to 1 before pushing status (to indicate BRK vs IRQ)
-    set_flag(FLAG_B, true);
-    CPU_write(CPU_STACK_PAGE + cpu.sp--, cpu.status);
+    set_flag(m, FLAG_B, true);
+    CPU_write(m, CPU_STACK_PAGE + m->cpu.sp--, m->cpu.status);
 
     // B flag is cleared immediately after (it's only used for identification on the stack)
-    set_flag(FLAG_B, false);
+    set_flag(m, FLAG_B, false);
+#ifdef CPU_MODEL_65C02
+    set_flag(m, FLAG_D, false);
+#endif
 
     // Jump to IRQ vector
-    const uint16_t irq_lo = CPU_read(CPU_IRQ_LO) & 0x00FF;
-    const uint16_t irq_hi = CPU_read(CPU_IRQ_HI) & 0x00FF;
-    cpu.pc = (irq_hi << 8) | irq_lo;
+    m->cpu.pc = read_vector(m, CPU_IRQ_LO, CPU_IRQ_HI);
 
     return 0;
 }
 
-uint8_t BVC(void) {
+uint8_t BVC(Machine *m) {
     // Branch if overflow clear
-    branch_on_condition(get_flag(FLAG_V) == 0);
+    branch_on_condition(m, get_flag(m, FLAG_V) == 0);
     return 0;
 }
 
-uint8_t BVS(void) {
+uint8_t BVS(Machine *m) {
     // Branch on overflow set
-    branch_on_condition(get_flag(FLAG_V) == 1);
+    branch_on_condition(m, get_flag(m, FLAG_V) == 1);
     return 0;
 }
 
-uint8_t CLC(void) {
-    set_flag(FLAG_C, false);
+uint8_t CLC(Machine *m) {
+    set_flag(m, FLAG_C, false);
     return 0;
 }
 
-uint8_t CLD(void) {
+uint8_t CLD(Machine *m) {
     // Clear decimal flag
-    set_flag(FLAG_D, false);
+    set_flag(m, FLAG_D, false);
     return 0;
 }
 
-uint8_t CLI(void) {
+uint8_t CLI(Machine *m) {
     // Clear interrupt disable bit
-    set_flag(FLAG_I, false);
+    set_flag(m, FLAG_I, false);
     return 0;
 }
 
-uint8_t CLV(void) {
+uint8_t CLV(Machine *m) {
     // Clear overflow flag
-    set_flag(FLAG_V, false);
+    set_flag(m, FLAG_V, false);
+    return 0;
+}
+
+uint8_t CMP(Machine *m) {
+    compare_register(m, m->cpu.a);
     return 0;
 }
 
-uint8_t CMP(void) {
-    compare_register(cpu.a);
+uint8_t CPX(Machine *m) {
+    compare_register(m, m->cpu.x);
     return 0;
 }
 
-uint8_t CPX(void) {
-    compare_register(cpu.x);
+uint8_t CPY(Machine *m) {
+    compare_register(m, m->cpu.y);
     return 0;
 }
 
-uint8_t CPY(void) {
-    compare_register(cpu.y);
+uint8_t DEA(Machine *m) {
+    // Decrement accumulator by one (65C02 DEC A)
+    m->cpu.a--;
+    set_flag(m, FLAG_Z, m->cpu.a == 0);
+    set_flag(m, FLAG_N, m->cpu.a & 0x80);
     return 0;
 }
 
-uint8_t DEC(void) {
+uint8_t DEC(Machine *m) {
     // Decrement memory by one
-    uint8_t data = CPU_read(cpu.addr_abs);
+    uint8_t data = CPU_read(m, m->cpu.addr_abs);
     data--;
-    CPU_write(cpu.addr_abs, data);
-    set_flag(FLAG_Z, data == 0);
-    set_flag(FLAG_N, data & 0x80);
+    CPU_write(m, m->cpu.addr_abs, data);
+    set_flag(m, FLAG_Z, data == 0);
+    set_flag(m, FLAG_N, data & 0x80);
     return 0;
 }
 
-uint8_t DEX(void) {
+uint8_t DEX(Machine *m) {
     // Decrement X register by one
-    cpu.x--;
-    set_flag(FLAG_Z, cpu.x == 0);
-    set_flag(FLAG_N, cpu.x & 0x80);
+    m->cpu.x--;
+    set_flag(m, FLAG_Z, m->cpu.x == 0);
+    set_flag(m, FLAG_N, m->cpu.x & 0x80);
     return 0;
 }
 
-uint8_t DEY(void) {
+uint8_t DEY(Machine *m) {
     // Decrement Y register by one
-    cpu.y--;
-    set_flag(FLAG_Z, cpu.y == 0);
-    set_flag(FLAG_N, cpu.y & 0x80);
+    m->cpu.y--;
+    set_flag(m, FLAG_Z, m->cpu.y == 0);
+    set_flag(m, FLAG_N, m->cpu.y & 0x80);
     return 0;
 }
 
-uint8_t EOR(void) {
+uint8_t EOR(Machine *m) {
     // Exclusive or memory with accumulator
-    const uint8_t data = CPU_read(cpu.addr_abs);
-    cpu.a ^= data;
-    set_flag(FLAG_Z, cpu.a == 0);
-    set_flag(FLAG_N, cpu.a & 0x80);
+    const uint8_t data = CPU_read(m, m->cpu.addr_abs);
+    m->cpu.a ^= data;
+    set_flag(m, FLAG_Z, m->cpu.a == 0);
+    set_flag(m, FLAG_N, m->cpu.a & 0x80);
     return 1;
 }
 
-uint8_t ILL(void) {
+uint8_t ILL(Machine *m) {
     return 0;
 }
 
-uint8_t INC(void) {
-    uint8_t data = CPU_read(cpu.addr_abs);
+uint8_t INA(Machine *m) {
+    // Increment accumulator by one (65C02 INC A)
+    m->cpu.a++;
+    set_flag(m, FLAG_Z, m->cpu.a == 0);
+    set_flag(m, FLAG_N, m->cpu.a & 0x80);
+    return 0;
+}
+
+uint8_t INC(Machine *m) {
+    uint8_t data = CPU_read(m, m->cpu.addr_abs);
     data++;
-    CPU_write(cpu.addr_abs, data);
-    set_flag(FLAG_Z, data == 0);
-    set_flag(FLAG_N, data & 0x80);
+    CPU_write(m, m->cpu.addr_abs, data);
+    set_flag(m, FLAG_Z, data == 0);
+    set_flag(m, FLAG_N, data & 0x80);
     return 0;
 }
 
-uint8_t INX(void) {
-    cpu.x++;
-    set_flag(FLAG_Z, cpu.x == 0);
-    set_flag(FLAG_N, cpu.x & 0x80);
+uint8_t INX(Machine *m) {
+    m->cpu.x++;
+    set_flag(m, FLAG_Z, m->cpu.x == 0);
+    set_flag(m, FLAG_N, m->cpu.x & 0x80);
     return 0;
 }
 
-uint8_t INY(void) {
-    cpu.y++;
-    set_flag(FLAG_Z, cpu.y == 0);
-    set_flag(FLAG_N, cpu.y & 0x80);
+uint8_t INY(Machine *m) {
+    m->cpu.y++;
+    set_flag(m, FLAG_Z, m->cpu.y == 0);
+    set_flag(m, FLAG_N, m->cpu.y & 0x80);
     return 0;
 }
 
-uint8_t JMP(void) {
-    cpu.pc = cpu.addr_abs;
+uint8_t JMP(Machine *m) {
+    m->cpu.pc = m->cpu.addr_abs;
     return 0;
 }
 
-uint8_t JSR(void) {
-    cpu.pc--;
+uint8_t JSR(Machine *m) {
+    m->cpu.pc--;
 
     // Push PC hi and lo byte of pc to stack
-    CPU_write(CPU_STACK_PAGE + cpu.sp--, (cpu.pc >> 8) & 0x00FF);
-    CPU_write(CPU_STACK_PAGE + cpu.sp--, cpu.pc & 0x00FF);
+    CPU_write(m, CPU_STACK_PAGE + m->cpu.sp--, (m->cpu.pc >> 8) & 0x00FF);
+    CPU_write(m, CPU_STACK_PAGE + m->cpu.sp--, m->cpu.pc & 0x00FF);
 
     // set pc to new address
-    cpu.pc = cpu.addr_abs;
+    m->cpu.pc = m->cpu.addr_abs;
     return 0;
 }
 
-uint8_t LDA(void) {
+uint8_t LDA(Machine *m) {
     // Load into accumulator
-    cpu.a = CPU_read(cpu.addr_abs);
-    set_flag(FLAG_Z, cpu.a == 0);
-    set_flag(FLAG_N, cpu.a & 0x80);
+    m->cpu.a = CPU_read(m, m->cpu.addr_abs);
+    set_flag(m, FLAG_Z, m->cpu.a == 0);
+    set_flag(m, FLAG_N, m->cpu.a & 0x80);
     return 1;
 }
 
-uint8_t LDX(void) {
+uint8_t LDX(Machine *m) {
     // Load into x register
-    cpu.x = CPU_read(cpu.addr_abs);
-    set_flag(FLAG_Z, cpu.x == 0);
-    set_flag(FLAG_N, cpu.x & 0x80);
+    m->cpu.x = CPU_read(m, m->cpu.addr_abs);
+    set_flag(m, FLAG_Z, m->cpu.x == 0);
+    set_flag(m, FLAG_N, m->cpu.x & 0x80);
     return 1;
 }
 
-uint8_t LDY(void) {
+uint8_t LDY(Machine *m) {
     // Load into y register
-    cpu.y = CPU_read(cpu.addr_abs);
-    set_flag(FLAG_Z, cpu.y == 0);
-    set_flag(FLAG_N, cpu.y & 0x80);
+    m->cpu.y = CPU_read(m, m->cpu.addr_abs);
+    set_flag(m, FLAG_Z, m->cpu.y == 0);
+    set_flag(m, FLAG_N, m->cpu.y & 0x80);
     return 1;
 }
 
-uint8_t LSR(void) {
+uint8_t LSR(Machine *m) {
     uint16_t data = 0;
     uint16_t res = 0;
 
@@ -634,227 +902,273 @@ uint8_t LSR(void) {
      * byte from memory, but modify the accumulator directly.
      * If not then we DO want to read the next byte and write it back into memory.
      */
-    if (is_implied_addressing()) {
-        data = cpu.a;
-        set_flag(FLAG_C, data & 0x01);
+    if (is_implied_addressing(m)) {
+        data = m->cpu.a;
+        set_flag(m, FLAG_C, data & 0x01);
         res = data >> 1;
-        cpu.a = res & 0x00FF;
+        m->cpu.a = res & 0x00FF;
     } else {
-        data = CPU_read(cpu.addr_abs);
-        set_flag(FLAG_C, data & 0x01);
+        data = CPU_read(m, m->cpu.addr_abs);
+        set_flag(m, FLAG_C, data & 0x01);
         res = data >> 1;
-        CPU_write(cpu.addr_abs, res & 0x00FF);
+        CPU_write(m, m->cpu.addr_abs, res & 0x00FF);
     }
 
-    set_flag(FLAG_Z, (res & 0x00FF) == 0);
-    set_flag(FLAG_N, false); // MSB is always 0 after LSR
-    return 0;
+    set_flag(m, FLAG_Z, (res & 0x00FF) == 0);
+    set_flag(m, FLAG_N, false); // MSB is always 0 after LSR
+    return SHIFT_PAGE_PENALTY;
 }
 
-uint8_t NOP(void) {
+uint8_t NOP(Machine *m) {
     return 0;
 }
 
-uint8_t ORA(void) {
+uint8_t ORA(Machine *m) {
     // OR memory with accumulator
-    const uint8_t data = CPU_read(cpu.addr_abs);
-    cpu.a |= data;
-    set_flag(FLAG_Z, cpu.a == 0);
-    set_flag(FLAG_N, cpu.a & 0x80);
+    const uint8_t data = CPU_read(m, m->cpu.addr_abs);
+    m->cpu.a |= data;
+    set_flag(m, FLAG_Z, m->cpu.a == 0);
+    set_flag(m, FLAG_N, m->cpu.a & 0x80);
 
     // Candidate for additional cycle
     return 1;
 }
 
-uint8_t PHA(void) {
+uint8_t PHA(Machine *m) {
     // Push accumulator to stack
-    CPU_write(CPU_STACK_PAGE + cpu.sp, cpu.a);
-    cpu.sp--;
+    CPU_write(m, CPU_STACK_PAGE + m->cpu.sp, m->cpu.a);
+    m->cpu.sp--;
+    return 0;
+}
+
+uint8_t PHX(Machine *m) {
+    CPU_write(m, CPU_STACK_PAGE + m->cpu.sp--, m->cpu.x);
+    return 0;
+}
+
+uint8_t PHY(Machine *m) {
+    CPU_write(m, CPU_STACK_PAGE + m->cpu.sp--, m->cpu.y);
     return 0;
 }
 
-uint8_t PHP(void) {
+uint8_t PHP(Machine *m) {
     /*
      * Push status register to stack. Before pushing, B and U need to be set
      * and then toggled off.
      * */
-    CPU_write(CPU_STACK_PAGE + cpu.sp, cpu.status | FLAG_B | FLAG_U);
-    set_flag(FLAG_B, false);
-    set_flag(FLAG_U, false);
-    cpu.sp--;
+    CPU_write(m, CPU_STACK_PAGE + m->cpu.sp, m->cpu.status | FLAG_B | FLAG_U);
+    set_flag(m, FLAG_B, false);
+    set_flag(m, FLAG_U, false);
+    m->cpu.sp--;
     return 0;
 }
 
-uint8_t PLA(void) {
+uint8_t PLA(Machine *m) {
     // Pop accumulator from stack
-    cpu.sp++;
-    cpu.a = CPU_read(CPU_STACK_PAGE + cpu.sp);
-    set_flag(FLAG_Z, cpu.a == 0);
-    set_flag(FLAG_N, cpu.a & 0x80);
+    m->cpu.sp++;
+    m->cpu.a = CPU_read(m, CPU_STACK_PAGE + m->cpu.sp);
+    set_flag(m, FLAG_Z, m->cpu.a == 0);
+    set_flag(m, FLAG_N, m->cpu.a & 0x80);
     return 0;
 }
 
-uint8_t PLP(void) {
+uint8_t PLX(Machine *m) {
+    m->cpu.x = CPU_read(m, CPU_STACK_PAGE + (++m->cpu.sp));
+    set_flag(m, FLAG_Z, m->cpu.x == 0);
+    set_flag(m, FLAG_N, m->cpu.x & 0x80);
+    return 0;
+}
+
+uint8_t PLY(Machine *m) {
+    m->cpu.y = CPU_read(m, CPU_STACK_PAGE + (++m->cpu.sp));
+    set_flag(m, FLAG_Z, m->cpu.y == 0);
+    set_flag(m, FLAG_N, m->cpu.y & 0x80);
+    return 0;
+}
+
+uint8_t PLP(Machine *m) {
     // Pop status register from stack
-    cpu.sp++;
-    cpu.status = CPU_read(CPU_STACK_PAGE + cpu.sp);
-    set_flag(FLAG_B, false);
-    set_flag(FLAG_U, true);
+    m->cpu.sp++;
+    m->cpu.status = CPU_read(m, CPU_STACK_PAGE + m->cpu.sp);
+    set_flag(m, FLAG_B, false);
+    set_flag(m, FLAG_U, true);
     return 0;
 }
 
-uint8_t ROL(void) {
+uint8_t ROL(Machine *m) {
     uint16_t data = 0;
     uint16_t res = 0;
 
     // Rotate one bit left, LSB = whatever is in carry
-    const bool carry = get_flag(FLAG_C);
+    const bool carry = get_flag(m, FLAG_C);
 
-    if (is_implied_addressing()) {
-        data = cpu.a;
+    if (is_implied_addressing(m)) {
+        data = m->cpu.a;
         res = data << 1 | carry;
-        cpu.a = res & 0x00FF;
+        m->cpu.a = res & 0x00FF;
     } else {
-        data = CPU_read(cpu.addr_abs);
+        data = CPU_read(m, m->cpu.addr_abs);
         res = data << 1 | carry;
-        CPU_write(cpu.addr_abs, res & 0x00FF);
+        CPU_write(m, m->cpu.addr_abs, res & 0x00FF);
     }
 
-    set_flag(FLAG_C, res > 0x00FF);
-    set_flag(FLAG_Z, (res & 0x00FF) == 0);
-    set_flag(FLAG_N, res & 0x0080);
+    set_flag(m, FLAG_C, res > 0x00FF);
+    set_flag(m, FLAG_Z, (res & 0x00FF) == 0);
+    set_flag(m, FLAG_N, res & 0x0080);
 
-    return 0;
+    return SHIFT_PAGE_PENALTY;
 }
 
-uint8_t ROR(void) {
+uint8_t ROR(Machine *m) {
     // Rotate one bit right, MSB = whatever is in carry
     uint16_t data = 0;
     uint16_t res = 0;
-    const bool carry = get_flag(FLAG_C);
+    const bool carry = get_flag(m, FLAG_C);
 
-    if (is_implied_addressing()) {
-        data = cpu.a;
-        set_flag(FLAG_C, data & 0x01);  // Bit 0 goes to carry
+    if (is_implied_addressing(m)) {
+        data = m->cpu.a;
+        set_flag(m, FLAG_C, data & 0x01);  // Bit 0 goes to carry
         res = (data >> 1) | (carry << 7);
-        cpu.a = res & 0x00FF;
+        m->cpu.a = res & 0x00FF;
     } else {
-        data = CPU_read(cpu.addr_abs);
-        set_flag(FLAG_C, data & 0x01);  // Bit 0 goes to carry
+        data = CPU_read(m, m->cpu.addr_abs);
+        set_flag(m, FLAG_C, data & 0x01);  // Bit 0 goes to carry
         res = (data >> 1) | (carry << 7);
-        CPU_write(cpu.addr_abs, res & 0x00FF);
+        CPU_write(m, m->cpu.addr_abs, res & 0x00FF);
     }
 
-    set_flag(FLAG_Z, (res & 0x00FF) == 0);
-    set_flag(FLAG_N, res & 0x0080);
+    set_flag(m, FLAG_Z, (res & 0x00FF) == 0);
+    set_flag(m, FLAG_N, res & 0x0080);
 
-    return 0;
+    return SHIFT_PAGE_PENALTY;
 }
 
-uint8_t RTI(void) {
+uint8_t RTI(Machine *m) {
     // Retrieve status register from stack (should be the last thing that was pushed)
-    cpu.status = CPU_read(CPU_STACK_PAGE + (++cpu.sp));
+    m->cpu.status = CPU_read(m, CPU_STACK_PAGE + (++m->cpu.sp));
 
     // Set I and B to 0
-    set_flag(FLAG_I, false);
-    set_flag(FLAG_B, false);
+    set_flag(m, FLAG_I, false);
+    set_flag(m, FLAG_B, false);
 
     // Retrieve where pc was before calling an interrupt.
-    const uint16_t pc_lo = CPU_read(CPU_STACK_PAGE + (++cpu.sp));
-    const uint16_t pc_hi = CPU_read(CPU_STACK_PAGE + (++cpu.sp));
+    const uint16_t pc_lo = CPU_read(m, CPU_STACK_PAGE + (++m->cpu.sp));
+    const uint16_t pc_hi = CPU_read(m, CPU_STACK_PAGE + (++m->cpu.sp));
 
     // Set pc to where it was before entering the subroutine
-    cpu.pc = (pc_hi << 8) | (pc_lo & 0x00FF);
+    m->cpu.pc = (pc_hi << 8) | (pc_lo & 0x00FF);
     return 0;
 }
 
-uint8_t RTS(void) {
+uint8_t RTS(Machine *m) {
     // Pop PC lo and hi byte from the stack
-    const uint16_t pc_lo = CPU_read(CPU_STACK_PAGE + (++cpu.sp));
-    const uint16_t pc_hi = CPU_read(CPU_STACK_PAGE + (++cpu.sp));
+    const uint16_t pc_lo = CPU_read(m, CPU_STACK_PAGE + (++m->cpu.sp));
+    const uint16_t pc_hi = CPU_read(m, CPU_STACK_PAGE + (++m->cpu.sp));
 
     // Set pc to where it was before entering the subroutine +1 (since we decrement by one on JSR)
-    cpu.pc = ((pc_hi << 8) | (pc_lo & 0x00FF)) + 1;
+    m->cpu.pc = ((pc_hi << 8) | (pc_lo & 0x00FF)) + 1;
     return 0;
 }
 
-uint8_t SBC(void) {
-    const uint16_t data = CPU_read(cpu.addr_abs);
-    set_add_or_sub_result(data ^ 0x00FF);
+uint8_t SBC(Machine *m) {
+    const uint8_t data = CPU_read(m, m->cpu.addr_abs);
+    set_add_or_sub_result(m, data, true);
     // May required additional cycle
     return 1;
 }
 
-uint8_t SEC(void) {
-    set_flag(FLAG_C, true);
+uint8_t SEC(Machine *m) {
+    set_flag(m, FLAG_C, true);
     return 0;
 }
 
-uint8_t SED(void) {
+uint8_t SED(Machine *m) {
     // Set decimal mode
-    set_flag(FLAG_D, true);
+    set_flag(m, FLAG_D, true);
     return 0;
 }
 
-uint8_t SEI(void) {
+uint8_t SEI(Machine *m) {
     // Set interrupt disable bit (0 = irq and brk are free to go, nmi will always fire)
-    set_flag(FLAG_I, true);
+    set_flag(m, FLAG_I, true);
     return 0;
 }
 
-uint8_t STA(void) {
+uint8_t STA(Machine *m) {
     // Store accumulator
-    CPU_write(cpu.addr_abs, cpu.a);
+    CPU_write(m, m->cpu.addr_abs, m->cpu.a);
+    return 0;
+}
+
+uint8_t STX(Machine *m) {
+    CPU_write(m, m->cpu.addr_abs, m->cpu.x);
+    return 0;
+}
+
+uint8_t STY(Machine *m) {
+    CPU_write(m, m->cpu.addr_abs, m->cpu.y);
     return 0;
 }
 
-uint8_t STX(void) {
-    CPU_write(cpu.addr_abs, cpu.x);
+uint8_t STZ(Machine *m) {
+    // Store zero (65C02)
+    CPU_write(m, m->cpu.addr_abs, 0x00);
     return 0;
 }
 
-uint8_t STY(void) {
-    CPU_write(cpu.addr_abs, cpu.y);
+uint8_t TAX(Machine *m) {
+    m->cpu.x = m->cpu.a;
+    set_flag(m, FLAG_Z, m->cpu.x == 0);
+    set_flag(m, FLAG_N, m->cpu.x & 0x80);
     return 0;
 }
 
-uint8_t TAX(void) {
-    cpu.x = cpu.a;
-    set_flag(FLAG_Z, cpu.x == 0);
-    set_flag(FLAG_N, cpu.x & 0x80);
+uint8_t TAY(Machine *m) {
+    m->cpu.y = m->cpu.a;
+    set_flag(m, FLAG_Z, m->cpu.y == 0);
+    set_flag(m, FLAG_N, m->cpu.y & 0x80);
     return 0;
 }
 
-uint8_t TAY(void) {
-    cpu.y = cpu.a;
-    set_flag(FLAG_Z, cpu.y == 0);
-    set_flag(FLAG_N, cpu.y & 0x80);
+uint8_t TRB(Machine *m) {
+    // Test and reset bits (65C02), Z is set like BIT does, then the bits set in A are cleared in memory
+    const uint8_t data = CPU_read(m, m->cpu.addr_abs);
+    set_flag(m, FLAG_Z, (m->cpu.a & data) == 0);
+    CPU_write(m, m->cpu.addr_abs, data & ~m->cpu.a);
     return 0;
 }
 
-uint8_t TSX(void) {
-    cpu.x = cpu.sp;
-    set_flag(FLAG_Z, cpu.x == 0);
-    set_flag(FLAG_N, cpu.x & 0x80);
+uint8_t TSB(Machine *m) {
+    // Test and set bits (65C02), same as TRB but sets the bits set in A
+    const uint8_t data = CPU_read(m, m->cpu.addr_abs);
+    set_flag(m, FLAG_Z, (m->cpu.a & data) == 0);
+    CPU_write(m, m->cpu.addr_abs, data | m->cpu.a);
     return 0;
 }
 
-uint8_t TXA(void) {
-    cpu.a = cpu.x;
-    set_flag(FLAG_Z, cpu.a == 0);
-    set_flag(FLAG_N, cpu.a & 0x80);
+uint8_t TSX(Machine *m) {
+    m->cpu.x = m->cpu.sp;
+    set_flag(m, FLAG_Z, m->cpu.x == 0);
+    set_flag(m, FLAG_N, m->cpu.x & 0x80);
     return 0;
 }
 
-uint8_t TXS(void) {
-    cpu.sp = cpu.x;
+uint8_t TXA(Machine *m) {
+    m->cpu.a = m->cpu.x;
+    set_flag(m, FLAG_Z, m->cpu.a == 0);
+    set_flag(m, FLAG_N, m->cpu.a & 0x80);
     return 0;
 }
 
-uint8_t TYA(void) {
-    cpu.a = cpu.y;
-    set_flag(FLAG_Z, cpu.a == 0);
-    set_flag(FLAG_N, cpu.a & 0x80);
+uint8_t TXS(Machine *m) {
+    m->cpu.sp = m->cpu.x;
+    return 0;
+}
+
+uint8_t TYA(Machine *m) {
+    m->cpu.a = m->cpu.y;
+    set_flag(m, FLAG_Z, m->cpu.a == 0);
+    set_flag(m, FLAG_N, m->cpu.a & 0x80);
     return 0;
 }
 
@@ -863,91 +1177,103 @@ uint8_t TYA(void) {
 // Addressing modes
 // ==============================================
 
-uint8_t ABS(void) {
+uint8_t ABS(Machine *m) {
     // Absolute addressing mode, read the lo and hi byte from pc and or together to 16 bit word, no additional cycle
-    const uint16_t lo = CPU_read(cpu.pc++);
-    const uint16_t hi = CPU_read(cpu.pc++);
-    cpu.addr_abs = (hi << 8) | lo;
+    const uint16_t lo = CPU_read(m, m->cpu.pc++);
+    const uint16_t hi = CPU_read(m, m->cpu.pc++);
+    m->cpu.addr_abs = (hi << 8) | lo;
     return 0;
 }
 
-uint8_t ABX(void) {
-    const uint16_t lo = CPU_read(cpu.pc++);
-    const uint16_t hi = CPU_read(cpu.pc++);
-    cpu.addr_abs = ((hi << 8) | lo) + cpu.x;
+uint8_t ABX(Machine *m) {
+    const uint16_t lo = CPU_read(m, m->cpu.pc++);
+    const uint16_t hi = CPU_read(m, m->cpu.pc++);
+    m->cpu.addr_abs = ((hi << 8) | lo) + m->cpu.x;
 
     // If we crossed page boundary we need to return an additional clock cycle
-    if ((cpu.addr_abs & 0xFF00) != (hi << 8)) {
+    if ((m->cpu.addr_abs & 0xFF00) != (hi << 8)) {
         return 1;
     }
     return 0;
 }
 
-uint8_t ABY(void) {
-    const uint16_t lo = CPU_read(cpu.pc++);
-    const uint16_t hi = CPU_read(cpu.pc++);
-    cpu.addr_abs = ((hi << 8) | lo) + cpu.y;
+uint8_t ABY(Machine *m) {
+    const uint16_t lo = CPU_read(m, m->cpu.pc++);
+    const uint16_t hi = CPU_read(m, m->cpu.pc++);
+    m->cpu.addr_abs = ((hi << 8) | lo) + m->cpu.y;
 
     // If we crossed page boundary we need to return an additional clock cycle
-    if ((cpu.addr_abs & 0xFF00) != (hi << 8)) {
+    if ((m->cpu.addr_abs & 0xFF00) != (hi << 8)) {
         return 1;
     }
     return 0;
 }
 
-uint8_t IMM(void) {
+uint8_t IMM(Machine *m) {
     // Immediate mode, set absolute address to pc and inc pc
     // Requires no additional cycles
-    cpu.addr_abs = cpu.pc++;
+    m->cpu.addr_abs = m->cpu.pc++;
     return 0;
 }
 
-uint8_t IMP(void) {
+uint8_t IMP(Machine *m) {
     // There could be stuff going on with the accumulator in implied mode
-    // cpu.curr_opcode = cpu.a;
+    // m->cpu.curr_opcode = m->cpu.a;
     return 0;
 }
 
-uint8_t IND(void) {
+uint8_t IND(Machine *m) {
     /*
      * Indirect addressing mode meaning the location we are reading is a 16-bit pointer to the actual
      * address to set addr_abs to.
      */
-    const uint16_t ptr_lo = CPU_read(cpu.pc++) & 0x00FF;
-    const uint16_t ptr_hi = CPU_read(cpu.pc++) & 0x00FF;
+    const uint16_t ptr_lo = CPU_read(m, m->cpu.pc++) & 0x00FF;
+    const uint16_t ptr_hi = CPU_read(m, m->cpu.pc++) & 0x00FF;
 
     const uint16_t data = (ptr_hi << 8) | ptr_lo;
 
+    const uint16_t new_addr_lo = CPU_read(m, data);
+#ifdef CPU_MODEL_65C02
+    // Fixed on the 65C02 at the cost of a cycle
+    const uint16_t new_addr_hi = CPU_read(m, data + 1);
+#else
     /*
      * There is a bug in the 6502 where if the low byte of the address is 0xFF it does
      * not jump to the next page in memory but wraps around in the same page
      */
-    const uint8_t new_addr_lo = CPU_read(data);
-    uint16_t new_addr_hi = 0;
-    if (ptr_lo == 0x00FF) {
-        new_addr_hi = CPU_read(data & 0xFF00) << 8;
-    } else {
-        new_addr_hi = CPU_read(data + 1);
-    }
-    cpu.addr_abs = new_addr_hi << 8 | new_addr_lo;
+    const uint16_t new_addr_hi = CPU_read(m, (data & 0xFF00) | ((data + 1) & 0x00FF));
+#endif
+    m->cpu.addr_abs = new_addr_hi << 8 | new_addr_lo;
+
+    return 0;
+}
+
+uint8_t IAX(Machine *m) {
+    // Absolute indexed indirect, only used by the 65C02 JMP ($nnnn,X)
+    const uint16_t lo = CPU_read(m, m->cpu.pc++);
+    const uint16_t hi = CPU_read(m, m->cpu.pc++);
+    const uint16_t ptr = ((hi << 8) | lo) + m->cpu.x;
 
+    const uint16_t new_addr_lo = CPU_read(m, ptr);
+    const uint16_t new_addr_hi = CPU_read(m, ptr + 1);
+    m->cpu.addr_abs = new_addr_hi << 8 | new_addr_lo;
     return 0;
 }
 
-uint8_t IZX(void) {
+uint8_t IZX(Machine *m) {
     /*
      * Pre-indexed indirect addressing mode in the zero page.
      * Pc is set to hi-byte+x+1 | lo-byte+x to data at location read
      */
-    const uint16_t ptr = CPU_read(cpu.pc++) & 0x00FF;
-    const uint8_t new_addr_lo = CPU_read(ptr + cpu.x);
-    const uint8_t new_addr_hi = CPU_read(ptr + cpu.x + 1);
+    const uint16_t ptr = CPU_read(m, m->cpu.pc++) & 0x00FF;
+    const uint8_t new_addr_lo = CPU_read(m, ptr + m->cpu.x);
+    const uint8_t new_addr_hi = CPU_read(m, ptr + m->cpu.x + 1);
 
-    cpu.addr_abs = new_addr_hi << 8 | new_addr_lo;
+    m->cpu.addr_abs = new_addr_hi << 8 | new_addr_lo;
     return 0;
 }
 
-uint8_t IZY(void) {
+uint8_t IZY(Machine *m) {
     /*
      * Address Mode: Indirect Y
      * The supplied 8-bit address indexes a location in page 0x00. From
@@ -955,38 +1281,47 @@ uint8_t IZY(void) {
      * Y Register are added to it to offset it. If the offset causes a
      * change in the page, then an additional clock cycle is required.
      */
-    const uint16_t ptr = CPU_read(cpu.pc++) & 0x00FF;
-    const uint16_t lo = CPU_read(ptr);
-    const uint16_t hi = CPU_read(ptr + 1);
+    const uint16_t ptr = CPU_read(m, m->cpu.pc++) & 0x00FF;
+    const uint16_t lo = CPU_read(m, ptr);
+    const uint16_t hi = CPU_read(m, ptr + 1);
 
-    cpu.addr_abs = ((hi << 8) | lo) + cpu.y;
-    if ((cpu.addr_abs & 0xFF00) != (hi << 8)) {
+    m->cpu.addr_abs = ((hi << 8) | lo) + m->cpu.y;
+    if ((m->cpu.addr_abs & 0xFF00) != (hi << 8)) {
         return 1;
     }
     return 0;
 }
 
-uint8_t REL(void) {
-    cpu.addr_rel = CPU_read(cpu.pc++);
+uint8_t REL(Machine *m) {
+    m->cpu.addr_rel = CPU_read(m, m->cpu.pc++);
 
-    if (cpu.addr_rel & 0x80) {
-        cpu.addr_rel |= 0xFF00;
+    if (m->cpu.addr_rel & 0x80) {
+        m->cpu.addr_rel |= 0xFF00;
     }
     return 0;
 }
 
-uint8_t ZP0(void) {
-    cpu.addr_abs = CPU_read(cpu.pc++) & 0x00FF;
+uint8_t ZP0(Machine *m) {
+    m->cpu.addr_abs = CPU_read(m, m->cpu.pc++) & 0x00FF;
+    return 0;
+}
+
+uint8_t ZPI(Machine *m) {
+    // Zero page indirect (65C02), like IZY without adding Y. The pointer wraps within the zero page.
+    const uint8_t ptr = CPU_read(m, m->cpu.pc++);
+    const uint16_t lo = CPU_read(m, ptr);
+    const uint16_t hi = CPU_read(m, (uint8_t) (ptr + 1));
+    m->cpu.addr_abs = (hi << 8) | lo;
     return 0;
 }
 
-uint8_t ZPX(void) {
-    cpu.addr_abs = (CPU_read(cpu.pc++) + cpu.x) & 0x00FF;
+uint8_t ZPX(Machine *m) {
+    m->cpu.addr_abs = (CPU_read(m, m->cpu.pc++) + m->cpu.x) & 0x00FF;
     return 0;
 }
 
-uint8_t ZPY(void) {
-    cpu.addr_abs = (CPU_read(cpu.pc++) + cpu.y) & 0x00FF;
+uint8_t ZPY(Machine *m) {
+    m->cpu.addr_abs = (CPU_read(m, m->cpu.pc++) + m->cpu.y) & 0x00FF;
     return 0;
 }
 
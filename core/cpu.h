@@ -30,8 +30,11 @@
 // =========================================================
 // Type declarations
 // =========================================================
-typedef uint8_t (*opcode_fn)(void);
-typedef uint8_t (*addressing_fn)(void);
+// Defined in machine.h, every function operating on emulator state takes one
+typedef struct Machine Machine;
+
+typedef uint8_t (*opcode_fn)(Machine *m);
+typedef uint8_t (*addressing_fn)(Machine *m);
 
 typedef struct mos6502 {
     uint8_t a;
@@ -44,6 +47,8 @@ typedef struct mos6502 {
     uint16_t addr_rel;
     uint8_t curr_opcode;
     uint8_t cycles;
+    // Total number of cycles elapsed since the last reset
+    uint64_t cycle_count;
 } CPU;
 
 typedef struct Instruction {
@@ -53,93 +58,128 @@ typedef struct Instruction {
     uint8_t cycles;
 } Instruction;
 
-const CPU *CPU_get_state(void);
-uint16_t CPU_get_pc(void);
+const CPU *CPU_get_state(const Machine *m);
+uint16_t CPU_get_pc(const Machine *m);
+// Total number of cycles elapsed since the last reset
+uint64_t CPU_get_cycle_count(const Machine *m);
+// Instructions executed since the last reset, by any of the run loops, interrupts not included
+uint64_t CPU_get_instruction_count(const Machine *m);
+// Populate the instruction table shared by all machines, call once before running any of them
 void CPU_load_instructions(void);
-void CPU_reset(void);
-void CPU_irq(void);
-void CPU_nmi(void);
-uint8_t CPU_read(uint16_t addr);
-void CPU_write(uint16_t addr, uint8_t data);
+void CPU_reset(Machine *m);
+void CPU_irq(Machine *m);
+void CPU_nmi(Machine *m);
+uint8_t CPU_read(Machine *m, uint16_t addr);
+void CPU_write(Machine *m, uint16_t addr, uint8_t data);
 Instruction *CPU_get_instruction(uint8_t opcode);
+// The cpu model the core was built for, "6502" or "65C02" (cmake -DCPU_MODEL=65C02)
+const char *CPU_get_model(void);
 
 // Tick one cycle
-void CPU_tick(void);
+void CPU_tick(Machine *m);
 // Tick to the next instruction (e.g. cycles==0)
-void CPU_step(void);
+void CPU_step(Machine *m);
+// Same as calling CPU_step n times, minus the per step tracing
+void CPU_step_n(Machine *m, uint32_t n);
+// Run whole instructions until at least `cycles` cycles have elapsed or CPU_pause() is called.
+// Returns the number of cycles actually executed.
+uint64_t CPU_run(Machine *m, uint64_t cycles);
+// Same as CPU_run but also stops as soon as pc == `pc` (at least one instruction is always executed)
+uint64_t CPU_run_until(Machine *m, uint16_t pc, uint64_t max_cycles);
+/**
+ * Same as CPU_run but also stops before executing an instruction at a breakpoint whose condition
+ * holds (see breakpoint.h), check Breakpoint_was_hit to tell why it returned. The instruction at
+ * the current pc always runs, so a run can continue from the breakpoint it stopped at.
+ */
+uint64_t CPU_run_to_breakpoint(Machine *m, uint64_t max_cycles);
+// Ask a running batch to stop at the next instruction boundary. Safe to call from any thread.
+void CPU_pause(Machine *m);
 
-// Opcodes
-uint8_t ADC(void);
-uint8_t AND(void);
-uint8_t ASL(void);
-uint8_t BCC(void);
-uint8_t BCS(void);
-uint8_t BEQ(void);
-uint8_t BIT(void);
-uint8_t BMI(void);
-uint8_t BNE(void);
-uint8_t BPL(void);
-uint8_t BRK(void);
-uint8_t BVC(void);
-uint8_t BVS(void);
-uint8_t CLC(void);
-uint8_t CLD(void);
-uint8_t CLI(void);
-uint8_t CLV(void);
-uint8_t CMP(void);
-uint8_t CPX(void);
-uint8_t CPY(void);
-uint8_t DEC(void);
-uint8_t DEX(void);
-uint8_t DEY(void);
-uint8_t EOR(void);
-uint8_t INC(void);
-uint8_t INX(void);
-uint8_t INY(void);
-uint8_t JMP(void);
-uint8_t JSR(void);
-uint8_t LDA(void);
-uint8_t LDX(void);
-uint8_t LDY(void);
-uint8_t LSR(void);
-uint8_t NOP(void);
-uint8_t ORA(void);
-uint8_t PHA(void);
-uint8_t PHP(void);
-uint8_t PLA(void);
-uint8_t PLP(void);
-uint8_t ROL(void);
-uint8_t ROR(void);
-uint8_t RTI(void);
-uint8_t RTS(void);
-uint8_t SBC(void);
-uint8_t SEC(void);
-uint8_t SED(void);
-uint8_t SEI(void);
-uint8_t STA(void);
-uint8_t STX(void);
-uint8_t STY(void);
-uint8_t TAX(void);
-uint8_t TAY(void);
-uint8_t TSX(void);
-uint8_t TXA(void);
-uint8_t TYA(void);
-uint8_t TXS(void);
-uint8_t ILL(void);
+// Opcodes, the ones marked 65C02 are only in the instruction table of a 65C02 build
+uint8_t ADC(Machine *m);
+uint8_t AND(Machine *m);
+uint8_t ASL(Machine *m);
+uint8_t BCC(Machine *m);
+uint8_t BCS(Machine *m);
+uint8_t BEQ(Machine *m);
+uint8_t BIT(Machine *m);
+uint8_t BIT_IMM(Machine *m); // 65C02
+uint8_t BMI(Machine *m);
+uint8_t BNE(Machine *m);
+uint8_t BPL(Machine *m);
+uint8_t BRA(Machine *m); // 65C02
+uint8_t BRK(Machine *m);
+uint8_t BVC(Machine *m);
+uint8_t BVS(Machine *m);
+uint8_t CLC(Machine *m);
+uint8_t CLD(Machine *m);
+uint8_t CLI(Machine *m);
+uint8_t CLV(Machine *m);
+uint8_t CMP(Machine *m);
+uint8_t CPX(Machine *m);
+uint8_t CPY(Machine *m);
+uint8_t DEA(Machine *m); // 65C02
+uint8_t DEC(Machine *m);
+uint8_t DEX(Machine *m);
+uint8_t DEY(Machine *m);
+uint8_t EOR(Machine *m);
+uint8_t INA(Machine *m); // 65C02
+uint8_t INC(Machine *m);
+uint8_t INX(Machine *m);
+uint8_t INY(Machine *m);
+uint8_t JMP(Machine *m);
+uint8_t JSR(Machine *m);
+uint8_t LDA(Machine *m);
+uint8_t LDX(Machine *m);
+uint8_t LDY(Machine *m);
+uint8_t LSR(Machine *m);
+uint8_t NOP(Machine *m);
+uint8_t ORA(Machine *m);
+uint8_t PHA(Machine *m);
+uint8_t PHP(Machine *m);
+uint8_t PHX(Machine *m); // 65C02
+uint8_t PHY(Machine *m); // 65C02
+uint8_t PLA(Machine *m);
+uint8_t PLP(Machine *m);
+uint8_t PLX(Machine *m); // 65C02
+uint8_t PLY(Machine *m); // 65C02
+uint8_t ROL(Machine *m);
+uint8_t ROR(Machine *m);
+uint8_t RTI(Machine *m);
+uint8_t RTS(Machine *m);
+uint8_t SBC(Machine *m);
+uint8_t SEC(Machine *m);
+uint8_t SED(Machine *m);
+uint8_t SEI(Machine *m);
+uint8_t STA(Machine *m);
+uint8_t STX(Machine *m);
+uint8_t STY(Machine *m);
+uint8_t STZ(Machine *m); // 65C02
+uint8_t TAX(Machine *m);
+uint8_t TAY(Machine *m);
+uint8_t TRB(Machine *m); // 65C02
+uint8_t TSB(Machine *m); // 65C02
+uint8_t TSX(Machine *m);
+uint8_t TXA(Machine *m);
+uint8_t TYA(Machine *m);
+uint8_t TXS(Machine *m);
+uint8_t ILL(Machine *m);
 
-// Addressing modes
-uint8_t ABS(void);
-uint8_t ABX(void);
-uint8_t ABY(void);
-uint8_t IMM(void);
-uint8_t IMP(void);
-uint8_t IND(void);
-uint8_t IZX(void);
-uint8_t IZY(void);
-uint8_t REL(void);
-uint8_t ZP0(void);
-uint8_t ZPX(void);
-uint8_t ZPY(void);
+// Addressing modes, the ones marked 65C02 are only used by a 65C02 build
+uint8_t ABS(Machine *m);
+uint8_t ABX(Machine *m);
+uint8_t ABY(Machine *m);
+uint8_t IMM(Machine *m);
+uint8_t IAX(Machine *m); // 65C02
+uint8_t IMP(Machine *m);
+uint8_t IND(Machine *m);
+uint8_t IZX(Machine *m);
+uint8_t IZY(Machine *m);
+uint8_t REL(Machine *m);
+uint8_t ZP0(Machine *m);
+uint8_t ZPI(Machine *m); // 65C02
+uint8_t ZPX(Machine *m);
+uint8_t ZPY(Machine *m);
 
 
 #endif //INC_6502_EMULATOR_CPU_H
\ No newline at end of file
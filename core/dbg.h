@@ -5,15 +5,13 @@
 #include <errno.h>
 #include <string.h>
 
-#define NDEBUG
+#include "log.h"
 
-#ifdef NDEBUG
-#define log_debug(M, ...)
-#else
-#define log_debug(M, ...) fprintf(stdout, "DEBUG %s:%d: " M "\n",\
-__FILE__, __LINE__, ##__VA_ARGS__)
-#endif
+// Chatter from runtime paths goes through the asynchronous logger, see log.h
+#define log_debug(M, ...) LOG_DEBUG(M, ##__VA_ARGS__)
+#define log_info(M, ...) LOG_INFO(M, ##__VA_ARGS__)
 
+// Errors and warnings are written right away, they may be the last thing before an exit
 #define clean_errno() (errno == 0 ? "None" : strerror(errno))
 
 #define log_err(M, ...) fprintf(stderr,\
@@ -24,9 +22,6 @@ clean_errno(), ##__VA_ARGS__)
 "[WARN] (%s:%d: errno: %s) " M "\n",\
 __FILE__, __LINE__, clean_errno(), ##__VA_ARGS__)
 
-#define log_info(M, ...) fprintf(stdout, "[INFO] (%s:%d) " M "\n",\
-__FILE__, __LINE__, ##__VA_ARGS__)
-
 // Basic check with custom action
 #define check(A, M, ACTION, ...) do { \
 if(!(A)) { \
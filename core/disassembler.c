@@ -2,22 +2,21 @@
 // Created by johan on 2025-10-23.
 //
 
-// ReSharper disable CppDFAMemoryLeak because this memory will live during the entire program life-cycle
 #include "disassembler.h"
 
 #include <stdlib.h>
 
+#include "bus.h"
 #include "cpu.h"
 #include "dbg.h"
+#include "machine.h"
 #include "rom.h"
 
-static SourceCode code;
-
-void Disassembler_parse_rom(const ROM *const rom) {
-    Disassembler_parse_section(rom->start, rom->end);
+void Disassembler_parse_rom(Machine *const m, const ROM *const rom) {
+    Disassembler_parse_section(m, rom->start, rom->end);
 }
 
-void Disassembler_parse_section(const uint16_t start, const uint16_t end) {
+void Disassembler_parse_section(Machine *const m, const uint16_t start, const uint16_t end) {
     const uint16_t max_instructions = end - start;
     SourceLine *lines = calloc(max_instructions, sizeof(SourceLine));
     check_mem(lines, exit(EXIT_FAILURE));
@@ -27,7 +26,7 @@ void Disassembler_parse_section(const uint16_t start, const uint16_t end) {
         const uint16_t origin = addr;
 
         char buffer[32];
-        const uint8_t opcode = CPU_read(addr++);
+        const uint8_t opcode = BUS_peek(m, addr++);
         const Instruction *ins = CPU_get_instruction(opcode);
 
         char operand_str[16] = "";
@@ -36,45 +35,53 @@ void Disassembler_parse_section(const uint16_t start, const uint16_t end) {
         if (addr_fn == IMP) {
             snprintf(operand_str, operand_len, "{IMP}");
         } else if (addr_fn == IMM) {
-            const uint8_t data = CPU_read(addr++);
+            const uint8_t data = BUS_peek(m, addr++);
             snprintf(operand_str, operand_len, "#$%02X {IMM}", data);
         } else if (addr_fn == ABS) {
-            const uint8_t lo = CPU_read(addr++);
-            const uint8_t hi = CPU_read(addr++);
+            const uint8_t lo = BUS_peek(m, addr++);
+            const uint8_t hi = BUS_peek(m, addr++);
             const uint16_t abs = (hi << 8) | lo;
             snprintf(operand_str, operand_len, "$%04X {ABS}", abs);
         } else if (addr_fn == ABX) {
-            const uint8_t lo = CPU_read(addr++);
-            const uint8_t hi = CPU_read(addr++);
+            const uint8_t lo = BUS_peek(m, addr++);
+            const uint8_t hi = BUS_peek(m, addr++);
             const uint16_t abx = (hi << 8) | lo;
             snprintf(operand_str, operand_len, "$%04X,X {ABX}", abx);
         } else if (addr_fn == ABY) {
-            const uint8_t lo = CPU_read(addr++);
-            const uint8_t hi = CPU_read(addr++);
+            const uint8_t lo = BUS_peek(m, addr++);
+            const uint8_t hi = BUS_peek(m, addr++);
             const uint16_t aby = (hi << 8) | lo;
             snprintf(operand_str, operand_len, "$%04X,Y {ABY}", aby);
         } else if (addr_fn == ZP0) {
-            const uint8_t data = CPU_read(addr++);
+            const uint8_t data = BUS_peek(m, addr++);
             snprintf(operand_str, operand_len, "$%02X {ZP0}", data);
         } else if (addr_fn == ZPX) {
-            const uint8_t data = CPU_read(addr++);
+            const uint8_t data = BUS_peek(m, addr++);
             snprintf(operand_str, operand_len, "$%02X,X {ZPX}", data);
         } else if (addr_fn == ZPY) {
-            const uint8_t data = CPU_read(addr++);
+            const uint8_t data = BUS_peek(m, addr++);
             snprintf(operand_str, operand_len, "$%02X,Y {ZPY}", data);
         } else if (addr_fn == REL) {
-            const uint8_t data = CPU_read(addr++);
+            const uint8_t data = BUS_peek(m, addr++);
             snprintf(operand_str, operand_len, "$%02X {REL}", data);
         } else if (addr_fn == IND) {
-            const uint8_t lo = CPU_read(addr++);
-            const uint8_t hi = CPU_read(addr++);
+            const uint8_t lo = BUS_peek(m, addr++);
+            const uint8_t hi = BUS_peek(m, addr++);
             const uint16_t abs = (hi << 8) | lo;
             snprintf(operand_str, operand_len, "($%04X) {IND}", abs);
+        } else if (addr_fn == IAX) {
+            const uint8_t lo = BUS_peek(m, addr++);
+            const uint8_t hi = BUS_peek(m, addr++);
+            const uint16_t abs = (hi << 8) | lo;
+            snprintf(operand_str, operand_len, "($%04X,X) {IAX}", abs);
+        } else if (addr_fn == ZPI) {
+            const uint8_t data = BUS_peek(m, addr++);
+            snprintf(operand_str, operand_len, "($%02X) {ZPI}", data);
         } else if (addr_fn == IZX) {
-            const uint8_t data = CPU_read(addr++);
+            const uint8_t data = BUS_peek(m, addr++);
             snprintf(operand_str, operand_len, "($%02X),X {IZX}", data);
         } else if (addr_fn == IZY) {
-            const uint8_t data = CPU_read(addr++);
+            const uint8_t data = BUS_peek(m, addr++);
             snprintf(operand_str, operand_len, "($%02X),Y {IZY}", data);
         }
 
@@ -94,19 +101,44 @@ void Disassembler_parse_section(const uint16_t start, const uint16_t end) {
         n_instructions++;
     }
 
-    code = (SourceCode){lines, n_instructions};
+    Disassembler_free(m);
+    m->code = (SourceCode){lines, n_instructions};
     log_info("Binary disassembled");
 }
 
-SourceCode *Disassembler_get_code() {
-    return &code;
+SourceCode *Disassembler_get_code(Machine *const m) {
+    return &m->code;
 }
 
-char *Disassembler_get_line_at(const uint16_t address) {
-    for (int i = 0; i < code.n_lines; i++) {
-        if (code.lines[i].address == address) {
-            return code.lines[i].line;
+int32_t Disassembler_find_line(const Machine *const m, const uint16_t address) {
+    // Lines are produced in address order, so binary search for the last one starting at or before address
+    int32_t lo = 0;
+    int32_t hi = (int32_t) m->code.n_lines - 1;
+    int32_t found = -1;
+    while (lo <= hi) {
+        const int32_t mid = lo + (hi - lo) / 2;
+        if (m->code.lines[mid].address <= address) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
         }
     }
-    return "NOT_FOUND";
+    return found;
+}
+
+char *Disassembler_get_line_at(const Machine *const m, const uint16_t address) {
+    const int32_t index = Disassembler_find_line(m, address);
+    if (index < 0 || m->code.lines[index].address != address) {
+        return "NOT_FOUND";
+    }
+    return m->code.lines[index].line;
+}
+
+void Disassembler_free(Machine *const m) {
+    for (int i = 0; i < m->code.n_lines; i++) {
+        free(m->code.lines[i].line);
+    }
+    free(m->code.lines);
+    m->code = (SourceCode){NULL, 0};
 }
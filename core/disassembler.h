@@ -18,9 +18,16 @@ typedef struct SourceCode {
     uint16_t n_lines;
 } SourceCode;
 
-void Disassembler_parse_rom(const ROM *rom);
-void Disassembler_parse_section(uint16_t start, uint16_t end);
-char *Disassembler_get_line_at(uint16_t address);
-SourceCode *Disassembler_get_code();
+typedef struct Machine Machine;
+
+void Disassembler_parse_rom(Machine *m, const ROM *rom);
+// Reads through BUS_peek, devices and the memory map do not see it
+void Disassembler_parse_section(Machine *m, uint16_t start, uint16_t end);
+// Index of the line holding `address` (the last one starting at or before it), -1 if there is none
+int32_t Disassembler_find_line(const Machine *m, uint16_t address);
+char *Disassembler_get_line_at(const Machine *m, uint16_t address);
+SourceCode *Disassembler_get_code(Machine *m);
+// Release the lines of the last parse (done automatically when parsing again)
+void Disassembler_free(Machine *m);
 
 #endif //INC_6502_EMULATOR_DISASSEMBLER_H
\ No newline at end of file
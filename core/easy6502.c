@@ -0,0 +1,135 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "easy6502.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bus.h"
+#include "dbg.h"
+#include "machine.h"
+
+#define DEFAULT_SEED 0x6502A11Eu
+
+static uint32_t next_random(Easy6502 *e) {
+    uint32_t x = e->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    e->random = x;
+    return x;
+}
+
+// The queued key a read of $FF would take next, -1 if there is none
+static int front_key(const Easy6502 *e) {
+    const unsigned head = atomic_load_explicit(&e->head, memory_order_relaxed);
+    const unsigned tail = atomic_load_explicit(&e->tail, memory_order_acquire);
+    return head == tail ? -1 : e->keys[head & (EASY6502_KEY_QUEUE_SIZE - 1)];
+}
+
+static uint8_t easy6502_peek(const Machine *m, const void *ctx, const uint16_t addr) {
+    const int key = addr == EASY6502_KEY ? front_key(ctx) : -1;
+    return key < 0 ? m->ram[addr] : key;
+}
+
+static uint8_t easy6502_read(Machine *m, void *ctx, const uint16_t addr) {
+    Easy6502 *e = ctx;
+    if (addr == EASY6502_RANDOM) {
+        // Not a write the program made, so it does not mark page 0 dirty on every poll
+        m->ram[addr] = next_random(e) & 0xFF;
+    } else {
+        const int key = front_key(e);
+        if (key >= 0) {
+            atomic_fetch_add_explicit(&e->head, 1, memory_order_release);
+            BUS_write_ram(m, addr, key);
+        }
+    }
+    return m->ram[addr];
+}
+
+static void easy6502_write(Machine *m, void *ctx, const uint16_t addr, const uint8_t data) {
+    BUS_write_ram(m, addr, data);
+}
+
+static void easy6502_reset(Machine *m, void *ctx) {
+    Easy6502 *e = ctx;
+    // Keys pressed before the reset are not for the program that starts now
+    atomic_store_explicit(&e->head, atomic_load_explicit(&e->tail, memory_order_acquire), memory_order_release);
+}
+
+static void easy6502_destroy(Machine *m, void *ctx) {
+    free(ctx);
+}
+
+// Only the generator, queued keys were pressed for whatever runs now
+static size_t easy6502_save(const Machine *m, const void *ctx, uint8_t *out) {
+    const Easy6502 *e = ctx;
+    if (out) {
+        memcpy(out, &e->random, sizeof(e->random));
+    }
+    return sizeof(e->random);
+}
+
+static bool easy6502_load(Machine *m, void *ctx, const uint8_t *data, const size_t size) {
+    Easy6502 *e = ctx;
+    if (!data) {
+        Easy6502_seed(e, 0);
+        return true;
+    }
+    if (size != sizeof(e->random)) {
+        return false;
+    }
+    uint32_t random;
+    memcpy(&random, data, sizeof(random));
+    Easy6502_seed(e, random);
+    return true;
+}
+
+Easy6502 *Easy6502_attach(Machine *m) {
+    check_return(!Easy6502_get(m), "Machine already has the easy6502 ports", NULL);
+
+    Easy6502 *e = calloc(1, sizeof(Easy6502));
+    check_mem_return(e, NULL);
+    Easy6502_seed(e, 0);
+
+    const Device device = {
+        .name = EASY6502_DEVICE_NAME,
+        .start = EASY6502_RANDOM,
+        .end = EASY6502_KEY,
+        .ctx = e,
+        .read = easy6502_read,
+        .peek = easy6502_peek,
+        .write = easy6502_write,
+        .reset = easy6502_reset,
+        .destroy = easy6502_destroy,
+        .save = easy6502_save,
+        .load = easy6502_load,
+    };
+    if (!BUS_map_device(m, &device)) {
+        free(e);
+        return NULL;
+    }
+    return e;
+}
+
+Easy6502 *Easy6502_get(const Machine *m) {
+    const Device *d = BUS_find_device(m, EASY6502_DEVICE_NAME);
+    return d ? d->ctx : NULL;
+}
+
+void Easy6502_seed(Easy6502 *e, const uint32_t seed) {
+    e->random = seed ? seed : DEFAULT_SEED;
+}
+
+bool Easy6502_push_key(Easy6502 *e, const uint8_t key) {
+    const unsigned tail = atomic_load_explicit(&e->tail, memory_order_relaxed);
+    const unsigned head = atomic_load_explicit(&e->head, memory_order_acquire);
+    if (tail - head == EASY6502_KEY_QUEUE_SIZE) {
+        return false;
+    }
+    e->keys[tail & (EASY6502_KEY_QUEUE_SIZE - 1)] = key;
+    atomic_store_explicit(&e->tail, tail + 1, memory_order_release);
+    return true;
+}
@@ -0,0 +1,61 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_EASY6502_H
+#define INC_6502_EMULATOR_EASY6502_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Machine Machine;
+
+#define EASY6502_DEVICE_NAME "easy6502"
+// A new random byte on every read
+#define EASY6502_RANDOM 0x00FE
+// The last key pressed
+#define EASY6502_KEY 0x00FF
+// Keys that can be waiting for the program, a power of two
+#define EASY6502_KEY_QUEUE_SIZE 64
+
+/*
+ * The two zero page ports of the easy6502 convention. Both live in the RAM underneath, so memory
+ * views show them like any other byte and the program can overwrite them (e.g. clear $FF once it
+ * has handled a key).
+ *
+ * Reading $FE steps a xorshift32 generator and returns its low byte. The generator starts from a
+ * fixed seed, so runs are reproducible unless Easy6502_seed says otherwise.
+ *
+ * Keys go through a single producer, single consumer queue: Easy6502_push_key may be called from
+ * any one thread at any time, also while the machine runs on another one, without taking a lock.
+ * A read of $FF moves the next queued key (if any) into $FF first, so the program sees a key the
+ * next time it polls for one rather than after the current batch.
+ */
+typedef struct Easy6502 {
+    uint32_t random;
+    uint8_t keys[EASY6502_KEY_QUEUE_SIZE];
+    // Only the pushing thread moves tail, only the machine moves head
+    atomic_uint head;
+    atomic_uint tail;
+} Easy6502;
+
+/**
+ * Map the ports at $FE-$FF, a machine has at most one set.
+ * @return the ports, owned by the machine until its devices are unmapped, or NULL on failure
+ */
+Easy6502 *Easy6502_attach(Machine *m);
+
+// The machine's ports, NULL if none are mapped
+Easy6502 *Easy6502_get(const Machine *m);
+
+// Restart the random numbers from `seed` (0 is replaced by the default seed)
+void Easy6502_seed(Easy6502 *e, uint32_t seed);
+
+/**
+ * Queue a key (ASCII code) for the program, safe to call while the machine runs.
+ * @return false if the queue is full
+ */
+bool Easy6502_push_key(Easy6502 *e, uint8_t key);
+
+#endif //INC_6502_EMULATOR_EASY6502_H
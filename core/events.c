@@ -0,0 +1,85 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "events.h"
+
+#include "machine.h"
+
+static void update_next_cycle(Machine *m) {
+    Events *ev = &m->events;
+    if (ev->irq_lines) {
+        ev->next_cycle = 0;
+    } else {
+        ev->next_cycle = ev->head ? ev->head->cycle : UINT64_MAX;
+    }
+}
+
+static void unlink_event(Events *ev, Event *e) {
+    for (Event **link = &ev->head; *link; link = &(*link)->next) {
+        if (*link == e) {
+            *link = e->next;
+            break;
+        }
+    }
+    e->next = NULL;
+    e->scheduled = false;
+}
+
+void Events_reset(Machine *m) {
+    Events *ev = &m->events;
+    while (ev->head) {
+        unlink_event(ev, ev->head);
+    }
+    ev->irq_lines = 0;
+    update_next_cycle(m);
+}
+
+void Events_schedule(Machine *m, Event *e, const uint64_t cycle) {
+    Events *ev = &m->events;
+    if (e->scheduled) {
+        unlink_event(ev, e);
+    }
+    e->cycle = cycle;
+    e->scheduled = true;
+
+    // Events due at the same cycle fire in the order they were scheduled
+    Event **link = &ev->head;
+    while (*link && (*link)->cycle <= cycle) {
+        link = &(*link)->next;
+    }
+    e->next = *link;
+    *link = e;
+    update_next_cycle(m);
+}
+
+void Events_cancel(Machine *m, Event *e) {
+    if (e->scheduled) {
+        unlink_event(&m->events, e);
+        update_next_cycle(m);
+    }
+}
+
+void Events_set_irq(Machine *m, const EventsIrqSource source, const bool asserted) {
+    if (asserted) {
+        m->events.irq_lines |= source;
+    } else {
+        m->events.irq_lines &= ~source;
+    }
+    update_next_cycle(m);
+}
+
+void Events_dispatch(Machine *m) {
+    Events *ev = &m->events;
+    while (ev->head && ev->head->cycle <= m->cpu.cycle_count) {
+        Event *e = ev->head;
+        unlink_event(ev, e);
+        // May schedule itself again, e.g. a free running timer
+        e->fire(m, e);
+    }
+    update_next_cycle(m);
+
+    if (ev->irq_lines) {
+        CPU_irq(m);
+    }
+}
@@ -0,0 +1,63 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_EVENTS_H
+#define INC_6502_EMULATOR_EVENTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Machine Machine;
+typedef struct Event Event;
+
+typedef void (*event_fn)(Machine *m, Event *e);
+
+/*
+ * Something a device wants to happen at a future cycle (e.g. a timer running out). Devices own
+ * their events, usually embedded in their state, the scheduler only links them into its list.
+ */
+struct Event {
+    // Absolute cycle (see CPU_get_cycle_count) the event is due at
+    uint64_t cycle;
+    event_fn fire;
+    void *ctx;
+    Event *next;
+    bool scheduled;
+};
+
+/*
+ * Pending events sorted by cycle, plus the IRQ line. Devices never tick: the run loops compare
+ * the cycle count to next_cycle before each instruction and only call Events_dispatch once
+ * something is due, so idle devices cost one comparison per instruction.
+ *
+ * The IRQ line is level triggered like on the real bus: it is the OR of every source that
+ * asserts it, and an interrupt is taken at each instruction boundary it is asserted at with I
+ * clear. While asserted next_cycle stays 0 so the boundaries are looked at.
+ */
+typedef struct Events {
+    Event *head;
+    uint64_t next_cycle;
+    // One bit per EventsIrqSource
+    uint8_t irq_lines;
+} Events;
+
+typedef enum EventsIrqSource {
+    EVENTS_IRQ_VIA = 1 << 0,
+    EVENTS_IRQ_ACIA = 1 << 1,
+} EventsIrqSource;
+
+// Drop every pending event and release the IRQ line
+void Events_reset(Machine *m);
+
+// Schedule `e` at `cycle`, moving it if it was already scheduled
+void Events_schedule(Machine *m, Event *e, uint64_t cycle);
+
+void Events_cancel(Machine *m, Event *e);
+
+void Events_set_irq(Machine *m, EventsIrqSource source, bool asserted);
+
+// Fire the events that are due and take an interrupt if the IRQ line asks for one
+void Events_dispatch(Machine *m);
+
+#endif //INC_6502_EMULATOR_EVENTS_H
@@ -0,0 +1,134 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "framebuffer.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "bus.h"
+#include "dbg.h"
+#include "machine.h"
+
+// The easy6502 colours
+const uint32_t FRAMEBUFFER_PALETTE[FRAMEBUFFER_PALETTE_SIZE] = {
+    0x000000, 0xFFFFFF, 0x880000, 0xAAFFEE, 0xCC44CC, 0x00CC55, 0x0000AA, 0xEEEE77,
+    0xDD8855, 0x664400, 0xFF7777, 0x333333, 0x777777, 0xAAFF66, 0x0088FF, 0xBBBBBB,
+};
+
+static void mark_dirty(Framebuffer *fb, const uint8_t x, const uint8_t y) {
+    const uint32_t row = 1u << y;
+    if (!(fb->dirty_rows & row)) {
+        fb->dirty_rows |= row;
+        fb->dirty_from[y] = x;
+        fb->dirty_to[y] = x;
+    } else if (x < fb->dirty_from[y]) {
+        fb->dirty_from[y] = x;
+    } else if (x > fb->dirty_to[y]) {
+        fb->dirty_to[y] = x;
+    }
+}
+
+static uint8_t framebuffer_peek(const Machine *m, const void *ctx, const uint16_t addr) {
+    return m->ram[addr];
+}
+
+static uint8_t framebuffer_read(Machine *m, void *ctx, const uint16_t addr) {
+    return m->ram[addr];
+}
+
+static void framebuffer_write(Machine *m, void *ctx, const uint16_t addr, const uint8_t data) {
+    Framebuffer *fb = ctx;
+    const uint8_t old = m->ram[addr];
+    // Still RAM as far as everybody else is concerned
+    BUS_write_ram(m, addr, data);
+    if ((old ^ data) & (FRAMEBUFFER_PALETTE_SIZE - 1)) {
+        const uint16_t pixel = addr - fb->base;
+        mark_dirty(fb, pixel % FRAMEBUFFER_WIDTH, pixel / FRAMEBUFFER_WIDTH);
+    }
+}
+
+static void framebuffer_reset(Machine *m, void *ctx) {
+    Framebuffer_invalidate(ctx);
+}
+
+static void framebuffer_destroy(Machine *m, void *ctx) {
+    free(ctx);
+}
+
+// The pixels are in RAM, but the display has to be redrawn from them
+static bool framebuffer_load(Machine *m, void *ctx, const uint8_t *data, const size_t size) {
+    Framebuffer_invalidate(ctx);
+    return true;
+}
+
+Framebuffer *Framebuffer_attach(Machine *m, const uint16_t base) {
+    check_return(!Framebuffer_get(m), "Machine already has a framebuffer", NULL);
+    check_return(base <= 0xFFFF - (FRAMEBUFFER_SIZE - 1), "Framebuffer does not fit at %04X", NULL, base);
+
+    Framebuffer *fb = calloc(1, sizeof(Framebuffer));
+    check_mem_return(fb, NULL);
+    fb->base = base;
+
+    const Device device = {
+        .name = FRAMEBUFFER_DEVICE_NAME,
+        .start = base,
+        .end = base + FRAMEBUFFER_SIZE - 1,
+        .ctx = fb,
+        .read = framebuffer_read,
+        .peek = framebuffer_peek,
+        .write = framebuffer_write,
+        .reset = framebuffer_reset,
+        .destroy = framebuffer_destroy,
+        .load = framebuffer_load,
+    };
+    if (!BUS_map_device(m, &device)) {
+        free(fb);
+        return NULL;
+    }
+    return fb;
+}
+
+Framebuffer *Framebuffer_get(const Machine *m) {
+    const Device *d = BUS_find_device(m, FRAMEBUFFER_DEVICE_NAME);
+    return d ? d->ctx : NULL;
+}
+
+void Framebuffer_invalidate(Framebuffer *fb) {
+    fb->dirty_rows = 0xFFFFFFFF;
+    for (int y = 0; y < FRAMEBUFFER_HEIGHT; y++) {
+        fb->dirty_from[y] = 0;
+        fb->dirty_to[y] = FRAMEBUFFER_WIDTH - 1;
+    }
+}
+
+size_t Framebuffer_take_dirty(Framebuffer *fb, FramebufferRect *rects) {
+    size_t n = 0;
+    bool open = false;
+    uint8_t from = 0;
+    uint8_t to = 0;
+    for (uint8_t y = 0; y < FRAMEBUFFER_HEIGHT; y++) {
+        if (!(fb->dirty_rows & (1u << y))) {
+            open = false;
+            continue;
+        }
+        const uint8_t row_from = fb->dirty_from[y];
+        const uint8_t row_to = fb->dirty_to[y];
+        if (open && row_from <= to && row_to >= from) {
+            // Grow the rectangle of the rows above
+            from = row_from < from ? row_from : from;
+            to = row_to > to ? row_to : to;
+            rects[n - 1].x = from;
+            rects[n - 1].width = to - from + 1;
+            rects[n - 1].height++;
+            continue;
+        }
+        open = true;
+        from = row_from;
+        to = row_to;
+        rects[n++] = (FramebufferRect){.x = from, .y = y, .width = to - from + 1, .height = 1};
+    }
+    fb->dirty_rows = 0;
+    return n;
+}
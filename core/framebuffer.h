@@ -0,0 +1,67 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_FRAMEBUFFER_H
+#define INC_6502_EMULATOR_FRAMEBUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Machine Machine;
+
+#define FRAMEBUFFER_DEVICE_NAME "framebuffer"
+// Where the easy6502 examples draw (e.g. STA $0200)
+#define FRAMEBUFFER_DEFAULT_BASE 0x0200
+#define FRAMEBUFFER_WIDTH 32
+#define FRAMEBUFFER_HEIGHT 32
+#define FRAMEBUFFER_SIZE (FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT)
+#define FRAMEBUFFER_PALETTE_SIZE 16
+
+// The low nibble of a pixel picks its colour, 0xRRGGBB
+extern const uint32_t FRAMEBUFFER_PALETTE[FRAMEBUFFER_PALETTE_SIZE];
+
+typedef struct FramebufferRect {
+    uint8_t x;
+    uint8_t y;
+    uint8_t width;
+    uint8_t height;
+} FramebufferRect;
+
+/*
+ * 32x32 pixel display, one byte per pixel row by row from the base address. The pixels are plain
+ * RAM, programs read them back and memory views see them like any other page. Writes that change
+ * the colour of a pixel widen the dirty span of its row, Framebuffer_take_dirty turns those spans
+ * into rectangles so a display only redraws what changed since it last asked.
+ *
+ * RAM changed behind the bus (BUS_init, restoring a snapshot) is not seen, Framebuffer_invalidate
+ * after that. CPU_reset does it already.
+ */
+typedef struct Framebuffer {
+    uint16_t base;
+    // One bit per row with anything in its span
+    uint32_t dirty_rows;
+    uint8_t dirty_from[FRAMEBUFFER_HEIGHT];
+    uint8_t dirty_to[FRAMEBUFFER_HEIGHT];
+} Framebuffer;
+
+/**
+ * Map a framebuffer at base..base+3FF, a machine has at most one.
+ * @return the framebuffer, owned by the machine until its devices are unmapped, or NULL on failure
+ */
+Framebuffer *Framebuffer_attach(Machine *m, uint16_t base);
+
+// The machine's framebuffer, NULL if none is mapped
+Framebuffer *Framebuffer_get(const Machine *m);
+
+// Mark the whole screen dirty
+void Framebuffer_invalidate(Framebuffer *fb);
+
+/**
+ * Move the dirty area into at most FRAMEBUFFER_HEIGHT rectangles and clear it. Consecutive rows
+ * whose spans overlap share a rectangle.
+ * @return the number of rectangles written to `rects`
+ */
+size_t Framebuffer_take_dirty(Framebuffer *fb, FramebufferRect *rects);
+
+#endif //INC_6502_EMULATOR_FRAMEBUFFER_H
@@ -0,0 +1,171 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+/*
+ * Headless conformance and throughput gate. Runs a functional test image (e.g. Klaus Dormann's
+ * 6502_functional_test.bin, which is not shipped here) until it traps, i.e. an instruction leaves
+ * pc where it was (JMP * or a branch to itself). Passing means trapping at the success address.
+ *
+ * usage: 6502_functional_test ROM --success ADDR [--start ADDR] [--max-cycles N]
+ *                             [--baseline FILE] [--tolerance PERCENT] [--update-baseline]
+ *
+ * Addresses are hex. --start overrides the reset vector (the Klaus image starts at 0400).
+ * --baseline holds the emulated MHz of a previous run, the test fails when this run is more than
+ * --tolerance percent (default 10) slower. A missing baseline file is created from this run,
+ * --update-baseline always rewrites it. Only compare optimized builds against each other.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bus.h"
+#include "cpu.h"
+#include "dbg.h"
+#include "machine.h"
+#include "rom.h"
+
+#define NO_ADDRESS (-1)
+// Cycles run between two checks for a trap
+#define TRAP_CHECK_CYCLES 100000
+#define DEFAULT_MAX_CYCLES 1000000000ULL
+#define DEFAULT_TOLERANCE 10.0
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static int32_t parse_address(const char *str) {
+    char *end = NULL;
+    const unsigned long address = strtoul(str, &end, 16);
+    return *str && !*end && address <= 0xFFFF ? (int32_t) address : NO_ADDRESS;
+}
+
+// Whether the instruction at pc jumps to itself, runs it once to find out
+static bool is_trapped(Machine *m) {
+    const uint16_t pc = CPU_get_pc(m);
+    CPU_step_n(m, 1);
+    return CPU_get_pc(m) == pc;
+}
+
+static bool read_baseline(const char *path, double *mhz) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    const bool read = fscanf(file, "%lf", mhz) == 1;
+    fclose(file);
+    return read;
+}
+
+static void write_baseline(const char *path, const double mhz) {
+    FILE *file = fopen(path, "w");
+    check(file, "Could not write baseline %s", return, path);
+    fprintf(file, "%.2f\n", mhz);
+    fclose(file);
+    printf("Baseline %s set to %.2f MHz\n", path, mhz);
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s ROM --success ADDR [--start ADDR] [--max-cycles N] [--baseline FILE] "
+            "[--tolerance PERCENT] [--update-baseline]\n", program);
+}
+
+int main(const int argc, char *argv[]) {
+    const char *rom_path = NULL;
+    const char *baseline_path = NULL;
+    int32_t success = NO_ADDRESS;
+    int32_t start = NO_ADDRESS;
+    uint64_t max_cycles = DEFAULT_MAX_CYCLES;
+    double tolerance = DEFAULT_TOLERANCE;
+    bool update_baseline = false;
+
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--success") == 0 && has_value) {
+            success = parse_address(argv[++i]);
+        } else if (strcmp(argv[i], "--start") == 0 && has_value) {
+            start = parse_address(argv[++i]);
+        } else if (strcmp(argv[i], "--max-cycles") == 0 && has_value) {
+            max_cycles = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--baseline") == 0 && has_value) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && has_value) {
+            tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--update-baseline") == 0) {
+            update_baseline = true;
+        } else if (!rom_path && argv[i][0] != '-') {
+            rom_path = argv[i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!rom_path || success == NO_ADDRESS) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ROM rom = {0};
+    ROM_from_file(&rom, rom_path);
+    check_return(rom.data, "Could not load %s", EXIT_FAILURE, rom_path);
+
+    CPU_load_instructions();
+    Machine *m = Machine_create();
+    check_mem(m, {
+        free(rom.data);
+        free(rom.file);
+        return EXIT_FAILURE;
+    });
+    BUS_load_ROM(m, &rom);
+    free(rom.data);
+    free(rom.file);
+    CPU_reset(m);
+    if (start != NO_ADDRESS) {
+        m->cpu.pc = start;
+    }
+
+    const uint64_t start_cycles = CPU_get_cycle_count(m);
+    const double start_time = now_seconds();
+    uint64_t cycles = 0;
+    bool trapped = false;
+    while (!trapped && cycles < max_cycles) {
+        CPU_run(m, TRAP_CHECK_CYCLES);
+        trapped = is_trapped(m);
+        cycles = CPU_get_cycle_count(m) - start_cycles;
+    }
+    const double seconds = now_seconds() - start_time;
+    const double mhz = (double) cycles / seconds / 1e6;
+    const uint16_t pc = CPU_get_pc(m);
+    Machine_destroy(m);
+
+    printf("%s: %llu cycles in %.3f s, %.2f MHz\n", rom_path, (unsigned long long) cycles, seconds, mhz);
+    if (!trapped) {
+        printf("FAIL: no trap within %llu cycles, pc at %04X\n", (unsigned long long) max_cycles, pc);
+        return EXIT_FAILURE;
+    }
+    if (pc != success) {
+        printf("FAIL: trapped at %04X, success is %04X\n", pc, success);
+        return EXIT_FAILURE;
+    }
+    printf("PASS: trapped at %04X\n", pc);
+
+    if (baseline_path) {
+        double baseline = 0;
+        if (update_baseline || !read_baseline(baseline_path, &baseline)) {
+            write_baseline(baseline_path, mhz);
+        } else if (mhz < baseline * (1.0 - tolerance / 100.0)) {
+            printf("FAIL: %.2f MHz is more than %.0f%% below the baseline of %.2f MHz\n", mhz, tolerance, baseline);
+            return EXIT_FAILURE;
+        } else {
+            printf("Throughput %.2f MHz, baseline %.2f MHz\n", mhz, baseline);
+        }
+    }
+    return EXIT_SUCCESS;
+}
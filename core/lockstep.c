@@ -0,0 +1,375 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+/*
+ * Differential checker, runs the same image on a reference and a candidate core side by side and
+ * stops at the first instruction after which they disagree, dumping the instructions leading up to
+ * it. Registers and the total cycle count are compared after every instruction, memory every
+ * --ram-interval instructions. When only memory differs both machines go back to the last
+ * comparison that matched and replay from there comparing memory after every instruction, so the
+ * instruction reported is the one that wrote the difference.
+ *
+ * With --interval N (fast mode) the cores run N instructions at a time and registers and memory are
+ * only compared at those boundaries. On a mismatch both machines go back to the last boundary
+ * that matched and the block is replayed one instruction at a time to pinpoint it.
+ *
+ * usage: 6502_lockstep ROM [--reference CORE] [--candidate CORE] [--start ADDR]
+ *                      [--instructions N] [--interval N] [--ram-interval N]
+ *                      [--fault-at N] [--expect-divergence N]
+ *
+ * A core is one way of driving the interpreter in cpu.c, new cores register themselves in `cores`.
+ * The corrupt-flag and corrupt-ram cores are the step core with a bug planted after instruction
+ * --fault-at, with --expect-divergence N the exit status tells whether the divergence was reported
+ * after exactly N instructions. That is how ctest checks the checker itself.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bus.h"
+#include "cpu.h"
+#include "dbg.h"
+#include "machine.h"
+#include "rom.h"
+#include "trace.h"
+
+#define NO_ADDRESS (-1)
+#define HISTORY_SIZE 16
+#define DEFAULT_INSTRUCTIONS 100000000ULL
+#define DEFAULT_RAM_INTERVAL 4096
+#define DEFAULT_FAULT_AT 10000
+// Flipped by corrupt-ram, an address the example roms leave alone
+#define FAULT_ADDRESS 0x8000
+
+typedef struct Core {
+    const char *name;
+    // Execute exactly `n` instructions, `executed` have been executed before
+    void (*run)(Machine *m, uint64_t executed, uint32_t n);
+} Core;
+
+typedef struct Snapshot {
+    CPU cpu;
+    uint8_t ram[RAM_SIZE];
+} Snapshot;
+
+typedef struct Lockstep {
+    Machine *reference;
+    Machine *candidate;
+    const Core *reference_core;
+    const Core *candidate_core;
+    uint64_t executed;
+    // Pcs of the last instructions the reference executed, oldest first once wrapped
+    uint16_t history[HISTORY_SIZE];
+    uint32_t n_history;
+} Lockstep;
+
+// Where both machines were when they last matched, registers and memory
+typedef struct Checkpoint {
+    Snapshot reference;
+    Snapshot candidate;
+    uint64_t executed;
+    uint32_t n_history;
+} Checkpoint;
+
+// Instruction after which the corrupt-* cores go wrong
+static uint64_t fault_at = DEFAULT_FAULT_AT;
+
+// The function pointer interpreter, one instruction per call to CPU_tick
+static void run_step(Machine *m, const uint64_t executed, const uint32_t n) {
+    CPU_step_n(m, n);
+}
+
+// Cycle by cycle like a clocked bus would drive it
+static void run_tick(Machine *m, const uint64_t executed, const uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        // Finish whatever is in flight (e.g. the reset sequence), then one whole instruction
+        while (m->cpu.cycles > 0) {
+            CPU_tick(m);
+        }
+        do {
+            CPU_tick(m);
+        } while (m->cpu.cycles > 0);
+    }
+}
+
+static void corrupt_flag(Machine *m) {
+    m->cpu.status ^= FLAG_C;
+}
+
+static void corrupt_ram(Machine *m) {
+    m->ram[FAULT_ADDRESS] ^= 0xFF;
+}
+
+// The step core, with `fault` applied right after instruction `fault_at`
+static void run_faulty(Machine *m, const uint64_t executed, const uint32_t n, void (*fault)(Machine *m)) {
+    if (executed >= fault_at || executed + n < fault_at) {
+        CPU_step_n(m, n);
+        return;
+    }
+    CPU_step_n(m, fault_at - executed);
+    fault(m);
+    CPU_step_n(m, executed + n - fault_at);
+}
+
+static void run_corrupt_flag(Machine *m, const uint64_t executed, const uint32_t n) {
+    run_faulty(m, executed, n, corrupt_flag);
+}
+
+static void run_corrupt_ram(Machine *m, const uint64_t executed, const uint32_t n) {
+    run_faulty(m, executed, n, corrupt_ram);
+}
+
+static const Core cores[] = {
+    {"step", run_step},
+    {"tick", run_tick},
+    {"corrupt-flag", run_corrupt_flag},
+    {"corrupt-ram", run_corrupt_ram},
+};
+
+static const Core *find_core(const char *name) {
+    for (size_t i = 0; i < sizeof(cores) / sizeof(cores[0]); i++) {
+        if (strcmp(cores[i].name, name) == 0) {
+            return &cores[i];
+        }
+    }
+    return NULL;
+}
+
+// Cores may leave the cycles of the last instruction pending, count those as spent
+static uint64_t total_cycles(const Machine *m) {
+    return m->cpu.cycle_count + m->cpu.cycles;
+}
+
+static bool registers_match(const Machine *a, const Machine *b) {
+    const CPU *x = &a->cpu;
+    const CPU *y = &b->cpu;
+    return x->pc == y->pc && x->a == y->a && x->x == y->x && x->y == y->y && x->sp == y->sp &&
+           x->status == y->status && total_cycles(a) == total_cycles(b);
+}
+
+static bool ram_matches(const Machine *a, const Machine *b) {
+    return memcmp(a->ram, b->ram, RAM_SIZE) == 0;
+}
+
+static void take_snapshot(const Machine *m, Snapshot *snapshot) {
+    snapshot->cpu = m->cpu;
+    memcpy(snapshot->ram, m->ram, RAM_SIZE);
+}
+
+static void restore_snapshot(Machine *m, const Snapshot *snapshot) {
+    m->cpu = snapshot->cpu;
+    memcpy(m->ram, snapshot->ram, RAM_SIZE);
+}
+
+static void take_checkpoint(const Lockstep *l, Checkpoint *checkpoint) {
+    take_snapshot(l->reference, &checkpoint->reference);
+    take_snapshot(l->candidate, &checkpoint->candidate);
+    checkpoint->executed = l->executed;
+    checkpoint->n_history = l->n_history;
+}
+
+static void print_registers(const char *label, const Machine *m) {
+    const CPU *c = &m->cpu;
+    printf("  %-10s PC:%04X A:%02X X:%02X Y:%02X SP:%02X P:%02X cycles:%llu\n", label, c->pc, c->a, c->x,
+           c->y, c->sp, c->status, (unsigned long long) total_cycles(m));
+}
+
+static void print_instruction(const Machine *m, const uint16_t pc, const char *marker) {
+    const uint8_t opcode = m->ram[pc];
+    const uint8_t n_operands = Trace_operand_count(opcode);
+    printf("  %-4s %04X  %02X", marker, pc, opcode);
+    for (uint8_t i = 0; i < 2; i++) {
+        if (i < n_operands) {
+            printf(" %02X", m->ram[(uint16_t) (pc + 1 + i)]);
+        } else {
+            printf("   ");
+        }
+    }
+    printf("  %s\n", CPU_get_instruction(opcode)->name);
+}
+
+static void dump_divergence(Lockstep *l) {
+    printf("Divergence after %llu instructions\n", (unsigned long long) l->executed);
+    print_registers(l->reference_core->name, l->reference);
+    print_registers(l->candidate_core->name, l->candidate);
+    for (uint32_t address = 0; address < RAM_SIZE; address++) {
+        if (l->reference->ram[address] != l->candidate->ram[address]) {
+            printf("  first memory difference at %04X: %02X vs %02X\n", address, l->reference->ram[address],
+                   l->candidate->ram[address]);
+            break;
+        }
+    }
+
+    printf("Last instructions (reference):\n");
+    const uint32_t n = l->n_history < HISTORY_SIZE ? l->n_history : HISTORY_SIZE;
+    for (uint32_t i = l->n_history - n; i < l->n_history; i++) {
+        print_instruction(l->reference, l->history[i % HISTORY_SIZE], i + 1 == l->n_history ? ">" : "");
+    }
+    printf("Next instruction:\n");
+    print_instruction(l->reference, l->reference->cpu.pc, "ref");
+    print_instruction(l->candidate, l->candidate->cpu.pc, "cand");
+}
+
+// One instruction on both cores, false at a divergence
+static bool step_both(Lockstep *l, const bool compare_ram) {
+    l->history[l->n_history++ % HISTORY_SIZE] = l->reference->cpu.pc;
+    l->reference_core->run(l->reference, l->executed, 1);
+    l->candidate_core->run(l->candidate, l->executed, 1);
+    l->executed++;
+    return registers_match(l->reference, l->candidate) && (!compare_ram || ram_matches(l->reference, l->candidate));
+}
+
+/*
+ * Back to `checkpoint` and up to `end` again one instruction at a time, registers and memory
+ * compared after each, to find the instruction that diverged. Always false, the machines are known
+ * to disagree at `end`.
+ */
+static bool replay(Lockstep *l, const Checkpoint *checkpoint, const uint64_t end) {
+    restore_snapshot(l->reference, &checkpoint->reference);
+    restore_snapshot(l->candidate, &checkpoint->candidate);
+    l->executed = checkpoint->executed;
+    l->n_history = checkpoint->n_history;
+    while (l->executed < end) {
+        if (!step_both(l, true)) {
+            return false;
+        }
+    }
+    log_warn("Instructions %llu to %llu diverged but their replay did not, the cores disagree on where "
+             "they stop", (unsigned long long) checkpoint->executed, (unsigned long long) end);
+    return false;
+}
+
+static bool run_lockstep(Lockstep *l, const uint64_t instructions, const uint32_t ram_interval) {
+    static Checkpoint checkpoint;
+    while (l->executed < instructions) {
+        take_checkpoint(l, &checkpoint);
+        const uint64_t end = instructions - l->executed < ram_interval ? instructions : l->executed + ram_interval;
+        while (l->executed < end) {
+            if (!step_both(l, false)) {
+                return false;
+            }
+        }
+        if (!ram_matches(l->reference, l->candidate)) {
+            return replay(l, &checkpoint, end);
+        }
+    }
+    return true;
+}
+
+static bool run_blocks(Lockstep *l, const uint64_t instructions, const uint32_t interval) {
+    static Checkpoint checkpoint;
+    while (l->executed < instructions) {
+        take_checkpoint(l, &checkpoint);
+        const uint32_t n = instructions - l->executed < interval ? instructions - l->executed : interval;
+
+        l->reference_core->run(l->reference, l->executed, n);
+        l->candidate_core->run(l->candidate, l->executed, n);
+        l->executed += n;
+        if (!registers_match(l->reference, l->candidate) || !ram_matches(l->reference, l->candidate)) {
+            return replay(l, &checkpoint, l->executed);
+        }
+    }
+    return true;
+}
+
+static Machine *load_machine(const ROM *rom, const int32_t start) {
+    Machine *m = Machine_create();
+    check_mem_return(m, NULL);
+    BUS_load_ROM(m, rom);
+    CPU_reset(m);
+    if (start != NO_ADDRESS) {
+        m->cpu.pc = start;
+    }
+    return m;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s ROM [--reference CORE] [--candidate CORE] [--start ADDR] [--instructions N] "
+            "[--interval N] [--ram-interval N] [--fault-at N] [--expect-divergence N]\ncores:", program);
+    for (size_t i = 0; i < sizeof(cores) / sizeof(cores[0]); i++) {
+        fprintf(stderr, " %s", cores[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(const int argc, char *argv[]) {
+    const char *rom_path = NULL;
+    const char *reference_name = "step";
+    const char *candidate_name = "tick";
+    int32_t start = NO_ADDRESS;
+    uint64_t instructions = DEFAULT_INSTRUCTIONS;
+    uint32_t interval = 1;
+    uint32_t ram_interval = DEFAULT_RAM_INTERVAL;
+    // Only set when the run is meant to diverge
+    bool expect_divergence = false;
+    uint64_t expected = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--reference") == 0 && has_value) {
+            reference_name = argv[++i];
+        } else if (strcmp(argv[i], "--candidate") == 0 && has_value) {
+            candidate_name = argv[++i];
+        } else if (strcmp(argv[i], "--start") == 0 && has_value) {
+            start = (int32_t) (strtoul(argv[++i], NULL, 16) & 0xFFFF);
+        } else if (strcmp(argv[i], "--instructions") == 0 && has_value) {
+            instructions = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--interval") == 0 && has_value) {
+            interval = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--ram-interval") == 0 && has_value) {
+            ram_interval = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--fault-at") == 0 && has_value) {
+            fault_at = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--expect-divergence") == 0 && has_value) {
+            expect_divergence = true;
+            expected = strtoull(argv[++i], NULL, 10);
+        } else if (!rom_path && argv[i][0] != '-') {
+            rom_path = argv[i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Lockstep l = {.reference_core = find_core(reference_name), .candidate_core = find_core(candidate_name)};
+    if (!rom_path || !l.reference_core || !l.candidate_core || interval == 0 || ram_interval == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ROM rom = {0};
+    ROM_from_file(&rom, rom_path);
+    check_return(rom.data, "Could not load %s", EXIT_FAILURE, rom_path);
+    CPU_load_instructions();
+    l.reference = load_machine(&rom, start);
+    l.candidate = load_machine(&rom, start);
+    free(rom.data);
+    free(rom.file);
+    check(l.reference && l.candidate, "Could not create machines", {
+        Machine_destroy(l.reference);
+        Machine_destroy(l.candidate);
+        return EXIT_FAILURE;
+    });
+
+    const bool matched = interval == 1
+                             ? run_lockstep(&l, instructions, ram_interval)
+                             : run_blocks(&l, instructions, interval);
+    if (matched) {
+        printf("%s and %s match over %llu instructions\n", l.reference_core->name, l.candidate_core->name,
+               (unsigned long long) l.executed);
+    } else {
+        dump_divergence(&l);
+    }
+    Machine_destroy(l.reference);
+    Machine_destroy(l.candidate);
+    if (expect_divergence) {
+        check_return(!matched && l.executed == expected, "Expected a divergence after %llu instructions",
+                     EXIT_FAILURE, (unsigned long long) expected);
+        return EXIT_SUCCESS;
+    }
+    return matched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,375 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "log.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// How long the writer sleeps when nothing woke it up, warnings and errors wake it right away
+#define WRITER_POLL_NS 10000000
+#define LINE_SIZE 512
+
+typedef struct LogRecord {
+    const LogSite *site;
+    // Global order of the record, rings are merged on it
+    uint64_t sequence;
+    int n_args;
+    LogArg args[LOG_MAX_ARGS];
+    // String arguments point in here
+    char strings[LOG_MAX_STRING];
+} LogRecord;
+
+/*
+ * Single producer (the thread that owns it), single consumer (the writer) ring of records. A ring
+ * outlives its thread, when the thread exits it is marked orphaned and the writer frees it once
+ * it is drained.
+ */
+typedef struct LogRing {
+    LogRecord records[LOG_RING_RECORDS];
+    atomic_uint_fast64_t head;
+    atomic_uint_fast64_t tail;
+    atomic_bool orphaned;
+    struct LogRing *next;
+} LogRing;
+
+atomic_int Log_level = LOG_LEVEL_INFO;
+
+static const char *level_names[] = {"trace", "debug", "info", "warn", "error", "off"};
+static const char *level_tags[] = {"[TRACE]", "[DEBUG]", "[INFO]", "[WARN]", "[ERROR]", ""};
+
+// Guards the ring list, the output and the writer state
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t drained = PTHREAD_COND_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;
+static _Thread_local LogRing *thread_ring;
+static LogRing *rings;
+static pthread_t writer;
+static bool writer_running;
+static bool stopping;
+// Whether records go through the rings, read by producers without taking the lock
+static atomic_bool accepting;
+static FILE *output;
+// Flush requests made and served, see Log_flush
+static uint64_t flushes_requested;
+static uint64_t flushes_done;
+static uint64_t dropped_reported;
+static atomic_uint_fast64_t sequence;
+static atomic_uint_fast64_t dropped;
+
+static FILE *out(void) {
+    return output ? output : stderr;
+}
+
+static void append(char *line, size_t *len, const char *text, const size_t n) {
+    const size_t room = LINE_SIZE - 1 - *len;
+    const size_t copied = n < room ? n : room;
+    memcpy(line + *len, text, copied);
+    *len += copied;
+}
+
+/*
+ * Formats one conversion. The length modifier of the call site is replaced by the one matching
+ * how the argument was stored, so %x of a uint8_t and %llu of a uint64_t both print right.
+ */
+static int format_arg(char *dst, const size_t size, const char *spec, const size_t spec_len, const char conversion,
+                      const LogArg *arg) {
+    char fmt[32];
+    size_t n = 0;
+    for (size_t i = 0; i < spec_len && n < sizeof(fmt) - 4; i++) {
+        if (!strchr("hljztL", spec[i])) {
+            fmt[n++] = spec[i];
+        }
+    }
+    switch (conversion) {
+        case 'd':
+        case 'i':
+            memcpy(fmt + n, "lld", 4);
+            return snprintf(dst, size, fmt, arg->type == LOG_ARG_DOUBLE ? (long long) arg->d : (long long) arg->i);
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            fmt[n++] = 'l';
+            fmt[n++] = 'l';
+            fmt[n++] = conversion;
+            fmt[n] = '\0';
+            return snprintf(dst, size, fmt, arg->type == LOG_ARG_DOUBLE
+                                                ? (unsigned long long) arg->d
+                                                : (unsigned long long) arg->u);
+        case 'c':
+            memcpy(fmt + n, "c", 2);
+            return snprintf(dst, size, fmt, (int) arg->i);
+        case 's':
+            memcpy(fmt + n, "s", 2);
+            return snprintf(dst, size, fmt, arg->type == LOG_ARG_STRING ? arg->s : "?");
+        case 'p':
+            memcpy(fmt + n, "p", 2);
+            return snprintf(dst, size, fmt, arg->p);
+        default:
+            fmt[n++] = conversion;
+            fmt[n] = '\0';
+            return snprintf(dst, size, fmt, arg->type == LOG_ARG_DOUBLE
+                                                ? arg->d
+                                                : arg->type == LOG_ARG_INT ? (double) arg->i : (double) arg->u);
+    }
+}
+
+static void write_record(const LogSite *site, const int n_args, const LogArg *args) {
+    char line[LINE_SIZE];
+    size_t len = (size_t) snprintf(line, sizeof(line), "%s (%s:%d) ", level_tags[site->level], site->file,
+                                   site->line);
+    if (len >= sizeof(line)) {
+        len = sizeof(line) - 1;
+    }
+
+    int next_arg = 0;
+    for (const char *c = site->format; *c;) {
+        if (*c != '%') {
+            const char *end = strchr(c, '%');
+            const size_t n = end ? (size_t) (end - c) : strlen(c);
+            append(line, &len, c, n);
+            c += n;
+            continue;
+        }
+        if (c[1] == '%') {
+            append(line, &len, "%", 1);
+            c += 2;
+            continue;
+        }
+        const size_t spec_len = 1 + strspn(c + 1, "-+ #0123456789.hljztL");
+        const char conversion = c[spec_len];
+        if (!conversion || !strchr("diuxXocspfFeEgGaA", conversion) || next_arg >= n_args) {
+            // Unknown conversion or a missing argument, print it as written
+            append(line, &len, c, spec_len + (conversion ? 1 : 0));
+        } else {
+            char formatted[LINE_SIZE];
+            const int n = format_arg(formatted, sizeof(formatted), c, spec_len, conversion, &args[next_arg++]);
+            if (n > 0) {
+                append(line, &len, formatted, (size_t) n < sizeof(formatted) ? (size_t) n : sizeof(formatted) - 1);
+            }
+        }
+        c += spec_len + (conversion ? 1 : 0);
+    }
+    line[len++] = '\n';
+    fwrite(line, 1, len, out());
+}
+
+static bool ring_empty(LogRing *r) {
+    return atomic_load_explicit(&r->tail, memory_order_relaxed) ==
+           atomic_load_explicit(&r->head, memory_order_acquire);
+}
+
+// Writes every published record, oldest first across all rings. Called with the lock held
+static void drain(void) {
+    while (true) {
+        LogRing *oldest = NULL;
+        for (LogRing *r = rings; r; r = r->next) {
+            if (ring_empty(r)) {
+                continue;
+            }
+            const uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+            const uint64_t oldest_tail = oldest ? atomic_load_explicit(&oldest->tail, memory_order_relaxed) : 0;
+            if (!oldest || r->records[tail % LOG_RING_RECORDS].sequence <
+                           oldest->records[oldest_tail % LOG_RING_RECORDS].sequence) {
+                oldest = r;
+            }
+        }
+        if (!oldest) {
+            break;
+        }
+        const uint64_t tail = atomic_load_explicit(&oldest->tail, memory_order_relaxed);
+        const LogRecord *record = &oldest->records[tail % LOG_RING_RECORDS];
+        write_record(record->site, record->n_args, record->args);
+        atomic_store_explicit(&oldest->tail, tail + 1, memory_order_release);
+    }
+
+    const uint64_t n_dropped = atomic_load(&dropped);
+    if (n_dropped != dropped_reported) {
+        fprintf(out(), "[WARN] %llu log records dropped, the writer could not keep up\n",
+                (unsigned long long) (n_dropped - dropped_reported));
+        dropped_reported = n_dropped;
+    }
+    fflush(out());
+
+    // Free the rings of threads that are gone
+    for (LogRing **r = &rings; *r;) {
+        if (atomic_load(&(*r)->orphaned) && ring_empty(*r)) {
+            LogRing *orphan = *r;
+            *r = orphan->next;
+            free(orphan);
+        } else {
+            r = &(*r)->next;
+        }
+    }
+}
+
+static void *write_records(void *arg) {
+    (void) arg;
+    pthread_mutex_lock(&lock);
+    while (true) {
+        // Everything published before the flush was requested is drained below
+        const uint64_t requested = flushes_requested;
+        const bool stop = stopping;
+        drain();
+        flushes_done = requested;
+        pthread_cond_broadcast(&drained);
+        if (stop) {
+            break;
+        }
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += WRITER_POLL_NS;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (flushes_requested == requested && !stopping) {
+            pthread_cond_timedwait(&wake, &lock, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+// Stops the writer at exit, after it wrote whatever is left
+static void shutdown_writer(void) {
+    pthread_mutex_lock(&lock);
+    if (!writer_running) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    atomic_store(&accepting, false);
+    stopping = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(writer, NULL);
+    pthread_mutex_lock(&lock);
+    writer_running = false;
+    pthread_mutex_unlock(&lock);
+}
+
+static void orphan_ring(void *ring) {
+    atomic_store(&((LogRing *) ring)->orphaned, true);
+}
+
+static void init(void) {
+    pthread_key_create(&ring_key, orphan_ring);
+    if (pthread_create(&writer, NULL, write_records, NULL) == 0) {
+        writer_running = true;
+        atomic_store(&accepting, true);
+        atexit(shutdown_writer);
+    } else {
+        fprintf(stderr, "[ERROR] Could not start the log writer, logging synchronously\n");
+    }
+}
+
+static LogRing *attach_ring(void) {
+    pthread_once(&once, init);
+    LogRing *r = calloc(1, sizeof(LogRing));
+    if (!r) {
+        return NULL;
+    }
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->orphaned, false);
+    pthread_setspecific(ring_key, r);
+
+    pthread_mutex_lock(&lock);
+    r->next = rings;
+    rings = r;
+    pthread_mutex_unlock(&lock);
+    thread_ring = r;
+    return r;
+}
+
+void Log_write(const LogSite *site, const int n_args, const LogArg *args) {
+    LogRing *r = thread_ring ? thread_ring : attach_ring();
+    if (!r || !atomic_load_explicit(&accepting, memory_order_acquire)) {
+        // No writer (any more), write it here
+        pthread_mutex_lock(&lock);
+        write_record(site, n_args, args);
+        fflush(out());
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+
+    const uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&r->tail, memory_order_acquire) == LOG_RING_RECORDS) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    LogRecord *record = &r->records[head % LOG_RING_RECORDS];
+    record->site = site;
+    record->sequence = atomic_fetch_add_explicit(&sequence, 1, memory_order_relaxed);
+    record->n_args = n_args < LOG_MAX_ARGS ? n_args : LOG_MAX_ARGS;
+    size_t used = 0;
+    for (int i = 0; i < record->n_args; i++) {
+        record->args[i] = args[i];
+        if (args[i].type != LOG_ARG_STRING) {
+            continue;
+        }
+        // Copy strings, the caller's may be gone by the time the record is written
+        const char *s = args[i].s ? args[i].s : "(null)";
+        const size_t room = used < LOG_MAX_STRING ? LOG_MAX_STRING - used - 1 : 0;
+        const size_t n = strnlen(s, room);
+        char *copy = record->strings + (used < LOG_MAX_STRING ? used : LOG_MAX_STRING - 1);
+        memcpy(copy, s, n);
+        copy[n] = '\0';
+        record->args[i].s = copy;
+        used += n + 1;
+    }
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+    if (site->level >= LOG_LEVEL_WARN) {
+        pthread_cond_signal(&wake);
+    }
+}
+
+void Log_set_level(const int level) {
+    atomic_store_explicit(&Log_level, level, memory_order_relaxed);
+}
+
+int Log_parse_level(const char *name) {
+    for (int level = LOG_LEVEL_TRACE; level <= LOG_LEVEL_OFF; level++) {
+        if (strcmp(name, level_names[level]) == 0) {
+            return level;
+        }
+    }
+    return -1;
+}
+
+const char *Log_level_name(const int level) {
+    return level >= LOG_LEVEL_TRACE && level <= LOG_LEVEL_OFF ? level_names[level] : "?";
+}
+
+void Log_set_output(FILE *file) {
+    Log_flush();
+    pthread_mutex_lock(&lock);
+    output = file;
+    pthread_mutex_unlock(&lock);
+}
+
+void Log_flush(void) {
+    pthread_mutex_lock(&lock);
+    if (writer_running && !stopping) {
+        const uint64_t request = ++flushes_requested;
+        pthread_cond_signal(&wake);
+        while (flushes_done < request && writer_running) {
+            pthread_cond_wait(&drained, &lock);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+uint64_t Log_dropped(void) {
+    return atomic_load(&dropped);
+}
@@ -0,0 +1,121 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_LOG_H
+#define INC_6502_EMULATOR_LOG_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Asynchronous logger. A call site only copies its arguments into a fixed size record in a ring
+ * owned by the calling thread, a background thread formats the records and writes them to the
+ * output (stderr by default). When a ring is full records are dropped and counted, the caller
+ * never waits.
+ *
+ * Levels below LOG_COMPILE_LEVEL are removed by the compiler, levels below the run-time level
+ * (Log_set_level) cost a relaxed load and a compare. Messages take at most LOG_MAX_ARGS
+ * arguments, integers, doubles or strings. Strings are copied, up to LOG_MAX_STRING bytes in
+ * total per record.
+ */
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_OFF 5
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_MAX_ARGS 4
+#define LOG_MAX_STRING 64
+// Records buffered per thread, a power of two
+#define LOG_RING_RECORDS 1024
+
+typedef struct LogSite {
+    int level;
+    const char *file;
+    int line;
+    const char *format;
+} LogSite;
+
+typedef enum LogArgType {
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING,
+    LOG_ARG_POINTER,
+} LogArgType;
+
+typedef struct LogArg {
+    LogArgType type;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const char *s;
+        const void *p;
+    };
+} LogArg;
+
+extern atomic_int Log_level;
+
+void Log_set_level(int level);
+// LOG_LEVEL_* for "trace", "debug", "info", "warn", "error" or "off", -1 for anything else
+int Log_parse_level(const char *name);
+const char *Log_level_name(int level);
+// Where formatted records go, NULL for stderr. The file must stay open until Log_flush returned
+void Log_set_output(FILE *file);
+// Blocks until every record logged before the call has been written
+void Log_flush(void);
+// Records dropped because a ring was full
+uint64_t Log_dropped(void);
+
+void Log_write(const LogSite *site, int n_args, const LogArg *args);
+
+static inline LogArg Log_arg_int(const int64_t value) { return (LogArg) {.type = LOG_ARG_INT, .i = value}; }
+static inline LogArg Log_arg_uint(const uint64_t value) { return (LogArg) {.type = LOG_ARG_UINT, .u = value}; }
+static inline LogArg Log_arg_double(const double value) { return (LogArg) {.type = LOG_ARG_DOUBLE, .d = value}; }
+static inline LogArg Log_arg_string(const char *value) { return (LogArg) {.type = LOG_ARG_STRING, .s = value}; }
+static inline LogArg Log_arg_pointer(const void *value) { return (LogArg) {.type = LOG_ARG_POINTER, .p = value}; }
+
+#define LOG_ARG(X) _Generic((X), \
+    char: Log_arg_int, signed char: Log_arg_int, short: Log_arg_int, int: Log_arg_int, \
+    long: Log_arg_int, long long: Log_arg_int, \
+    unsigned char: Log_arg_uint, unsigned short: Log_arg_uint, unsigned int: Log_arg_uint, \
+    unsigned long: Log_arg_uint, unsigned long long: Log_arg_uint, _Bool: Log_arg_uint, \
+    float: Log_arg_double, double: Log_arg_double, \
+    char *: Log_arg_string, const char *: Log_arg_string, \
+    default: Log_arg_pointer)(X)
+
+#define LOG_NARGS_(_0, _1, _2, _3, _4, N, ...) N
+#define LOG_NARGS(...) LOG_NARGS_(_, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define LOG_PACK_0()
+#define LOG_PACK_1(A) LOG_ARG(A)
+#define LOG_PACK_2(A, B) LOG_ARG(A), LOG_ARG(B)
+#define LOG_PACK_3(A, B, C) LOG_ARG(A), LOG_ARG(B), LOG_ARG(C)
+#define LOG_PACK_4(A, B, C, D) LOG_ARG(A), LOG_ARG(B), LOG_ARG(C), LOG_ARG(D)
+#define LOG_PACK__(N, ...) LOG_PACK_##N(__VA_ARGS__)
+#define LOG_PACK_(N, ...) LOG_PACK__(N, ##__VA_ARGS__)
+// A dummy first element keeps the array non-empty when there are no arguments
+#define LOG_ARGS(...) ((const LogArg[]) {{0}, LOG_PACK_(LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)} + 1)
+
+#define LOG_AT(LEVEL, M, ...) do { \
+if ((LEVEL) >= LOG_COMPILE_LEVEL && \
+    __builtin_expect((LEVEL) >= atomic_load_explicit(&Log_level, memory_order_relaxed), 0)) { \
+static const LogSite log_site_ = {(LEVEL), __FILE__, __LINE__, M}; \
+Log_write(&log_site_, LOG_NARGS(__VA_ARGS__), LOG_ARGS(__VA_ARGS__)); \
+} \
+} while (0)
+
+#define LOG_TRACE(M, ...) LOG_AT(LOG_LEVEL_TRACE, M, ##__VA_ARGS__)
+#define LOG_DEBUG(M, ...) LOG_AT(LOG_LEVEL_DEBUG, M, ##__VA_ARGS__)
+#define LOG_INFO(M, ...) LOG_AT(LOG_LEVEL_INFO, M, ##__VA_ARGS__)
+#define LOG_WARN(M, ...) LOG_AT(LOG_LEVEL_WARN, M, ##__VA_ARGS__)
+#define LOG_ERROR(M, ...) LOG_AT(LOG_LEVEL_ERROR, M, ##__VA_ARGS__)
+
+#endif //INC_6502_EMULATOR_LOG_H
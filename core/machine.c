@@ -0,0 +1,44 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "machine.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "dbg.h"
+
+Machine *Machine_create(void) {
+    Machine *m = calloc(1, sizeof(Machine));
+    check_mem_return(m, NULL);
+
+    atomic_init(&m->pause_requested, false);
+    Machine_recycle(m);
+    return m;
+}
+
+void Machine_recycle(Machine *const m) {
+    Disassembler_free(m);
+    Breakpoint_clear_all(m);
+    Profiler_stop(m);
+    Trace_stop(m);
+    Stats_reset(m);
+    MemoryMap_reset(m);
+    BUS_unmap_devices(m);
+    BUS_init(m);
+    CPU_reset(m);
+    atomic_store(&m->pause_requested, false);
+}
+
+void Machine_destroy(Machine *const m) {
+    if (!m) {
+        return;
+    }
+    Disassembler_free(m);
+    Breakpoint_clear_all(m);
+    Profiler_stop(m);
+    Trace_stop(m);
+    BUS_unmap_devices(m);
+    free(m);
+}
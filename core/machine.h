@@ -0,0 +1,72 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_MACHINE_H
+#define INC_6502_EMULATOR_MACHINE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "breakpoint.h"
+#include "bus.h"
+#include "cpu.h"
+#include "disassembler.h"
+#include "events.h"
+#include "memory_map.h"
+#include "profiler.h"
+#include "stats.h"
+#include "trace.h"
+
+/*
+ * Everything that makes up one emulated computer. Nothing in the core keeps
+ * global mutable state, so any number of machines can live side by side
+ * (e.g. one per client session) as long as each one is only driven by one
+ * thread at a time. The instruction table is shared and read-only.
+ */
+struct Machine {
+    CPU cpu;
+    // Instructions executed since the last reset, kept out of CPU so save-states do not carry it
+    uint64_t instruction_count;
+    // Device timers and the IRQ line, looked at before every instruction
+    Events events;
+    // Set by CPU_pause (from any thread), consumed by the run loop
+    atomic_bool pause_requested;
+    // Bumped on every bus write, observers compare it to skip looking at the bitmap at all
+    uint32_t generation;
+    uint8_t dirty_pages[BUS_DIRTY_BITMAP_SIZE];
+    SourceCode code;
+    Breakpoints breakpoints;
+    // Only allocated while profiling, see Profiler_start
+    Profiler *profiler;
+    // Only set while tracing, see Trace_start
+    Tracer *tracer;
+    // The device owning each page, NULL for plain RAM (see BUS_map_device)
+    Device *io_pages[RAM_SIZE / 0x100];
+    Device devices[BUS_MAX_DEVICES];
+    uint8_t n_devices;
+    uint8_t ram[RAM_SIZE];
+#ifdef CPU_OPCODE_STATS
+    // Kept last so the layout of everything above does not depend on the build flag
+    uint64_t opcode_stats[256][STAT_COUNT];
+#endif
+#ifdef CPU_MEMORY_MAP
+    uint32_t memory_map[MEMORY_ACCESS_COUNT][RAM_SIZE];
+#endif
+};
+
+/**
+ * Allocate a machine with cleared memory and a CPU fresh out of reset.
+ * CPU_load_instructions must have been called once before.
+ * @return the machine or NULL if out of memory
+ */
+Machine *Machine_create(void);
+
+/**
+ * Bring a machine back to its just created state so it can be handed to someone else.
+ */
+void Machine_recycle(Machine *m);
+
+void Machine_destroy(Machine *m);
+
+#endif //INC_6502_EMULATOR_MACHINE_H
@@ -1,25 +1,554 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+/*
+ * Headless runner. Loads an image, runs it until a stop condition and reports the result, the
+ * exit status tells scripts how it went:
+ *   0  stopped at --until or a breakpoint, or used up --cycles when there was nothing to stop at
+ *   1  bad arguments or the image could not be loaded
+ *   2  used up --cycles before reaching --until or a breakpoint
+ *
+ * Images (--format, picked from the extension by default):
+ *   bin  raw bytes, mapped to end at $FFFF with its vectors in place, or loaded at --org
+ *   hex  text of hex bytes ("A9 01 8D 00 02") loaded at --org (default $0600) with the reset
+ *        vector pointing there. In the example .txt files everything after "Binary" is used.
+ *
+ * Addresses are hex, ranges are START-END or START:LENGTH (both inclusive of START).
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "acia.h"
+#include "breakpoint.h"
 #include "bus.h"
 #include "cpu.h"
+#include "dbg.h"
 #include "disassembler.h"
+#include "easy6502.h"
+#include "log.h"
+#include "machine.h"
+#include "memory_map.h"
+#include "pacer.h"
+#include "profiler.h"
 #include "rom.h"
+#include "savestate.h"
+#include "stats.h"
+#include "trace.h"
+#include "via.h"
+
+#define NO_ADDRESS (-1)
+#define DEFAULT_HEX_ORG 0x0600
+#define DEFAULT_CYCLES 100000000ULL
+#define MAX_RANGES 16
+
+#define EXIT_NOT_REACHED 2
+
+typedef enum ImageFormat {
+    FORMAT_AUTO,
+    FORMAT_BIN,
+    FORMAT_HEX,
+} ImageFormat;
+
+typedef struct Range {
+    uint16_t start;
+    uint16_t end;
+} Range;
+
+typedef struct Options {
+    const char *image;
+    ImageFormat format;
+    int32_t org;
+    int32_t start;
+    uint64_t cycles;
+    // Emulated clock in Hz to pace the run to, 0 to run as fast as possible
+    uint32_t hz;
+    int32_t until;
+    const char *breakpoints[MAX_RANGES];
+    int n_breakpoints;
+    const char *trace_path;
+    const char *profile_path;
+    const char *stats_path;
+    const char *heatmap_path;
+    const char *coverage_prefix;
+    // Where to map a 6522 VIA, NO_ADDRESS for none
+    int32_t via;
+    // Same for the ACIA console, its input comes from a file and output goes to stdout by default
+    int32_t acia;
+    const char *acia_input;
+    const char *acia_output;
+    // Random numbers at $FE, the key port at $FF stays empty without a keyboard
+    bool easy6502;
+    // Save-state to carry on from (the image is optional then) and to write when done
+    const char *load_state;
+    const char *save_state;
+    bool registers;
+    Range dumps[MAX_RANGES];
+    int n_dumps;
+    Range disassemble[MAX_RANGES];
+    int n_disassemble;
+} Options;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static int32_t parse_address(const char *str) {
+    char *end = NULL;
+    const unsigned long address = strtoul(str, &end, 16);
+    return *str && !*end && address <= 0xFFFF ? (int32_t) address : NO_ADDRESS;
+}
+
+static bool parse_range(const char *str, Range *range) {
+    char *end = NULL;
+    const unsigned long start = strtoul(str, &end, 16);
+    if (end == str || start > 0xFFFF || (*end != '-' && *end != ':')) {
+        return false;
+    }
+    const bool is_length = *end == ':';
+    const char *second = end + 1;
+    const unsigned long value = strtoul(second, &end, 16);
+    const unsigned long last = is_length ? start + value - 1 : value;
+    if (end == second || *end || last > 0xFFFF || last < start || (is_length && value == 0)) {
+        return false;
+    }
+    *range = (Range){.start = start, .end = last};
+    return true;
+}
+
+static char *read_text(const char *path) {
+    FILE *file = fopen(path, "rb");
+    check_return(file, "Could not open %s", NULL, path);
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    rewind(file);
+
+    char *text = malloc(size + 1);
+    check_mem(text, {
+        fclose(file);
+        return NULL;
+    });
+    text[fread(text, 1, size, file)] = '\0';
+    fclose(file);
+    return text;
+}
+
+static bool load_hex(Machine *m, const char *path, const uint16_t org, Range *loaded) {
+    char *text = read_text(path);
+    if (!text) {
+        return false;
+    }
+    // Example files describe the program first, the bytes follow "Binary"
+    char *hex = strstr(text, "Binary");
+    hex = hex ? hex + strlen("Binary") : text;
+
+    // Keep the byte tokens only, so headings and separators do not end up in memory
+    size_t len = 0;
+    for (char *token = strtok(hex, " \t\r\n:-"); token; token = strtok(NULL, " \t\r\n:-")) {
+        char *end;
+        strtoul(token, &end, 16);
+        if (strlen(token) == 2 && *end == '\0') {
+            memmove(text + len, token, 2);
+            text[len + 2] = ' ';
+            len += 3;
+        }
+    }
+    text[len ? len - 1 : 0] = '\0';
+    check(len > 0, "No hex bytes in %s", {
+        free(text);
+        return false;
+    }, path);
 
+    BUS_load_ROM_from_str(m, org, text);
+    free(text);
+    *loaded = (Range){.start = org, .end = org + len / 3 - 1};
+    return true;
+}
+
+static bool load_bin(Machine *m, const char *path, const int32_t org, Range *loaded) {
+    ROM rom = {0};
+    ROM_from_file(&rom, path);
+    check_return(rom.data, "Could not load %s", false, path);
+    if (org != NO_ADDRESS) {
+        const uint32_t size = rom.end - rom.start + 1;
+        check(org + size <= ROM_MAX_SIZE, "%s does not fit at %04X", {
+            free(rom.data);
+            free(rom.file);
+            return false;
+        }, path, org);
+        rom.start = org;
+        rom.end = org + size - 1;
+    }
+    BUS_load_ROM(m, &rom);
+    free(rom.data);
+    free(rom.file);
+    *loaded = (Range){.start = rom.start, .end = rom.end};
+    return true;
+}
+
+static bool load_image(Machine *m, const Options *o, Range *loaded) {
+    ImageFormat format = o->format;
+    if (format == FORMAT_AUTO) {
+        const char *extension = strrchr(o->image, '.');
+        format = extension && (strcmp(extension, ".txt") == 0 || strcmp(extension, ".hex") == 0)
+                     ? FORMAT_HEX
+                     : FORMAT_BIN;
+    }
+    const bool ok = format == FORMAT_HEX
+                        ? load_hex(m, o->image, o->org == NO_ADDRESS ? DEFAULT_HEX_ORG : o->org, loaded)
+                        : load_bin(m, o->image, o->org, loaded);
+    if (ok) {
+        CPU_reset(m);
+        if (o->start != NO_ADDRESS) {
+            m->cpu.pc = o->start;
+        }
+    }
+    return ok;
+}
+
+static void print_registers(const Machine *m) {
+    const CPU *c = CPU_get_state(m);
+    printf("PC:%04X A:%02X X:%02X Y:%02X SP:%02X P:%02X cycles:%llu\n", c->pc, c->a, c->x, c->y, c->sp,
+           c->status, (unsigned long long) c->cycle_count);
+}
+
+static void print_memory(const Machine *m, const Range range) {
+    for (uint32_t address = range.start; address <= range.end; address++) {
+        if (address == range.start || address % 16 == 0) {
+            printf("%s%04X:", address == range.start ? "" : "\n", address);
+        }
+        printf(" %02X", BUS_peek(m, address));
+    }
+    printf("\n");
+}
+
+static void print_disassembly(Machine *m, const Range range) {
+    // The last instruction may start right at the end of the range
+    Disassembler_parse_section(m, range.start, range.end < 0xFFFD ? range.end + 3 : 0xFFFF);
+    const SourceCode *code = Disassembler_get_code(m);
+    for (int i = 0; i < code->n_lines && code->lines[i].address <= range.end; i++) {
+        printf("%s\n", code->lines[i].line);
+    }
+}
+
+static uint64_t run(Machine *m, const uint64_t cycles, const bool has_target) {
+    const uint64_t ran = has_target ? CPU_run_to_breakpoint(m, cycles) : CPU_run(m, cycles);
+    Acia *acia = Acia_get(m);
+    if (acia) {
+        Acia_flush(acia);
+    }
+    return ran;
+}
+
+// Same as run, a slice at a time with the host sleeping in between to keep to the clock
+static uint64_t run_paced(Machine *m, const Options *o, const bool has_target) {
+    Pacer p;
+    Pacer_start(&p, o->hz);
+    uint64_t executed = 0;
+    while (executed < o->cycles) {
+        const uint64_t remaining = o->cycles - executed;
+        const uint64_t slice = Pacer_slice_cycles(&p);
+        const uint64_t ran = run(m, remaining < slice ? remaining : slice, has_target);
+        executed += ran;
+        if (has_target && Breakpoint_was_hit(m)) {
+            break;
+        }
+        Pacer_wait(&p, ran);
+    }
+
+    const PacerStats *s = &p.stats;
+    printf("Paced at %u Hz: speed %.5f, drift %+.3f ms, %llu of %llu slices late (worst %.3f ms), %llu resyncs, "
+           "host busy %.1f%%\n", o->hz, Pacer_speed(s, o->hz), (double) s->drift_ns / 1e6,
+           (unsigned long long) s->late_slices, (unsigned long long) s->slices, (double) s->max_lag_ns / 1e6,
+           (unsigned long long) s->resyncs,
+           s->elapsed_ns ? 100.0 * (double) (s->elapsed_ns - s->sleep_ns) / (double) s->elapsed_ns : 0);
+    return executed;
+}
+
+static bool attach_acia(Machine *m, const Options *o, FILE *output) {
+    Acia *acia = Acia_attach(m, o->acia);
+    check_return(acia, "Could not map an ACIA at %04X", false, o->acia);
+    Acia_set_output(acia, output);
+    if (!o->acia_input) {
+        return true;
+    }
+
+    FILE *file = fopen(o->acia_input, "rb");
+    check_return(file, "Could not open %s", false, o->acia_input);
+    uint8_t buffer[4096];
+    size_t n;
+    bool queued = true;
+    while (queued && (n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        queued = Acia_send_input(m, acia, buffer, n);
+    }
+    fclose(file);
+    return queued;
+}
+
+static bool write_profile(const Machine *m, const char *path) {
+    FILE *file = fopen(path, "w");
+    check_return(file, "Could not open %s", false, path);
+    const bool written = Profiler_write_collapsed(m, file);
+    fclose(file);
+    return written;
+}
+
+static bool write_heatmap(const Machine *m, const char *path) {
+    FILE *file = fopen(path, "wb");
+    check_return(file, "Could not open %s", false, path);
+    const bool written = MemoryMap_write_heatmap(m, MEMORY_ACCESS_COUNT, file);
+    fclose(file);
+    return written;
+}
+
+// PREFIX.asm holds the disassembly of the image, PREFIX.info its lcov coverage
+static bool write_coverage(const Machine *m, const char *prefix) {
+    char listing_path[1024];
+    char lcov_path[1024];
+    snprintf(listing_path, sizeof(listing_path), "%s.asm", prefix);
+    snprintf(lcov_path, sizeof(lcov_path), "%s.info", prefix);
+
+    FILE *listing = fopen(listing_path, "w");
+    check_return(listing, "Could not open %s", false, listing_path);
+    MemoryMap_write_listing(m, listing);
+    fclose(listing);
+
+    FILE *lcov = fopen(lcov_path, "w");
+    check_return(lcov, "Could not open %s", false, lcov_path);
+    const bool written = MemoryMap_write_lcov(m, listing_path, lcov);
+    fclose(lcov);
+
+    MemoryCoverage coverage;
+    if (written && MemoryMap_get_coverage(m, &coverage)) {
+        printf("Coverage: %u of %u lines, %u code bytes, %u data bytes, %u pages touched\n", coverage.lines_hit,
+               coverage.lines, coverage.code_bytes, coverage.data_bytes, coverage.pages_touched);
+    }
+    return written;
+}
+
+static bool write_stats(const Machine *m, const char *path) {
+    FILE *file = fopen(path, "w");
+    check_return(file, "Could not open %s", false, path);
+    const bool written = Stats_write_csv(m, file);
+    fclose(file);
+    return written;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [options] IMAGE|--load-state FILE\n"
+            "  --format bin|hex      image format, from the extension by default (.txt/.hex are hex)\n"
+            "  --org ADDR            load address (hex default 0600, bin default: end at FFFF)\n"
+            "  --start ADDR          start here instead of at the reset vector\n"
+            "  --cycles N            cycle budget (default %llu)\n"
+            "  --hz N                run in real time at N Hz (e.g. 1000000) instead of flat out\n"
+            "  --until ADDR          stop before executing the instruction at ADDR\n"
+            "  --via ADDR            map a 6522 VIA at ADDR-ADDR+F (e.g. 6000)\n"
+            "  --acia ADDR           map a 6551 ACIA console at ADDR-ADDR+3 (e.g. 5000)\n"
+            "  --acia-input FILE     bytes for the program to read from the ACIA\n"
+            "  --acia-output FILE    where the ACIA output goes instead of stdout\n"
+            "  --easy6502            map the easy6502 ports, random numbers at FE and keys at FF\n"
+            "  --load-state FILE     carry on from a save-state, after loading IMAGE if given\n"
+            "  --save-state FILE     write a save-state when done\n"
+            "  --break ADDR[:COND]   stop at ADDR, if COND holds (e.g. 0612:A==$10), repeatable\n"
+            "  --trace FILE          binary trace of the run (see 6502_trace)\n"
+            "  --profile FILE        collapsed call stacks of the run for flamegraph tools\n"
+            "  --opcode-stats FILE   per opcode counters (needs -DCPU_OPCODE_STATS=ON)\n"
+            "  --heatmap FILE        PPM of reads (blue), writes (red), executes (green) per address\n"
+            "  --coverage PREFIX     lcov coverage PREFIX.info of the disassembly in PREFIX.asm\n"
+            "                        (both need -DCPU_MEMORY_MAP=ON)\n"
+            "  --registers           print the registers when done\n"
+            "  --dump RANGE          print memory when done, repeatable\n"
+            "  --disassemble RANGE   print disassembly when done, repeatable\n"
+            "  --log-level LEVEL     trace, debug, info (default), warn, error or off\n",
+            program, (unsigned long long) DEFAULT_CYCLES);
+}
+
+static bool parse_options(const int argc, char *argv[], Options *o) {
+    *o = (Options){
+        .org = NO_ADDRESS, .start = NO_ADDRESS, .until = NO_ADDRESS, .via = NO_ADDRESS, .acia = NO_ADDRESS,
+        .cycles = DEFAULT_CYCLES
+    };
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (strcmp(arg, "--format") == 0 && has_value) {
+            const char *format = argv[++i];
+            check_return(strcmp(format, "bin") == 0 || strcmp(format, "hex") == 0, "Unknown format %s", false,
+                         format);
+            o->format = strcmp(format, "bin") == 0 ? FORMAT_BIN : FORMAT_HEX;
+        } else if (strcmp(arg, "--org") == 0 && has_value) {
+            o->org = parse_address(argv[++i]);
+            check_return(o->org != NO_ADDRESS, "Invalid address %s", false, argv[i]);
+        } else if (strcmp(arg, "--start") == 0 && has_value) {
+            o->start = parse_address(argv[++i]);
+            check_return(o->start != NO_ADDRESS, "Invalid address %s", false, argv[i]);
+        } else if (strcmp(arg, "--until") == 0 && has_value) {
+            o->until = parse_address(argv[++i]);
+            check_return(o->until != NO_ADDRESS, "Invalid address %s", false, argv[i]);
+        } else if (strcmp(arg, "--via") == 0 && has_value) {
+            o->via = parse_address(argv[++i]);
+            check_return(o->via != NO_ADDRESS, "Invalid address %s", false, argv[i]);
+        } else if (strcmp(arg, "--acia") == 0 && has_value) {
+            o->acia = parse_address(argv[++i]);
+            check_return(o->acia != NO_ADDRESS, "Invalid address %s", false, argv[i]);
+        } else if (strcmp(arg, "--acia-input") == 0 && has_value) {
+            o->acia_input = argv[++i];
+        } else if (strcmp(arg, "--acia-output") == 0 && has_value) {
+            o->acia_output = argv[++i];
+        } else if (strcmp(arg, "--easy6502") == 0) {
+            o->easy6502 = true;
+        } else if (strcmp(arg, "--load-state") == 0 && has_value) {
+            o->load_state = argv[++i];
+        } else if (strcmp(arg, "--save-state") == 0 && has_value) {
+            o->save_state = argv[++i];
+        } else if (strcmp(arg, "--cycles") == 0 && has_value) {
+            o->cycles = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "--hz") == 0 && has_value) {
+            o->hz = (uint32_t) strtoul(argv[++i], NULL, 10);
+            check_return(o->hz > 0, "Invalid clock %s", false, argv[i]);
+        } else if (strcmp(arg, "--break") == 0 && has_value && o->n_breakpoints < MAX_RANGES) {
+            o->breakpoints[o->n_breakpoints++] = argv[++i];
+        } else if (strcmp(arg, "--trace") == 0 && has_value) {
+            o->trace_path = argv[++i];
+        } else if (strcmp(arg, "--profile") == 0 && has_value) {
+            o->profile_path = argv[++i];
+        } else if (strcmp(arg, "--opcode-stats") == 0 && has_value) {
+            o->stats_path = argv[++i];
+            check_return(Stats_enabled(), "--opcode-stats needs a build with -DCPU_OPCODE_STATS=ON", false);
+        } else if ((strcmp(arg, "--heatmap") == 0 || strcmp(arg, "--coverage") == 0) && has_value) {
+            *(strcmp(arg, "--heatmap") == 0 ? &o->heatmap_path : &o->coverage_prefix) = argv[++i];
+            check_return(MemoryMap_enabled(), "%s needs a build with -DCPU_MEMORY_MAP=ON", false, arg);
+        } else if (strcmp(arg, "--registers") == 0) {
+            o->registers = true;
+        } else if (strcmp(arg, "--dump") == 0 && has_value && o->n_dumps < MAX_RANGES) {
+            check_return(parse_range(argv[++i], &o->dumps[o->n_dumps++]), "Invalid range %s", false, argv[i]);
+        } else if (strcmp(arg, "--disassemble") == 0 && has_value && o->n_disassemble < MAX_RANGES) {
+            check_return(parse_range(argv[++i], &o->disassemble[o->n_disassemble++]), "Invalid range %s", false,
+                         argv[i]);
+        } else if (strcmp(arg, "--log-level") == 0 && has_value) {
+            const int level = Log_parse_level(argv[++i]);
+            check_return(level >= 0, "Unknown log level %s", false, argv[i]);
+            Log_set_level(level);
+        } else if (!o->image && arg[0] != '-') {
+            o->image = arg;
+        } else {
+            return false;
+        }
+    }
+    return o->image != NULL || o->load_state != NULL;
+}
+
+static bool set_breakpoints(Machine *m, const Options *o) {
+    if (o->until != NO_ADDRESS) {
+        Breakpoint_set(m, o->until, NULL);
+    }
+    for (int i = 0; i < o->n_breakpoints; i++) {
+        char address[8] = "";
+        const char *condition = strchr(o->breakpoints[i], ':');
+        const size_t length = condition ? (size_t) (condition - o->breakpoints[i]) : strlen(o->breakpoints[i]);
+        check_return(length < sizeof(address), "Invalid breakpoint %s", false, o->breakpoints[i]);
+        memcpy(address, o->breakpoints[i], length);
+        const int32_t pc = parse_address(address);
+        check_return(pc != NO_ADDRESS, "Invalid breakpoint %s", false, o->breakpoints[i]);
+        check_return(Breakpoint_set(m, pc, condition ? condition + 1 : NULL), "Invalid breakpoint %s", false,
+                     o->breakpoints[i]);
+    }
+    return true;
+}
+
+int main(const int argc, char *argv[]) {
+    Options o;
+    if (!parse_options(argc, argv, &o)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
 
-int main(void) {
-    // ROM rom;
-    // ROM_from_file(&rom, "kernel-rom.bin");
-    BUS_init();
     CPU_load_instructions();
-    // BUS_load_ROM(&rom);
-    CPU_reset();
+    Machine *m = Machine_create();
+    if (!m) {
+        return EXIT_FAILURE;
+    }
+    int status = EXIT_FAILURE;
+    FILE *acia_output = NULL;
+    Range image = {0x0000, 0xFFFF};
+    try(!o.image || load_image(m, &o, &image), "Could not load %s", o.image);
+    // Mapped after loading, so an image covering the registers does not write to them
+    try(o.via == NO_ADDRESS || Via_attach(m, o.via), "Could not map a VIA at %04X", o.via);
+    try(!o.easy6502 || Easy6502_attach(m), "Could not map the easy6502 ports");
+    if (o.acia != NO_ADDRESS) {
+        if (o.acia_output) {
+            acia_output = fopen(o.acia_output, "wb");
+            try(acia_output, "Could not open %s", o.acia_output);
+        }
+        try(attach_acia(m, &o, acia_output ? acia_output : stdout), "Could not set up the ACIA");
+    }
+    // After the devices, they are restored too
+    try(!o.load_state || SaveState_read_file(m, o.load_state), "Could not load %s", o.load_state);
+    if (o.profile_path || o.coverage_prefix) {
+        // Names the frames of the profile, the lines of the coverage report
+        Disassembler_parse_section(m, image.start, image.end);
+    }
+    try(set_breakpoints(m, &o), "Could not set breakpoints");
+    try(!o.trace_path || Trace_start(m, o.trace_path), "Could not start trace");
+    try(!o.profile_path || Profiler_start(m), "Could not start profiler");
+
+    const bool has_target = o.until != NO_ADDRESS || o.n_breakpoints > 0;
+    const double start = now_seconds();
+    const uint64_t cycles = o.hz ? run_paced(m, &o, has_target) : run(m, o.cycles, has_target);
+    const double seconds = now_seconds() - start;
+    Trace_stop(m);
 
-    // Dump code
-    Disassembler_parse_section(0xFF00, 0xFFFF);
-    while (CPU_get_pc() < 0xFFFF) {
-        CPU_step();
+    const double mhz = seconds > 0 ? (double) cycles / seconds / 1e6 : 0;
+    if (!has_target) {
+        printf("Ran %llu cycles in %.3f s (%.2f MHz)\n", (unsigned long long) cycles, seconds, mhz);
+        status = EXIT_SUCCESS;
+    } else if (Breakpoint_was_hit(m)) {
+        printf("Stopped at %04X after %llu cycles in %.3f s (%.2f MHz)\n", CPU_get_pc(m),
+               (unsigned long long) cycles, seconds, mhz);
+        status = EXIT_SUCCESS;
+    } else {
+        printf("No breakpoint reached within %llu cycles, pc at %04X\n", (unsigned long long) cycles, CPU_get_pc(m));
+        status = EXIT_NOT_REACHED;
     }
 
-    return EXIT_SUCCESS;
+    if (o.save_state && !SaveState_write_file(m, o.save_state)) {
+        status = EXIT_FAILURE;
+    }
+    if (o.profile_path && !write_profile(m, o.profile_path)) {
+        status = EXIT_FAILURE;
+    }
+    if (o.stats_path && !write_stats(m, o.stats_path)) {
+        status = EXIT_FAILURE;
+    }
+    if (o.heatmap_path && !write_heatmap(m, o.heatmap_path)) {
+        status = EXIT_FAILURE;
+    }
+    if (o.coverage_prefix && !write_coverage(m, o.coverage_prefix)) {
+        status = EXIT_FAILURE;
+    }
+    if (o.registers) {
+        print_registers(m);
+    }
+    for (int i = 0; i < o.n_dumps; i++) {
+        print_memory(m, o.dumps[i]);
+    }
+    for (int i = 0; i < o.n_disassemble; i++) {
+        print_disassembly(m, o.disassemble[i]);
+    }
+
+catch:
+    // Flushes what the ACIA still holds
+    Machine_destroy(m);
+    if (acia_output) {
+        fclose(acia_output);
+    }
+    return status;
 }
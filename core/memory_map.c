@@ -0,0 +1,158 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "memory_map.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dbg.h"
+#include "machine.h"
+#include "trace.h"
+
+#define HEATMAP_SIDE 256
+
+bool MemoryMap_enabled(void) {
+#ifdef CPU_MEMORY_MAP
+    return true;
+#else
+    return false;
+#endif
+}
+
+const uint32_t *MemoryMap_get(const Machine *const m, const MemoryAccess access) {
+#ifdef CPU_MEMORY_MAP
+    return access < MEMORY_ACCESS_COUNT ? m->memory_map[access] : NULL;
+#else
+    (void) m;
+    (void) access;
+    return NULL;
+#endif
+}
+
+void MemoryMap_reset(Machine *const m) {
+#ifdef CPU_MEMORY_MAP
+    memset(m->memory_map, 0, sizeof(m->memory_map));
+#else
+    (void) m;
+#endif
+}
+
+// Marks the opcode and operand bytes of every executed instruction
+static void mark_code(const Machine *m, const uint32_t *executes, uint8_t *code) {
+    memset(code, 0, RAM_SIZE);
+    for (uint32_t address = 0; address < RAM_SIZE; address++) {
+        if (executes[address]) {
+            const uint8_t n_bytes = 1 + Trace_operand_count(m->ram[address]);
+            for (uint8_t i = 0; i < n_bytes; i++) {
+                code[(uint16_t) (address + i)] = 1;
+            }
+        }
+    }
+}
+
+bool MemoryMap_get_coverage(const Machine *const m, MemoryCoverage *coverage) {
+    const uint32_t *reads = MemoryMap_get(m, MEMORY_READ);
+    const uint32_t *writes = MemoryMap_get(m, MEMORY_WRITE);
+    const uint32_t *executes = MemoryMap_get(m, MEMORY_EXECUTE);
+    if (!reads) {
+        return false;
+    }
+
+    uint8_t *code = malloc(RAM_SIZE);
+    check_mem_return(code, false);
+    mark_code(m, executes, code);
+    *coverage = (MemoryCoverage){0};
+    for (uint32_t page = 0; page < RAM_SIZE / 0x100; page++) {
+        bool touched = false;
+        for (uint32_t address = page * 0x100; address < (page + 1) * 0x100; address++) {
+            const bool accessed = reads[address] || writes[address];
+            coverage->code_bytes += code[address];
+            coverage->data_bytes += accessed && !code[address];
+            touched |= accessed || executes[address];
+        }
+        coverage->pages_touched += touched;
+    }
+    coverage->lines = m->code.n_lines;
+    for (uint32_t i = 0; i < m->code.n_lines; i++) {
+        coverage->lines_hit += executes[m->code.lines[i].address] != 0;
+    }
+    free(code);
+    return true;
+}
+
+static uint32_t bit_length(uint32_t value) {
+    uint32_t bits = 0;
+    for (; value; value >>= 1) {
+        bits++;
+    }
+    return bits;
+}
+
+static uint32_t max_count(const uint32_t *counts) {
+    uint32_t max = 0;
+    for (uint32_t address = 0; address < RAM_SIZE; address++) {
+        max = counts[address] > max ? counts[address] : max;
+    }
+    return max;
+}
+
+// 0 for untouched, 64..255 by the magnitude of count relative to the largest one
+static uint8_t brightness(const uint32_t count, const uint32_t max_bits) {
+    if (!count) {
+        return 0;
+    }
+    return (uint8_t) (64 + 191 * bit_length(count) / max_bits);
+}
+
+bool MemoryMap_write_heatmap(const Machine *const m, const MemoryAccess access, FILE *file) {
+    if (!MemoryMap_enabled()) {
+        return false;
+    }
+    if (access < MEMORY_ACCESS_COUNT) {
+        const uint32_t *counts = MemoryMap_get(m, access);
+        const uint32_t max_bits = bit_length(max_count(counts));
+        fprintf(file, "P5\n%d %d\n255\n", HEATMAP_SIDE, HEATMAP_SIDE);
+        for (uint32_t address = 0; address < RAM_SIZE; address++) {
+            fputc(brightness(counts[address], max_bits), file);
+        }
+        return true;
+    }
+
+    // Channel order in the file is red, green, blue
+    const MemoryAccess channels[] = {MEMORY_WRITE, MEMORY_EXECUTE, MEMORY_READ};
+    uint32_t max_bits[3];
+    for (int c = 0; c < 3; c++) {
+        max_bits[c] = bit_length(max_count(MemoryMap_get(m, channels[c])));
+    }
+    fprintf(file, "P6\n%d %d\n255\n", HEATMAP_SIDE, HEATMAP_SIDE);
+    for (uint32_t address = 0; address < RAM_SIZE; address++) {
+        for (int c = 0; c < 3; c++) {
+            fputc(brightness(MemoryMap_get(m, channels[c])[address], max_bits[c]), file);
+        }
+    }
+    return true;
+}
+
+bool MemoryMap_write_lcov(const Machine *const m, const char *source, FILE *file) {
+    const uint32_t *executes = MemoryMap_get(m, MEMORY_EXECUTE);
+    if (!executes) {
+        return false;
+    }
+    uint32_t hit = 0;
+    fprintf(file, "TN:\nSF:%s\n", source);
+    for (uint32_t i = 0; i < m->code.n_lines; i++) {
+        const uint32_t hits = executes[m->code.lines[i].address];
+        fprintf(file, "DA:%u,%u\n", i + 1, hits);
+        hit += hits != 0;
+    }
+    fprintf(file, "LF:%u\nLH:%u\nend_of_record\n", m->code.n_lines, hit);
+    return true;
+}
+
+void MemoryMap_write_listing(const Machine *const m, FILE *file) {
+    for (uint32_t i = 0; i < m->code.n_lines; i++) {
+        fprintf(file, "%s\n", m->code.lines[i].line);
+    }
+}
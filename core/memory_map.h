@@ -0,0 +1,84 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_MEMORY_MAP_H
+#define INC_6502_EMULATOR_MEMORY_MAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct Machine Machine;
+
+/*
+ * Per-address read, write and execute counters, only collected when the core is built with
+ * CPU_MEMORY_MAP (cmake -DCPU_MEMORY_MAP=ON). Without it the counting macros expand to nothing and
+ * the machine has no counters at all. Counters saturate instead of wrapping.
+ *
+ * Only accesses made by the cpu count (CPU_read/CPU_write), not loading images, debugger reads or
+ * the reset, IRQ/NMI and BRK vector fetches. Reads include instruction fetches, executes count the
+ * opcode byte of every instruction run.
+ */
+typedef enum MemoryAccess {
+    MEMORY_READ,
+    MEMORY_WRITE,
+    MEMORY_EXECUTE,
+    MEMORY_ACCESS_COUNT
+} MemoryAccess;
+
+#ifdef CPU_MEMORY_MAP
+#define MEMORY_MAP_ADD(m, access, addr) do { \
+uint32_t *counter_ = &(m)->memory_map[(access)][(addr)]; \
+*counter_ += *counter_ != UINT32_MAX; \
+} while (0)
+#else
+#define MEMORY_MAP_ADD(m, access, addr) ((void) 0)
+#endif
+
+typedef struct MemoryCoverage {
+    // Bytes of executed instructions (opcode and operands)
+    uint32_t code_bytes;
+    // Bytes read or written that are not code
+    uint32_t data_bytes;
+    // Pages with any access at all
+    uint32_t pages_touched;
+    // Disassembly lines (see Disassembler_parse_section) and how many of them ran
+    uint32_t lines;
+    uint32_t lines_hit;
+} MemoryCoverage;
+
+// Whether the counters were compiled in
+bool MemoryMap_enabled(void);
+
+/**
+ * RAM_SIZE counters of one kind for `m`, address 0x0000 first.
+ * @return NULL when the counters were not compiled in
+ */
+const uint32_t *MemoryMap_get(const Machine *m, MemoryAccess access);
+
+void MemoryMap_reset(Machine *m);
+
+// false when the counters were not compiled in
+bool MemoryMap_get_coverage(const Machine *m, MemoryCoverage *coverage);
+
+/**
+ * Write a 256x256 heatmap, one pixel per address with a row per page, brightness on a log scale
+ * of the count. A single access kind gives a binary PGM (P5), MEMORY_ACCESS_COUNT a binary PPM
+ * (P6) with writes in red, executes in green and reads in blue.
+ * @return false when the counters were not compiled in
+ */
+bool MemoryMap_write_heatmap(const Machine *m, MemoryAccess access, FILE *file);
+
+/**
+ * Write an lcov tracefile for the current disassembly with `source` as the file name, line N
+ * being the Nth disassembled line (see MemoryMap_write_listing) and its hits the executes of the
+ * line's address.
+ * @return false when the counters were not compiled in
+ */
+bool MemoryMap_write_lcov(const Machine *m, const char *source, FILE *file);
+
+// The disassembly, one line per line as referred to by MemoryMap_write_lcov
+void MemoryMap_write_listing(const Machine *m, FILE *file);
+
+#endif //INC_6502_EMULATOR_MEMORY_MAP_H
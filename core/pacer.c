@@ -0,0 +1,90 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "pacer.h"
+
+#include <errno.h>
+
+#define NS_PER_SECOND 1000000000ULL
+
+static uint64_t to_ns(const struct timespec *ts) {
+    return (uint64_t) ts->tv_sec * NS_PER_SECOND + (uint64_t) ts->tv_nsec;
+}
+
+static struct timespec from_ns(const uint64_t ns) {
+    return (struct timespec){.tv_sec = (time_t) (ns / NS_PER_SECOND), .tv_nsec = (long) (ns % NS_PER_SECOND)};
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return to_ns(&ts);
+}
+
+// Wall time `cycles` take at `hz`, split so it does not overflow for any realistic run
+static uint64_t cycles_to_ns(const uint64_t cycles, const uint32_t hz) {
+    return cycles / hz * NS_PER_SECOND + cycles % hz * NS_PER_SECOND / hz;
+}
+
+void Pacer_start(Pacer *p, const uint32_t hz) {
+    *p = (Pacer){.hz = hz ? hz : 1};
+    p->slice_cycles = (uint64_t) p->hz * PACER_SLICE_NS / NS_PER_SECOND;
+    if (p->slice_cycles == 0) {
+        p->slice_cycles = 1;
+    }
+    p->start_ns = now_ns();
+    p->origin = from_ns(p->start_ns);
+}
+
+uint64_t Pacer_slice_cycles(const Pacer *p) {
+    return p->slice_cycles;
+}
+
+void Pacer_wait(Pacer *p, const uint64_t cycles) {
+    if (Pacer_account(p, cycles)) {
+        const struct timespec until = from_ns(p->deadline_ns);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+        }
+    }
+    Pacer_resume(p);
+}
+
+uint64_t Pacer_account(Pacer *p, const uint64_t cycles) {
+    p->cycles += cycles;
+    p->stats.cycles += cycles;
+    p->stats.slices++;
+
+    const uint64_t deadline = to_ns(&p->origin) + cycles_to_ns(p->cycles, p->hz);
+    const uint64_t now = now_ns();
+    p->wait_from_ns = now;
+    if (now <= deadline) {
+        p->deadline_ns = deadline;
+        return deadline - now;
+    }
+    const uint64_t lag = now - deadline;
+    p->deadline_ns = 0;
+    p->stats.late_slices++;
+    p->stats.max_lag_ns = lag > p->stats.max_lag_ns ? lag : p->stats.max_lag_ns;
+    if (lag > PACER_MAX_LAG_NS) {
+        p->stats.resyncs++;
+        p->origin = from_ns(now);
+        p->cycles = 0;
+    }
+    return 0;
+}
+
+void Pacer_resume(Pacer *p) {
+    const uint64_t now = now_ns();
+    if (p->deadline_ns) {
+        p->stats.sleep_ns += now - p->wait_from_ns;
+        p->stats.oversleep_ns += now > p->deadline_ns ? now - p->deadline_ns : 0;
+        p->deadline_ns = 0;
+    }
+    p->stats.elapsed_ns = now - p->start_ns;
+    p->stats.drift_ns = (int64_t) (now - to_ns(&p->origin)) - (int64_t) cycles_to_ns(p->cycles, p->hz);
+}
+
+double Pacer_speed(const PacerStats *stats, const uint32_t hz) {
+    return stats->elapsed_ns ? (double) cycles_to_ns(stats->cycles, hz) / (double) stats->elapsed_ns : 0;
+}
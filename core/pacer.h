@@ -0,0 +1,76 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_PACER_H
+#define INC_6502_EMULATOR_PACER_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Real-time pacing for a run loop. The loop runs Pacer_slice_cycles cycles at a time and hands
+ * the cycles it actually ran to Pacer_wait, which sleeps until the wall clock catches up with the
+ * emulated one. Deadlines are absolute and derived from the total emulated cycles, so sleeping
+ * late or running a slice long is made up for by the next slices instead of adding up. When the
+ * host falls further behind than PACER_MAX_LAG_NS (e.g. the process was suspended) the pacer
+ * restarts its clock rather than running flat out until it has caught up.
+ *
+ * Loops that cannot block, like one driven by an event loop timer, split Pacer_wait in two: wait
+ * for what Pacer_account returns in their own way, then call Pacer_resume.
+ */
+#define PACER_SLICE_NS 1000000
+#define PACER_MAX_LAG_NS 50000000
+
+typedef struct PacerStats {
+    uint64_t cycles;
+    uint64_t slices;
+    // Slices that finished after their deadline had already passed
+    uint64_t late_slices;
+    // Times the clock was restarted after falling behind too far
+    uint64_t resyncs;
+    // Wall time since Pacer_start, and the part of it spent sleeping
+    uint64_t elapsed_ns;
+    uint64_t sleep_ns;
+    // Worst lateness of a slice, how late sleeps woke up in total
+    uint64_t max_lag_ns;
+    uint64_t oversleep_ns;
+    // Wall time minus emulated time since the last (re)start of the clock, ideally 0
+    int64_t drift_ns;
+} PacerStats;
+
+typedef struct Pacer {
+    uint32_t hz;
+    uint64_t slice_cycles;
+    struct timespec origin;
+    // Emulated cycles since origin
+    uint64_t cycles;
+    uint64_t start_ns;
+    // When the last Pacer_account was made and the deadline it asked to wait for, 0 if none
+    uint64_t wait_from_ns;
+    uint64_t deadline_ns;
+    PacerStats stats;
+} Pacer;
+
+// Pace to `hz` emulated cycles per second from now on
+void Pacer_start(Pacer *p, uint32_t hz);
+
+// Cycles to run before the next Pacer_wait
+uint64_t Pacer_slice_cycles(const Pacer *p);
+
+// Account for `cycles` just run and sleep until they are due
+void Pacer_wait(Pacer *p, uint64_t cycles);
+
+/**
+ * Account for `cycles` just run without sleeping.
+ * @return ns until they are due, 0 when that has already passed
+ */
+uint64_t Pacer_account(Pacer *p, uint64_t cycles);
+
+// Carry on after waiting for what Pacer_account returned
+void Pacer_resume(Pacer *p);
+
+// Emulated time divided by wall time since Pacer_start, 1.0 when exactly on time
+double Pacer_speed(const PacerStats *stats, uint32_t hz);
+
+#endif //INC_6502_EMULATOR_PACER_H
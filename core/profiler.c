@@ -0,0 +1,257 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "profiler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dbg.h"
+#include "disassembler.h"
+#include "machine.h"
+
+#define NO_NODE UINT32_MAX
+#define INITIAL_NODES 1024
+
+#define OPCODE_BRK 0x00
+#define OPCODE_JSR 0x20
+#define OPCODE_RTI 0x40
+#define OPCODE_RTS 0x60
+
+typedef struct Hotspot {
+    uint64_t cycles;
+    uint16_t pc;
+} Hotspot;
+
+static uint32_t hash_node(const uint32_t parent, const uint16_t address, const uint8_t kind, const uint32_t size) {
+    return ((parent * 0x9E3779B1u) ^ (address * 0x85EBCA6Bu) ^ kind) & (size - 1);
+}
+
+static bool grow_index(Profiler *p) {
+    const uint32_t size = p->index_size * 2;
+    uint32_t *index = malloc(size * sizeof(uint32_t));
+    check_mem_return(index, false);
+    memset(index, 0xFF, size * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < p->n_nodes; i++) {
+        const ProfilerNode *node = &p->nodes[i];
+        uint32_t slot = hash_node(node->parent, node->address, node->kind, size);
+        while (index[slot] != NO_NODE) {
+            slot = (slot + 1) & (size - 1);
+        }
+        index[slot] = i;
+    }
+    free(p->index);
+    p->index = index;
+    p->index_size = size;
+    return true;
+}
+
+static uint32_t add_node(Profiler *p, const uint32_t parent, const uint16_t address, const uint8_t kind) {
+    if (p->n_nodes == p->capacity) {
+        if (p->capacity == PROFILER_MAX_NODES) {
+            return NO_NODE;
+        }
+        ProfilerNode *nodes = realloc(p->nodes, p->capacity * 2 * sizeof(ProfilerNode));
+        check_mem_return(nodes, NO_NODE);
+        p->nodes = nodes;
+        p->capacity *= 2;
+    }
+    p->nodes[p->n_nodes] = (ProfilerNode){.parent = parent, .address = address, .kind = kind};
+    return p->n_nodes++;
+}
+
+// The node for calling `address` from `parent`, created on first use
+static uint32_t get_child(Profiler *p, const uint32_t parent, const uint16_t address, const uint8_t kind) {
+    uint32_t slot = hash_node(parent, address, kind, p->index_size);
+    while (p->index[slot] != NO_NODE) {
+        const ProfilerNode *node = &p->nodes[p->index[slot]];
+        if (node->parent == parent && node->address == address && node->kind == kind) {
+            return p->index[slot];
+        }
+        slot = (slot + 1) & (p->index_size - 1);
+    }
+
+    const uint32_t child = add_node(p, parent, address, kind);
+    if (child == NO_NODE) {
+        return NO_NODE;
+    }
+    p->index[slot] = child;
+    // Keep the load factor at or below one half
+    if (p->n_nodes * 2 > p->index_size) {
+        grow_index(p);
+    }
+    return child;
+}
+
+static void push_frame(Profiler *p, const ProfilerFrameKind kind, const uint16_t address, const uint8_t sp) {
+    if (p->depth == PROFILER_MAX_DEPTH) {
+        return;
+    }
+    const uint32_t parent = p->stack[p->depth - 1].node;
+    uint32_t node = get_child(p, parent, address, kind);
+    if (node == NO_NODE) {
+        // Out of nodes, keep charging the caller but stay balanced
+        node = parent;
+    }
+    p->stack[p->depth++] = (ProfilerFrame){.node = node, .sp = sp};
+}
+
+static void pop_frames(Profiler *p, const uint8_t sp) {
+    while (p->depth > 1 && p->stack[p->depth - 1].sp <= sp) {
+        p->depth--;
+    }
+}
+
+bool Profiler_start(Machine *const m) {
+    Profiler_stop(m);
+
+    Profiler *p = calloc(1, sizeof(Profiler));
+    check_mem_return(p, false);
+    p->nodes = malloc(INITIAL_NODES * sizeof(ProfilerNode));
+    p->index = malloc(INITIAL_NODES * 2 * sizeof(uint32_t));
+    check_mem(p->nodes && p->index, {
+        free(p->nodes);
+        free(p->index);
+        free(p);
+        return false;
+    });
+    p->capacity = INITIAL_NODES;
+    p->index_size = INITIAL_NODES * 2;
+    memset(p->index, 0xFF, p->index_size * sizeof(uint32_t));
+
+    add_node(p, NO_NODE, m->cpu.pc, PROFILER_FRAME_ROOT);
+    p->stack[0] = (ProfilerFrame){.node = 0, .sp = m->cpu.sp};
+    p->depth = 1;
+    m->profiler = p;
+    log_info("Profiler started at %04X", m->cpu.pc);
+    return true;
+}
+
+void Profiler_stop(Machine *const m) {
+    Profiler *p = m->profiler;
+    if (!p) {
+        return;
+    }
+    m->profiler = NULL;
+    free(p->nodes);
+    free(p->index);
+    free(p);
+}
+
+bool Profiler_is_running(const Machine *const m) {
+    return m->profiler != NULL;
+}
+
+void Profiler_record(Machine *const m, const uint16_t pc, const uint8_t opcode, const uint8_t cycles) {
+    Profiler *p = m->profiler;
+    p->pc_cycles[pc] += cycles;
+    p->pc_executed[pc]++;
+    p->total_cycles += cycles;
+    p->nodes[p->stack[p->depth - 1].node].self_cycles += cycles;
+
+    // The instruction has run, so calls are charged to the caller and returns to the callee
+    switch (opcode) {
+        case OPCODE_JSR:
+            push_frame(p, PROFILER_FRAME_CALL, m->cpu.pc, m->cpu.sp + 2);
+            break;
+        case OPCODE_BRK:
+            push_frame(p, PROFILER_FRAME_BRK, m->cpu.pc, m->cpu.sp + 3);
+            break;
+        case OPCODE_RTS:
+        case OPCODE_RTI:
+            pop_frames(p, m->cpu.sp);
+            break;
+        default:
+            break;
+    }
+}
+
+void Profiler_interrupt(Machine *const m, const ProfilerFrameKind kind, const uint8_t cycles) {
+    Profiler *p = m->profiler;
+    push_frame(p, kind, m->cpu.pc, m->cpu.sp + 3);
+    p->total_cycles += cycles;
+    p->nodes[p->stack[p->depth - 1].node].self_cycles += cycles;
+}
+
+// The disassembled instruction at `address` or just the address if it was not disassembled
+static void write_line(const Machine *m, const uint16_t address, FILE *file) {
+    const int32_t index = Disassembler_find_line(m, address);
+    if (index < 0 || m->code.lines[index].address != address) {
+        fprintf(file, "%04X", address);
+    } else {
+        fputs(m->code.lines[index].line, file);
+    }
+}
+
+static void write_frame_name(const Machine *m, const ProfilerNode *node, FILE *file) {
+    switch (node->kind) {
+        case PROFILER_FRAME_BRK: fputs("[brk] ", file); break;
+        case PROFILER_FRAME_IRQ: fputs("[irq] ", file); break;
+        case PROFILER_FRAME_NMI: fputs("[nmi] ", file); break;
+        default: break;
+    }
+
+    // ';' separates frames and never occurs in a disassembled line
+    write_line(m, node->address, file);
+}
+
+bool Profiler_write_collapsed(const Machine *const m, FILE *file) {
+    const Profiler *p = m->profiler;
+    if (!p) {
+        return false;
+    }
+
+    uint32_t path[PROFILER_MAX_DEPTH];
+    for (uint32_t i = 0; i < p->n_nodes; i++) {
+        if (!p->nodes[i].self_cycles) {
+            continue;
+        }
+        uint32_t depth = 0;
+        for (uint32_t node = i; node != NO_NODE && depth < PROFILER_MAX_DEPTH; node = p->nodes[node].parent) {
+            path[depth++] = node;
+        }
+        while (depth--) {
+            write_frame_name(m, &p->nodes[path[depth]], file);
+            fputc(depth ? ';' : ' ', file);
+        }
+        fprintf(file, "%llu\n", (unsigned long long) p->nodes[i].self_cycles);
+    }
+    return true;
+}
+
+static int compare_hotspots(const void *a, const void *b) {
+    const uint64_t x = ((const Hotspot *) a)->cycles;
+    const uint64_t y = ((const Hotspot *) b)->cycles;
+    return (x < y) - (x > y);
+}
+
+bool Profiler_write_hotspots(const Machine *const m, FILE *file, const uint32_t limit) {
+    const Profiler *p = m->profiler;
+    if (!p) {
+        return false;
+    }
+
+    Hotspot *hotspots = malloc(0x10000 * sizeof(Hotspot));
+    check_mem_return(hotspots, false);
+    uint32_t n = 0;
+    for (uint32_t pc = 0; pc <= 0xFFFF; pc++) {
+        if (p->pc_executed[pc]) {
+            hotspots[n++] = (Hotspot){.cycles = p->pc_cycles[pc], .pc = pc};
+        }
+    }
+    qsort(hotspots, n, sizeof(Hotspot), compare_hotspots);
+
+    const uint32_t count = limit && limit < n ? limit : n;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint16_t pc = hotspots[i].pc;
+        const double share = p->total_cycles ? 100.0 * (double) hotspots[i].cycles / (double) p->total_cycles : 0;
+        fprintf(file, "%llu\t%.2f%%\t%llu\t", (unsigned long long) hotspots[i].cycles, share,
+                (unsigned long long) p->pc_executed[pc]);
+        write_line(m, pc, file);
+        fputc('\n', file);
+    }
+    free(hotspots);
+    return true;
+}
@@ -0,0 +1,90 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_PROFILER_H
+#define INC_6502_EMULATOR_PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct Machine Machine;
+
+#define PROFILER_MAX_DEPTH 256
+#define PROFILER_MAX_NODES 65536
+
+typedef enum ProfilerFrameKind {
+    PROFILER_FRAME_ROOT,
+    PROFILER_FRAME_CALL,
+    PROFILER_FRAME_BRK,
+    PROFILER_FRAME_IRQ,
+    PROFILER_FRAME_NMI
+} ProfilerFrameKind;
+
+/*
+ * One call path, i.e. a node of the call tree. The same routine reached along two different
+ * paths gets two nodes, which is what makes the collapsed stacks exact.
+ */
+typedef struct ProfilerNode {
+    uint32_t parent;
+    uint16_t address;
+    uint8_t kind;
+    // Cycles of the instructions executed while this was the innermost frame
+    uint64_t self_cycles;
+} ProfilerNode;
+
+typedef struct ProfilerFrame {
+    uint32_t node;
+    // Stack pointer before the call, the frame is gone once sp is back above it
+    uint8_t sp;
+} ProfilerFrame;
+
+/*
+ * Guest level profiler following JSR/RTS, BRK/IRQ/NMI and RTI with a shadow call stack.
+ * Every instruction's cycles are charged to its pc and to the call path it runs in.
+ * Returning pops frames by stack pointer rather than one per RTS, so code that drops its return
+ * address (PLA PLA) or jumps through RTS does not derail it.
+ */
+typedef struct Profiler {
+    uint64_t pc_cycles[0x10000];
+    uint64_t pc_executed[0x10000];
+    ProfilerNode *nodes;
+    uint32_t n_nodes;
+    uint32_t capacity;
+    // Open addressing (parent, address, kind) -> node, size is a power of two
+    uint32_t *index;
+    uint32_t index_size;
+    ProfilerFrame stack[PROFILER_MAX_DEPTH];
+    uint16_t depth;
+    uint64_t total_cycles;
+} Profiler;
+
+/**
+ * Start profiling `m` from its current pc, which becomes the root of the call tree.
+ * Clears the previous profile if one is running.
+ * @return false if out of memory
+ */
+bool Profiler_start(Machine *m);
+// Stop profiling and release the profile
+void Profiler_stop(Machine *m);
+bool Profiler_is_running(const Machine *m);
+
+// Called by the cpu after an instruction at `pc` that took `cycles`, m->cpu is past it already
+void Profiler_record(Machine *m, uint16_t pc, uint8_t opcode, uint8_t cycles);
+// Called by the cpu after a hardware interrupt moved pc to its handler
+void Profiler_interrupt(Machine *m, ProfilerFrameKind kind, uint8_t cycles);
+
+/**
+ * Write the profile as collapsed stacks ("frame;frame;frame cycles" per line) for flamegraph.pl,
+ * speedscope and friends. Frames are named after the disassembled first instruction of the routine.
+ */
+bool Profiler_write_collapsed(const Machine *m, FILE *file);
+
+/**
+ * Write the `limit` hottest instructions (0 for all executed ones) as cycles, share of the total,
+ * times executed and the disassembled line, tab separated.
+ */
+bool Profiler_write_hotspots(const Machine *m, FILE *file, uint32_t limit);
+
+#endif //INC_6502_EMULATOR_PROFILER_H
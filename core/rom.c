@@ -10,20 +10,31 @@
 #include "dbg.h"
 
 void ROM_from_file(ROM *const rom, const char *filename) {
-    // Open the file
-    char *file_path = calloc(64, sizeof(char));
-    strncat(file_path, ROMS_DIR, 64);
-    strncat(file_path, filename, 64);
+    // Bare file names are looked up in the examples, anything with a directory is used as is
+    const char *dir = strchr(filename, '/') ? "" : ROMS_DIR;
+    const size_t path_size = strlen(dir) + strlen(filename) + 1;
+    char *file_path = malloc(path_size);
+    check_mem(file_path, return);
+    snprintf(file_path, path_size, "%s%s", dir, filename);
     FILE *file = fopen(file_path, "rb");
-    check(file, "Failed to open file", return);
+    check(file, "Failed to open file %s", {
+        free(file_path);
+        return;
+    }, file_path);
 
     fseek(file, 0, SEEK_END);
     const long file_size = ftell(file);
     rewind(file);
+    check(file_size > 0 && file_size <= ROM_MAX_SIZE, "Rom %s has an invalid size %ld", {
+        fclose(file);
+        free(file_path);
+        return;
+    }, file_path, file_size);
 
     uint8_t *bytes = calloc(file_size, sizeof(uint8_t));
     check_mem(bytes, {
         fclose(file);
+        free(file_path);
         return;
     });
 
@@ -32,14 +43,11 @@ void ROM_from_file(ROM *const rom, const char *filename) {
     fclose(file);
 
     /*
-     * The start of the program is located at 0xFFFC (almost at the very end).
+     * The vectors live at the very end of memory, so the image ends at 0xFFFF. The program starts
+     * wherever the reset vector at 0xFFFC points to (which is the first byte for the small roms).
      */
-    const uint16_t index_org = file_size - 3;
-    const uint16_t org_hi = bytes[index_org];
-    const uint16_t org_lo = bytes[index_org - 1];
-
-    rom->start = org_hi << 8 | org_lo;
+    rom->start = ROM_MAX_SIZE - file_size;
+    rom->end = ROM_MAX_SIZE - 1;
     rom->data = bytes;
     rom->file = file_path;
-    rom->end = rom->start + (file_size - 1);
 }
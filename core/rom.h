@@ -8,6 +8,8 @@
 #include <stdint.h>
 
 #define ROMS_DIR "../resources/examples/"
+// A rom image covers at most the whole address space
+#define ROM_MAX_SIZE 0x10000
 
 typedef struct ROM {
     uint8_t *data;
@@ -21,9 +23,10 @@ typedef struct ROM {
  * all interrupt handlers and pc start specified in the data. That means
  * that at the very least, the reset vector (0xFFFC) must be set. If the program
  * Uses an irq handler and/or depends on nmi handler, then those addresses (0xFFFE, 0xFFFA)
- * must also be specified.
- * @param rom the rom to populate (out parameter)
- * @param filename path to binary file
+ * must also be specified. The image is mapped so that its last byte lands at 0xFFFF, a 64K image
+ * covers all of memory.
+ * @param rom the rom to populate (out parameter), data is NULL if the file could not be read
+ * @param filename path to binary file, names without a directory are looked up in ROMS_DIR
  */
 void ROM_from_file(ROM *rom, const char *filename);
 
@@ -0,0 +1,254 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "savestate.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dbg.h"
+#include "events.h"
+#include "machine.h"
+
+#define RAM_PAGE_SIZE 0x100
+#define N_PAGES (RAM_SIZE / RAM_PAGE_SIZE)
+#define CHECKSUM_SEED 0xCBF29CE484222325ULL
+#define CHECKSUM_PRIME 0x100000001B3ULL
+
+// The checksum works a 64 bit word at a time
+_Static_assert(sizeof(SaveStateHeader) % 8 == 0, "SaveStateHeader is not a multiple of 8 bytes");
+_Static_assert(sizeof(SaveStateDevice) % 8 == 0, "SaveStateDevice is not a multiple of 8 bytes");
+
+static size_t padded(const size_t size) {
+    return (size + 7) & ~(size_t) 7;
+}
+
+// FNV style over whole words, `size` is a multiple of 8
+static uint64_t checksum_update(uint64_t hash, const uint8_t *data, const size_t size) {
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * CHECKSUM_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t checksum(const uint8_t *data, const size_t size) {
+    SaveStateHeader header;
+    memcpy(&header, data, sizeof(header));
+    header.checksum = 0;
+    const uint64_t hash = checksum_update(CHECKSUM_SEED, (const uint8_t *) &header, sizeof(header));
+    return checksum_update(hash, data + sizeof(header), size - sizeof(header));
+}
+
+static bool page_is_zero(const uint8_t *page) {
+    uint64_t any = 0;
+    for (int i = 0; i < RAM_PAGE_SIZE; i += 8) {
+        uint64_t word;
+        memcpy(&word, page + i, sizeof(word));
+        any |= word;
+    }
+    return any == 0;
+}
+
+static bool has_page(const SaveStateHeader *header, const int page) {
+    return header->pages[page >> 3] & (1 << (page & 7));
+}
+
+size_t SaveState_size(const Machine *m) {
+    size_t size = sizeof(SaveStateHeader);
+    for (int page = 0; page < N_PAGES; page++) {
+        if (!page_is_zero(&m->ram[page * RAM_PAGE_SIZE])) {
+            size += RAM_PAGE_SIZE;
+        }
+    }
+    for (int i = 0; i < m->n_devices; i++) {
+        const Device *d = &m->devices[i];
+        if (d->save) {
+            size += sizeof(SaveStateDevice) + padded(d->save(m, d->ctx, NULL));
+        }
+    }
+    return size;
+}
+
+size_t SaveState_save(const Machine *m, uint8_t *out, const size_t capacity) {
+    const size_t size = SaveState_size(m);
+    check_return(size <= capacity, "Save-state needs %zu bytes, got %zu", 0, size, capacity);
+
+    SaveStateHeader header = {
+        .magic = SAVESTATE_MAGIC,
+        .version = SAVESTATE_VERSION,
+        .header_size = sizeof(SaveStateHeader),
+        .size = size,
+        .cpu = m->cpu,
+    };
+    // Zero padded by the initialiser, no terminator when the name fills the field
+    const char *model = CPU_get_model();
+    memcpy(header.model, model, strnlen(model, sizeof(header.model)));
+
+    size_t offset = sizeof(header);
+    for (int page = 0; page < N_PAGES; page++) {
+        const uint8_t *data = &m->ram[page * RAM_PAGE_SIZE];
+        if (!page_is_zero(data)) {
+            header.pages[page >> 3] |= 1 << (page & 7);
+            header.n_pages++;
+            memcpy(out + offset, data, RAM_PAGE_SIZE);
+            offset += RAM_PAGE_SIZE;
+        }
+    }
+    for (int i = 0; i < m->n_devices; i++) {
+        const Device *d = &m->devices[i];
+        if (!d->save) {
+            continue;
+        }
+        SaveStateDevice section = {.size = d->save(m, d->ctx, NULL)};
+        memcpy(section.name, d->name, strnlen(d->name, sizeof(section.name) - 1));
+        memcpy(out + offset, &section, sizeof(section));
+        offset += sizeof(section);
+        d->save(m, d->ctx, out + offset);
+        memset(out + offset + section.size, 0, padded(section.size) - section.size);
+        offset += padded(section.size);
+        header.n_devices++;
+    }
+
+    memcpy(out, &header, sizeof(header));
+    header.checksum = checksum(out, size);
+    memcpy(out, &header, sizeof(header));
+    return size;
+}
+
+// Where the device sections start, 0 if the header does not describe a save-state of `size` bytes
+static size_t validate_header(const SaveStateHeader *header, const size_t size) {
+    check_return(memcmp(header->magic, SAVESTATE_MAGIC, sizeof(header->magic)) == 0, "Not a save-state", 0);
+    check_return(header->version == SAVESTATE_VERSION && header->header_size == sizeof(SaveStateHeader),
+                 "Save-state version %u is not supported", 0, header->version);
+    check_return(header->size == size, "Save-state is %zu bytes, expected %llu", 0, size,
+                 (unsigned long long) header->size);
+    check_return(strncmp(header->model, CPU_get_model(), sizeof(header->model)) == 0,
+                 "Save-state is for a %.8s, this is a %s", 0, header->model, CPU_get_model());
+
+    uint32_t n_pages = 0;
+    for (int page = 0; page < N_PAGES; page++) {
+        n_pages += has_page(header, page);
+    }
+    check_return(n_pages == header->n_pages, "Save-state page bitmap is corrupt", 0);
+    const size_t devices = sizeof(SaveStateHeader) + (size_t) n_pages * RAM_PAGE_SIZE;
+    check_return(devices <= size, "Save-state is truncated", 0);
+    return devices;
+}
+
+// The data of the device section called `name` and its size in `size`, NULL if there is none
+static const uint8_t *find_section(const uint8_t *data, const size_t offset, const uint32_t n_devices,
+                                   const char *name, size_t *size) {
+    size_t at = offset;
+    for (uint32_t i = 0; i < n_devices; i++) {
+        // Copied out, `data` need not be aligned
+        SaveStateDevice section;
+        memcpy(&section, data + at, sizeof(section));
+        if (strncmp(section.name, name, sizeof(section.name)) == 0) {
+            *size = section.size;
+            return data + at + sizeof(section);
+        }
+        at += sizeof(section) + padded(section.size);
+    }
+    return NULL;
+}
+
+bool SaveState_load(Machine *m, const uint8_t *data, const size_t size) {
+    check_return(size >= sizeof(SaveStateHeader) && size % 8 == 0, "Not a save-state", false);
+    SaveStateHeader header;
+    memcpy(&header, data, sizeof(header));
+    const size_t devices = validate_header(&header, size);
+    if (!devices) {
+        return false;
+    }
+    size_t offset = devices;
+    for (uint32_t i = 0; i < header.n_devices; i++) {
+        check_return(size - offset >= sizeof(SaveStateDevice), "Save-state is truncated", false);
+        SaveStateDevice section;
+        memcpy(&section, data + offset, sizeof(section));
+        check_return(memchr(section.name, 0, sizeof(section.name)), "Save-state device name is corrupt", false);
+        check_return(size - offset - sizeof(section) >= padded(section.size), "Save-state is truncated", false);
+        offset += sizeof(section) + padded(section.size);
+    }
+    check_return(offset == size, "Save-state has trailing data", false);
+    check_return(checksum(data, size) == header.checksum, "Save-state checksum does not match", false);
+
+    m->cpu = header.cpu;
+    const uint8_t *page_data = data + sizeof(header);
+    for (int page = 0; page < N_PAGES; page++) {
+        if (has_page(&header, page)) {
+            memcpy(&m->ram[page * RAM_PAGE_SIZE], page_data, RAM_PAGE_SIZE);
+            page_data += RAM_PAGE_SIZE;
+        } else {
+            memset(&m->ram[page * RAM_PAGE_SIZE], 0, RAM_PAGE_SIZE);
+        }
+    }
+    memset(m->dirty_pages, 0xFF, BUS_DIRTY_BITMAP_SIZE);
+    m->generation++;
+
+    // Pending events were timed against the old cycle count, the devices schedule theirs again
+    Events_reset(m);
+    bool loaded = true;
+    for (int i = 0; i < m->n_devices; i++) {
+        Device *d = &m->devices[i];
+        if (!d->load) {
+            continue;
+        }
+        size_t section_size = 0;
+        const uint8_t *section = find_section(data, devices, header.n_devices, d->name, &section_size);
+        if (!d->load(m, d->ctx, section, section_size)) {
+            log_err("Save-state of %s does not fit, it is reset instead", d->name);
+            d->reset(m, d->ctx);
+            loaded = false;
+        }
+    }
+    offset = devices;
+    for (uint32_t i = 0; i < header.n_devices; i++) {
+        SaveStateDevice section;
+        memcpy(&section, data + offset, sizeof(section));
+        if (!BUS_find_device(m, section.name)) {
+            log_warn("Save-state has a %s, the machine does not", section.name);
+        }
+        offset += sizeof(section) + padded(section.size);
+    }
+    return loaded;
+}
+
+bool SaveState_write_file(const Machine *m, const char *path) {
+    const size_t size = SaveState_size(m);
+    uint8_t *data = malloc(size);
+    check_mem_return(data, false);
+    SaveState_save(m, data, size);
+
+    FILE *file = fopen(path, "wb");
+    check(file, "Could not open %s", free(data); return false, path);
+    const bool written = fwrite(data, 1, size, file) == size;
+    fclose(file);
+    free(data);
+    check_return(written, "Could not write %s", false, path);
+    return true;
+}
+
+bool SaveState_read_file(Machine *m, const char *path) {
+    const int fd = open(path, O_RDONLY);
+    check_return(fd >= 0, "Could not open %s", false, path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(SaveStateHeader)) {
+        close(fd);
+        log_err("%s is not a save-state", path);
+        return false;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    check_return(data != MAP_FAILED, "Could not map %s", false, path);
+    const bool loaded = SaveState_load(m, data, st.st_size);
+    munmap(data, st.st_size);
+    return loaded;
+}
@@ -0,0 +1,78 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_SAVESTATE_H
+#define INC_6502_EMULATOR_SAVESTATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bus.h"
+#include "cpu.h"
+
+typedef struct Machine Machine;
+
+/*
+ * Everything needed to carry on running a machine later or elsewhere: the CPU (cycle count
+ * included), the RAM and the state of the mapped devices. Not included: breakpoints, the
+ * disassembly, profiles and traces, and host side buffers such as unread ACIA output or keys not
+ * taken yet.
+ *
+ * File: a SaveStateHeader, the pages flagged in its bitmap in ascending order (256 bytes each,
+ * all-zero pages are left out), then n_devices times a SaveStateDevice followed by its data,
+ * padded to a multiple of 8 bytes. Everything is stored the way it is laid out in memory on a
+ * little-endian host, so loading is a validation and a handful of memcpy calls, straight from an
+ * mmap of the file. The checksum covers the whole file, taken with the checksum field at 0.
+ * Any change to the layout of the header, the CPU or a device's data bumps SAVESTATE_VERSION.
+ */
+#define SAVESTATE_MAGIC "6502SAVE"
+#define SAVESTATE_VERSION 1
+#define SAVESTATE_DEVICE_NAME_SIZE 16
+
+typedef struct SaveStateHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t size;
+    uint64_t checksum;
+    // CPU_get_model of the build that saved it, a state only loads into the same model
+    char model[8];
+    uint32_t n_pages;
+    uint32_t n_devices;
+    CPU cpu;
+    // One bit per page that is stored, bit (page & 7) of byte (page >> 3)
+    uint8_t pages[BUS_DIRTY_BITMAP_SIZE];
+} SaveStateHeader;
+
+typedef struct SaveStateDevice {
+    char name[SAVESTATE_DEVICE_NAME_SIZE];
+    uint32_t size;
+    uint32_t reserved;
+} SaveStateDevice;
+
+// Bytes SaveState_save needs for the machine as it is now
+size_t SaveState_size(const Machine *m);
+
+/**
+ * Write the save-state of `m` to `out`.
+ * @return its size, 0 if it does not fit in `capacity` bytes
+ */
+size_t SaveState_save(const Machine *m, uint8_t *out, size_t capacity);
+
+/**
+ * Restore `m` from a save-state. The devices are matched by name and have to be mapped already,
+ * state for a device the machine does not have is skipped with a warning. Nothing is changed
+ * when the save-state does not check out, a device rejecting its state is reset.
+ * @return false if `data` is not a valid save-state for this build or a device rejected its state
+ */
+bool SaveState_load(Machine *m, const uint8_t *data, size_t size);
+
+// SaveState_save to a file
+bool SaveState_write_file(const Machine *m, const char *path);
+
+// SaveState_load from a file, mapped into memory rather than read
+bool SaveState_read_file(Machine *m, const char *path);
+
+#endif //INC_6502_EMULATOR_SAVESTATE_H
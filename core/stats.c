@@ -0,0 +1,97 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "stats.h"
+
+#include <string.h>
+
+#include "cpu.h"
+#include "machine.h"
+
+bool Stats_enabled(void) {
+#ifdef CPU_OPCODE_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+const uint64_t *Stats_get(const Machine *const m) {
+#ifdef CPU_OPCODE_STATS
+    return &m->opcode_stats[0][0];
+#else
+    (void) m;
+    return NULL;
+#endif
+}
+
+uint64_t Stats_get_addressing(const Machine *const m, const char *addressing, const Stat stat) {
+    const uint64_t *stats = Stats_get(m);
+    uint64_t total = 0;
+    for (int opcode = 0; stats && opcode <= 0xFF; opcode++) {
+        if (strcmp(Stats_addressing_name(opcode), addressing) == 0) {
+            total += stats[opcode * STAT_COUNT + stat];
+        }
+    }
+    return total;
+}
+
+void Stats_reset(Machine *const m) {
+#ifdef CPU_OPCODE_STATS
+    memset(m->opcode_stats, 0, sizeof(m->opcode_stats));
+#else
+    (void) m;
+#endif
+}
+
+const char *Stats_addressing_name(const uint8_t opcode) {
+    const Instruction *ins = CPU_get_instruction(opcode);
+    const addressing_fn addressing = ins->addressing;
+    if (ins->opcode == ILL) {
+        return "ILL";
+    }
+    if (addressing == IMP) return "IMP";
+    if (addressing == IMM) return "IMM";
+    if (addressing == ZP0) return "ZP0";
+    if (addressing == ZPX) return "ZPX";
+    if (addressing == ZPY) return "ZPY";
+    if (addressing == REL) return "REL";
+    if (addressing == ABS) return "ABS";
+    if (addressing == ABX) return "ABX";
+    if (addressing == ABY) return "ABY";
+    if (addressing == IND) return "IND";
+    if (addressing == IZX) return "IZX";
+    if (addressing == IZY) return "IZY";
+    if (addressing == IAX) return "IAX";
+    if (addressing == ZPI) return "ZPI";
+    return "???";
+}
+
+bool Stats_write_csv(const Machine *const m, FILE *file) {
+    const uint64_t *stats = Stats_get(m);
+    if (!stats) {
+        return false;
+    }
+
+    // Same header row as resources/opcodes.csv
+    for (int lo = 0; lo <= 0xF; lo++) {
+        fprintf(file, "\t0x%X", lo);
+    }
+    fprintf(file, "\n");
+
+    for (int hi = 0; hi <= 0xF; hi++) {
+        for (int lo = 0; lo <= 0xF; lo++) {
+            const uint8_t opcode = (hi << 4) | lo;
+            const Instruction *ins = CPU_get_instruction(opcode);
+            const uint64_t *s = &stats[opcode * STAT_COUNT];
+            fprintf(file, "%s%s,%02X,%s,%llu,%llu,%llu,%llu,%llu", lo ? "\t" : "",
+                    ins->opcode == ILL ? "ILL" : ins->name, opcode, Stats_addressing_name(opcode),
+                    (unsigned long long) s[STAT_EXECUTED], (unsigned long long) s[STAT_CYCLES],
+                    (unsigned long long) s[STAT_PAGE_CROSSES], (unsigned long long) s[STAT_BRANCHES_TAKEN],
+                    (unsigned long long) s[STAT_BRANCHES_NOT_TAKEN]);
+        }
+        fprintf(file, "\n");
+    }
+    return true;
+}
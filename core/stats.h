@@ -0,0 +1,59 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_STATS_H
+#define INC_6502_EMULATOR_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct Machine Machine;
+
+/*
+ * Per-opcode execution counters, only collected when the core is built with CPU_OPCODE_STATS
+ * (cmake -DCPU_OPCODE_STATS=ON). Without it the counting macros expand to nothing and the machine
+ * has no counters at all. Per addressing mode numbers are derived from the per-opcode ones.
+ */
+typedef enum Stat {
+    STAT_EXECUTED,
+    STAT_CYCLES,
+    // Extra cycles charged for crossing a page in ABX/ABY/IZY
+    STAT_PAGE_CROSSES,
+    STAT_BRANCHES_TAKEN,
+    STAT_BRANCHES_NOT_TAKEN,
+    STAT_COUNT
+} Stat;
+
+#ifdef CPU_OPCODE_STATS
+#define STATS_ADD(m, opcode, stat, n) ((m)->opcode_stats[(opcode)][(stat)] += (n))
+#else
+#define STATS_ADD(m, opcode, stat, n) ((void) 0)
+#endif
+
+// Whether the counters were compiled in
+bool Stats_enabled(void);
+
+/**
+ * The counters of `m`, STAT_COUNT consecutive values per opcode, opcode 0x00 first.
+ * @return NULL when the counters were not compiled in
+ */
+const uint64_t *Stats_get(const Machine *m);
+
+// Sum of `stat` over every opcode using the addressing mode called `addressing` (e.g. "ABX")
+uint64_t Stats_get_addressing(const Machine *m, const char *addressing, Stat stat);
+
+void Stats_reset(Machine *m);
+
+// Short name of an addressing mode function as used in resources/opcodes.csv ("IMM", "ABX", ...)
+const char *Stats_addressing_name(uint8_t opcode);
+
+/**
+ * Write the counters in the layout of resources/opcodes.csv, a 16x16 grid indexed by the high and
+ * low nibble of the opcode with cells NAME,OPCODE,MODE,executed,cycles,page crosses,taken,not taken
+ * @return false when the counters were not compiled in
+ */
+bool Stats_write_csv(const Machine *m, FILE *file);
+
+#endif //INC_6502_EMULATOR_STATS_H
@@ -0,0 +1,334 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu.h"
+#include "dbg.h"
+#include "machine.h"
+
+// Largest encoded record: flags, pc, opcode, 2 operands, 5 registers and a 10 byte varint
+#define TRACE_MAX_RECORD 21
+// How long the writer sleeps when it was not woken up by a finished block
+#define WRITER_POLL_NS 5000000
+
+typedef struct TraceSlot {
+    uint8_t data[TRACE_BLOCK_HEADER_SIZE + TRACE_BLOCK_SIZE];
+    uint32_t size;
+} TraceSlot;
+
+/*
+ * Single producer (the thread running the cpu), single consumer (the writer) ring of blocks.
+ * The producer fills ring[head % TRACE_RING_BLOCKS] and publishes it by bumping head, the writer
+ * consumes ring[tail % TRACE_RING_BLOCKS] and releases it by bumping tail. When the ring is full
+ * the producer drops records until a block is free again instead of waiting.
+ */
+struct Tracer {
+    TraceSlot *ring;
+    atomic_uint_fast64_t head;
+    atomic_uint_fast64_t tail;
+    atomic_bool stop;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    FILE *file;
+
+    // Producer side, the block being filled (NULL while dropping) and the previous record
+    TraceSlot *block;
+    uint8_t *cursor;
+    uint32_t n_records;
+    uint32_t block_flags;
+    uint64_t block_cycle;
+    bool first;
+    uint16_t next_pc;
+    uint8_t a, x, y, sp, status;
+    uint64_t cycle;
+    uint8_t operand_counts[256];
+
+    TraceStats stats;
+};
+
+static void write_u32(uint8_t *dst, const uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        dst[i] = (value >> (i * 8)) & 0xFF;
+    }
+}
+
+static void write_u64(uint8_t *dst, const uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        dst[i] = (value >> (i * 8)) & 0xFF;
+    }
+}
+
+static void *write_blocks(void *arg) {
+    Tracer *t = arg;
+    uint64_t tail = atomic_load(&t->tail);
+    while (true) {
+        // Read stop before head, once stop is seen the last block is visible as well
+        const bool stopping = atomic_load(&t->stop);
+        const uint64_t head = atomic_load(&t->head);
+        if (tail == head) {
+            if (stopping) {
+                break;
+            }
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += WRITER_POLL_NS;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_mutex_lock(&t->lock);
+            pthread_cond_timedwait(&t->wake, &t->lock, &deadline);
+            pthread_mutex_unlock(&t->lock);
+            continue;
+        }
+
+        const TraceSlot *slot = &t->ring[tail % TRACE_RING_BLOCKS];
+        if (fwrite(slot->data, 1, slot->size, t->file) != slot->size) {
+            log_err("Could not write trace block");
+        }
+        t->stats.bytes += slot->size;
+        atomic_store(&t->tail, ++tail);
+    }
+    return NULL;
+}
+
+// Claim the next free block, false if the writer has not released one yet
+static bool open_block(Tracer *t, const uint64_t cycle) {
+    const uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&t->tail, memory_order_acquire) == TRACE_RING_BLOCKS) {
+        t->block_flags = TRACE_BLOCK_AFTER_GAP;
+        return false;
+    }
+    t->block = &t->ring[head % TRACE_RING_BLOCKS];
+    t->cursor = t->block->data + TRACE_BLOCK_HEADER_SIZE;
+    t->n_records = 0;
+    t->block_cycle = cycle;
+    t->cycle = cycle;
+    t->first = true;
+    return true;
+}
+
+static void seal_block(Tracer *t) {
+    TraceSlot *block = t->block;
+    const uint32_t length = t->cursor - (block->data + TRACE_BLOCK_HEADER_SIZE);
+    write_u32(block->data, t->n_records);
+    write_u32(block->data + 4, length);
+    write_u64(block->data + 8, t->block_cycle);
+    write_u32(block->data + 16, t->block_flags);
+    write_u32(block->data + 20, 0);
+    block->size = TRACE_BLOCK_HEADER_SIZE + length;
+
+    t->stats.blocks++;
+    t->block = NULL;
+    t->block_flags = 0;
+    atomic_store_explicit(&t->head, atomic_load_explicit(&t->head, memory_order_relaxed) + 1,
+                          memory_order_release);
+    pthread_cond_signal(&t->wake);
+}
+
+uint8_t Trace_operand_count(const uint8_t opcode) {
+    const Instruction *ins = CPU_get_instruction(opcode);
+    const addressing_fn addressing = ins->addressing;
+    if (ins->opcode == ILL || addressing == IMP) {
+        return 0;
+    }
+    if (addressing == ABS || addressing == ABX || addressing == ABY || addressing == IND ||
+        addressing == IAX) {
+        return 2;
+    }
+    return 1;
+}
+
+bool Trace_start(Machine *const m, const char *path) {
+    Trace_stop(m);
+
+    Tracer *t = calloc(1, sizeof(Tracer));
+    check_mem_return(t, false);
+    t->ring = malloc(TRACE_RING_BLOCKS * sizeof(TraceSlot));
+    check_mem(t->ring, {
+        free(t);
+        return false;
+    });
+    t->file = fopen(path, "wb");
+    check(t->file, "Could not open %s", {
+        free(t->ring);
+        free(t);
+        return false;
+    }, path);
+
+    uint8_t header[16] = {0};
+    memcpy(header, TRACE_MAGIC, 8);
+    write_u32(header + 8, TRACE_BLOCK_SIZE);
+    fwrite(header, 1, sizeof(header), t->file);
+    t->stats.bytes = sizeof(header);
+
+    for (int opcode = 0; opcode <= 0xFF; opcode++) {
+        t->operand_counts[opcode] = Trace_operand_count(opcode);
+    }
+    atomic_init(&t->head, 0);
+    atomic_init(&t->tail, 0);
+    atomic_init(&t->stop, false);
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wake, NULL);
+    check(pthread_create(&t->writer, NULL, write_blocks, t) == 0, "Could not start trace writer", {
+        pthread_mutex_destroy(&t->lock);
+        pthread_cond_destroy(&t->wake);
+        fclose(t->file);
+        free(t->ring);
+        free(t);
+        return false;
+    });
+
+    m->tracer = t;
+    log_info("Tracing to %s", path);
+    return true;
+}
+
+TraceStats Trace_stop(Machine *const m) {
+    Tracer *t = m->tracer;
+    if (!t) {
+        return (TraceStats){0};
+    }
+    m->tracer = NULL;
+
+    if (t->block && t->n_records) {
+        seal_block(t);
+    }
+    atomic_store(&t->stop, true);
+    pthread_cond_signal(&t->wake);
+    pthread_join(t->writer, NULL);
+
+    fclose(t->file);
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->wake);
+    const TraceStats stats = t->stats;
+    free(t->ring);
+    free(t);
+    log_info("Trace done: %llu records in %llu blocks, %llu bytes, %llu dropped",
+             (unsigned long long) stats.records, (unsigned long long) stats.blocks,
+             (unsigned long long) stats.bytes, (unsigned long long) stats.dropped_records);
+    return stats;
+}
+
+bool Trace_is_running(const Machine *const m) {
+    return m->tracer != NULL;
+}
+
+void Trace_record(Machine *const m, const uint16_t pc, const uint8_t opcode) {
+    Tracer *t = m->tracer;
+    const CPU *cpu = &m->cpu;
+
+    if (t->block && t->cursor + TRACE_MAX_RECORD > t->block->data + sizeof(t->block->data)) {
+        seal_block(t);
+    }
+    if (!t->block && !open_block(t, cpu->cycle_count)) {
+        t->stats.dropped_records++;
+        return;
+    }
+
+    uint8_t *out = t->cursor;
+    uint8_t *flags = out++;
+    uint8_t f = 0;
+    if (t->first || pc != t->next_pc) {
+        f |= TRACE_PC;
+        *out++ = pc & 0xFF;
+        *out++ = pc >> 8;
+    }
+
+    *out++ = opcode;
+    const uint8_t n_operands = t->operand_counts[opcode];
+    for (uint8_t i = 0; i < n_operands; i++) {
+        // Straight from memory, code is never fetched from anything with read side effects
+        *out++ = m->ram[(uint16_t) (pc + 1 + i)];
+    }
+
+#define TRACE_REGISTER(flag, field) \
+    if (t->first || cpu->field != t->field) { \
+        f |= (flag); \
+        *out++ = cpu->field; \
+        t->field = cpu->field; \
+    }
+    TRACE_REGISTER(TRACE_A, a)
+    TRACE_REGISTER(TRACE_X, x)
+    TRACE_REGISTER(TRACE_Y, y)
+    TRACE_REGISTER(TRACE_SP, sp)
+    TRACE_REGISTER(TRACE_STATUS, status)
+#undef TRACE_REGISTER
+
+    uint64_t delta = cpu->cycle_count - t->cycle;
+    if (delta <= 0xFF) {
+        *out++ = delta;
+    } else {
+        f |= TRACE_WIDE_CYCLES;
+        do {
+            *out++ = (delta & 0x7F) | (delta > 0x7F ? 0x80 : 0);
+            delta >>= 7;
+        } while (delta);
+    }
+
+    *flags = f;
+    t->cursor = out;
+    t->first = false;
+    t->next_pc = pc + 1 + n_operands;
+    t->cycle = cpu->cycle_count;
+    t->n_records++;
+    t->stats.records++;
+}
+
+size_t Trace_decode_record(const uint8_t *data, const size_t length, TraceRecord *state) {
+    size_t pos = 0;
+#define TRACE_NEED(n) if (pos + (n) > length) return 0
+    TRACE_NEED(1);
+    const uint8_t f = data[pos++];
+    if (f & TRACE_PC) {
+        TRACE_NEED(2);
+        state->pc = data[pos] | (data[pos + 1] << 8);
+        pos += 2;
+    } else {
+        state->pc += 1 + state->n_operands;
+    }
+
+    TRACE_NEED(1);
+    state->opcode = data[pos++];
+    state->n_operands = Trace_operand_count(state->opcode);
+    TRACE_NEED(state->n_operands);
+    for (uint8_t i = 0; i < state->n_operands; i++) {
+        state->operands[i] = data[pos++];
+    }
+
+    const uint8_t flags[] = {TRACE_A, TRACE_X, TRACE_Y, TRACE_SP, TRACE_STATUS};
+    uint8_t *registers[] = {&state->a, &state->x, &state->y, &state->sp, &state->status};
+    for (int i = 0; i < 5; i++) {
+        if (f & flags[i]) {
+            TRACE_NEED(1);
+            *registers[i] = data[pos++];
+        }
+    }
+
+    uint64_t delta = 0;
+    if (f & TRACE_WIDE_CYCLES) {
+        for (int shift = 0;; shift += 7) {
+            TRACE_NEED(1);
+            const uint8_t byte = data[pos++];
+            delta |= (uint64_t) (byte & 0x7F) << shift;
+            if (!(byte & 0x80) || shift >= 63) {
+                break;
+            }
+        }
+    } else {
+        TRACE_NEED(1);
+        delta = data[pos++];
+    }
+    state->cycle += delta;
+#undef TRACE_NEED
+    return pos;
+}
@@ -0,0 +1,88 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_TRACE_H
+#define INC_6502_EMULATOR_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct Machine Machine;
+typedef struct Tracer Tracer;
+
+/*
+ * Binary execution trace, one record per instruction holding the state before it ran.
+ *
+ * File: "6502TRC1", u32 block size, u32 reserved, then blocks until the end of the file.
+ * Block: u32 number of records, u32 length of the records in bytes, u64 cycle count of the
+ * first record, u32 flags, u32 reserved, then the records. Every block decodes on its own.
+ * Record: a flags byte, the pc (u16) if TRACE_PC, the opcode and its operand bytes, then one byte
+ * for each of a, x, y, sp and status that is flagged, and the cycles since the previous record
+ * (since the block start for the first one) as a byte, or a LEB128 varint with TRACE_WIDE_CYCLES.
+ * The first record of a block has every register flagged. All multibyte values are little-endian.
+ */
+#define TRACE_MAGIC "6502TRC1"
+#define TRACE_BLOCK_SIZE (64 * 1024)
+#define TRACE_BLOCK_HEADER_SIZE 24
+// Blocks buffered between the cpu and the writer thread
+#define TRACE_RING_BLOCKS 64
+
+// Record flags, a register is only stored when it differs from the previous record
+#define TRACE_PC 0x01 // pc does not follow from the previous instruction
+#define TRACE_A 0x02
+#define TRACE_X 0x04
+#define TRACE_Y 0x08
+#define TRACE_SP 0x10
+#define TRACE_STATUS 0x20
+#define TRACE_WIDE_CYCLES 0x40
+
+// Block flags
+#define TRACE_BLOCK_AFTER_GAP 0x01 // blocks were dropped right before this one
+
+typedef struct TraceRecord {
+    uint64_t cycle;
+    uint16_t pc;
+    uint8_t opcode;
+    uint8_t operands[2];
+    uint8_t n_operands;
+    uint8_t a, x, y, sp, status;
+} TraceRecord;
+
+typedef struct TraceStats {
+    uint64_t records;
+    uint64_t blocks;
+    uint64_t bytes;
+    // Instructions not recorded because the writer could not keep up (the cpu never waits for it)
+    uint64_t dropped_records;
+} TraceStats;
+
+/**
+ * Start tracing every instruction `m` executes into the file at `path`, written by a background
+ * thread. Stops a trace already running first.
+ * @return false if the file or thread could not be created
+ */
+bool Trace_start(Machine *m, const char *path);
+
+/**
+ * Flush what is left, wait for the writer and close the file.
+ * @return what was recorded, zeroes if no trace was running
+ */
+TraceStats Trace_stop(Machine *m);
+bool Trace_is_running(const Machine *m);
+
+// Called by the cpu before executing the instruction at `pc`, the opcode has been fetched
+void Trace_record(Machine *m, uint16_t pc, uint8_t opcode);
+
+// Number of operand bytes following `opcode`
+uint8_t Trace_operand_count(uint8_t opcode);
+
+/**
+ * Decode the next record of a block into `state`, which holds the previous record. Before the
+ * first record of a block zero it and set its cycle to the one in the block header.
+ * @return bytes consumed, 0 if the data is truncated
+ */
+size_t Trace_decode_record(const uint8_t *data, size_t length, TraceRecord *state);
+
+#endif //INC_6502_EMULATOR_TRACE_H
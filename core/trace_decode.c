@@ -0,0 +1,130 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+/*
+ * Renders a binary trace written by Trace_start as text, one instruction per line:
+ *
+ *     cycle  pc  opcode operands  mnemonic  registers before the instruction
+ *
+ * usage: 6502_trace FILE [--from ADDR] [--to ADDR] [--limit N]
+ *
+ * --from and --to (hex, inclusive) only print instructions with a pc in that range, --limit stops
+ * after printing N of them. A line of dashes marks where records were dropped while tracing.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "dbg.h"
+#include "trace.h"
+
+static uint64_t read_le(const uint8_t *src, const int n) {
+    uint64_t value = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        value = (value << 8) | src[i];
+    }
+    return value;
+}
+
+static void print_record(const TraceRecord *r) {
+    char bytes[9];
+    switch (r->n_operands) {
+        case 0: snprintf(bytes, sizeof(bytes), "%02X", r->opcode); break;
+        case 1: snprintf(bytes, sizeof(bytes), "%02X %02X", r->opcode, r->operands[0]); break;
+        default: snprintf(bytes, sizeof(bytes), "%02X %02X %02X", r->opcode, r->operands[0], r->operands[1]);
+    }
+    printf("%12llu  %04X  %-8s  %-4s  A:%02X X:%02X Y:%02X SP:%02X P:%02X\n", (unsigned long long) r->cycle,
+           r->pc, bytes, CPU_get_instruction(r->opcode)->name, r->a, r->x, r->y, r->sp, r->status);
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s FILE [--from ADDR] [--to ADDR] [--limit N]\n", program);
+}
+
+int main(const int argc, char *argv[]) {
+    const char *path = NULL;
+    uint16_t from = 0x0000;
+    uint16_t to = 0xFFFF;
+    uint64_t limit = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--from") == 0 && has_value) {
+            from = (uint16_t) strtoul(argv[++i], NULL, 16);
+        } else if (strcmp(argv[i], "--to") == 0 && has_value) {
+            to = (uint16_t) strtoul(argv[++i], NULL, 16);
+        } else if (strcmp(argv[i], "--limit") == 0 && has_value) {
+            limit = strtoull(argv[++i], NULL, 10);
+        } else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!path) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *file = fopen(path, "rb");
+    check_return(file, "Could not open %s", EXIT_FAILURE, path);
+
+    uint8_t header[16];
+    check(fread(header, 1, sizeof(header), file) == sizeof(header) && memcmp(header, TRACE_MAGIC, 8) == 0,
+          "%s is not a trace", {
+              fclose(file);
+              return EXIT_FAILURE;
+          }, path);
+    const uint32_t block_size = read_le(header + 8, 4);
+
+    uint8_t *block = malloc(block_size);
+    check_mem(block, {
+        fclose(file);
+        return EXIT_FAILURE;
+    });
+
+    CPU_load_instructions();
+    uint64_t printed = 0;
+    uint8_t block_header[TRACE_BLOCK_HEADER_SIZE];
+    while (fread(block_header, 1, sizeof(block_header), file) == sizeof(block_header)) {
+        const uint32_t n_records = read_le(block_header, 4);
+        const uint32_t length = read_le(block_header + 4, 4);
+        const uint32_t flags = read_le(block_header + 16, 4);
+        if (length > block_size || fread(block, 1, length, file) != length) {
+            log_err("Truncated block, stopping");
+            break;
+        }
+        if (flags & TRACE_BLOCK_AFTER_GAP) {
+            printf("------------ records dropped ------------\n");
+        }
+
+        TraceRecord record = {.cycle = read_le(block_header + 8, 8)};
+        size_t pos = 0;
+        for (uint32_t i = 0; i < n_records; i++) {
+            const size_t used = Trace_decode_record(block + pos, length - pos, &record);
+            if (!used) {
+                log_err("Corrupt record in block, skipping the rest of it");
+                break;
+            }
+            pos += used;
+            if (record.pc < from || record.pc > to) {
+                continue;
+            }
+            print_record(&record);
+            if (limit && ++printed == limit) {
+                goto done;
+            }
+        }
+    }
+
+done:
+    free(block);
+    fclose(file);
+    return EXIT_SUCCESS;
+}
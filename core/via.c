@@ -0,0 +1,276 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#include "via.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bus.h"
+#include "dbg.h"
+#include "machine.h"
+
+// Accesses are timed at the end of the instruction making them, that is where its bus cycles end
+static uint64_t bus_cycle(const Machine *m) {
+    return m->cpu.cycle_count + m->cpu.cycles;
+}
+
+/*
+ * A counter loaded with N counts down to 0 in N cycles, shows FFFF for the cycle it runs out at
+ * and then either keeps counting down (one-shot) or is back at the latch a cycle later (T1 free
+ * running, a period of latch + 2 cycles).
+ */
+static uint16_t t1_counter(const Via *v, const uint64_t now) {
+    if (now < v->t1_start) {
+        // Reloaded on the cycle after running out, see t1_expired
+        return 0xFFFF;
+    }
+    const uint64_t elapsed = now - v->t1_start;
+    if (elapsed <= v->t1_value || !(v->acr & VIA_ACR_T1_CONTINUOUS)) {
+        return (uint16_t) (v->t1_value - elapsed);
+    }
+    // Only reached between running out and the event catching up
+    const uint64_t phase = (elapsed - v->t1_value - 1) % ((uint64_t) v->t1_latch + 2);
+    return phase == 0 ? 0xFFFF : (uint16_t) (v->t1_latch - (phase - 1));
+}
+
+static uint16_t t2_counter(const Via *v, const uint64_t now) {
+    if (v->acr & VIA_ACR_T2_PULSES) {
+        return v->t2_value;
+    }
+    return (uint16_t) (v->t2_value - (now - v->t2_start));
+}
+
+static void update_irq(Machine *m, const Via *v) {
+    Events_set_irq(m, EVENTS_IRQ_VIA, v->ifr & v->ier & 0x7F);
+}
+
+static void schedule_t1(Machine *m, Via *v) {
+    if (v->t1_armed || (v->acr & VIA_ACR_T1_CONTINUOUS)) {
+        Events_schedule(m, &v->t1_event, v->t1_start + v->t1_value + 1);
+    } else {
+        Events_cancel(m, &v->t1_event);
+    }
+}
+
+static void schedule_t2(Machine *m, Via *v) {
+    if (v->t2_armed && !(v->acr & VIA_ACR_T2_PULSES)) {
+        Events_schedule(m, &v->t2_event, v->t2_start + v->t2_value + 1);
+    } else {
+        Events_cancel(m, &v->t2_event);
+    }
+}
+
+static void t1_expired(Machine *m, Event *e) {
+    Via *v = e->ctx;
+    v->ifr |= VIA_IFR_T1;
+    v->t1_armed = false;
+    if (v->acr & VIA_ACR_T1_CONTINUOUS) {
+        // Timed from when it ran out rather than from now, so a late dispatch does not drift
+        v->t1_value = v->t1_latch;
+        v->t1_start = e->cycle + 1;
+        schedule_t1(m, v);
+    }
+    update_irq(m, v);
+}
+
+static void t2_expired(Machine *m, Event *e) {
+    Via *v = e->ctx;
+    v->ifr |= VIA_IFR_T2;
+    v->t2_armed = false;
+    update_irq(m, v);
+}
+
+static uint8_t port_pins(const Via *v, const ViaPort port) {
+    const uint8_t out = port == VIA_PORT_A ? v->ora : v->orb;
+    const uint8_t ddr = port == VIA_PORT_A ? v->ddra : v->ddrb;
+    return (out & ddr) | (v->input[port] & ~ddr);
+}
+
+static uint8_t read_register(const Machine *m, const Via *v, const ViaRegister reg) {
+    switch (reg) {
+        case VIA_ORB: return port_pins(v, VIA_PORT_B);
+        case VIA_ORA:
+        case VIA_ORA_NH: return port_pins(v, VIA_PORT_A);
+        case VIA_DDRB: return v->ddrb;
+        case VIA_DDRA: return v->ddra;
+        case VIA_T1C_L: return t1_counter(v, bus_cycle(m)) & 0x00FF;
+        case VIA_T1C_H: return t1_counter(v, bus_cycle(m)) >> 8;
+        case VIA_T1L_L: return v->t1_latch & 0x00FF;
+        case VIA_T1L_H: return v->t1_latch >> 8;
+        case VIA_T2C_L: return t2_counter(v, bus_cycle(m)) & 0x00FF;
+        case VIA_T2C_H: return t2_counter(v, bus_cycle(m)) >> 8;
+        case VIA_SR: return v->sr;
+        case VIA_ACR: return v->acr;
+        case VIA_PCR: return v->pcr;
+        case VIA_IFR: return v->ifr | (v->ifr & v->ier & 0x7F ? VIA_IFR_IRQ : 0);
+        case VIA_IER: return v->ier | 0x80;
+    }
+    return 0;
+}
+
+static uint8_t via_peek(const Machine *m, const void *ctx, const uint16_t addr) {
+    return read_register(m, ctx, addr & (VIA_N_REGISTERS - 1));
+}
+
+static uint8_t via_read(Machine *m, void *ctx, const uint16_t addr) {
+    Via *v = ctx;
+    const ViaRegister reg = addr & (VIA_N_REGISTERS - 1);
+    const uint8_t data = read_register(m, v, reg);
+    // Reading the low byte of a counter acknowledges its interrupt
+    if (reg == VIA_T1C_L || reg == VIA_T2C_L) {
+        v->ifr &= reg == VIA_T1C_L ? ~VIA_IFR_T1 : ~VIA_IFR_T2;
+        update_irq(m, v);
+    }
+    return data;
+}
+
+static void via_write(Machine *m, void *ctx, const uint16_t addr, const uint8_t data) {
+    Via *v = ctx;
+    const uint64_t now = bus_cycle(m);
+    switch ((ViaRegister) (addr & (VIA_N_REGISTERS - 1))) {
+        case VIA_ORB: v->orb = data; break;
+        case VIA_ORA:
+        case VIA_ORA_NH: v->ora = data; break;
+        case VIA_DDRB: v->ddrb = data; break;
+        case VIA_DDRA: v->ddra = data; break;
+        case VIA_T1C_L:
+        case VIA_T1L_L: v->t1_latch = (v->t1_latch & 0xFF00) | data; break;
+        case VIA_T1C_H:
+            // Loads the counter from the latch and starts it
+            v->t1_latch = (v->t1_latch & 0x00FF) | data << 8;
+            v->t1_value = v->t1_latch;
+            v->t1_start = now;
+            v->t1_armed = true;
+            v->ifr &= ~VIA_IFR_T1;
+            schedule_t1(m, v);
+            break;
+        case VIA_T1L_H:
+            v->t1_latch = (v->t1_latch & 0x00FF) | data << 8;
+            v->ifr &= ~VIA_IFR_T1;
+            break;
+        case VIA_T2C_L: v->t2_latch_lo = data; break;
+        case VIA_T2C_H:
+            v->t2_value = data << 8 | v->t2_latch_lo;
+            v->t2_start = now;
+            v->t2_armed = true;
+            v->ifr &= ~VIA_IFR_T2;
+            schedule_t2(m, v);
+            break;
+        case VIA_SR: v->sr = data; break;
+        case VIA_ACR:
+            // Freeze both counters where they are and carry on in the new mode from there
+            v->t1_value = t1_counter(v, now);
+            v->t1_start = now;
+            v->t2_value = t2_counter(v, now);
+            v->t2_start = now;
+            v->acr = data;
+            schedule_t1(m, v);
+            schedule_t2(m, v);
+            break;
+        case VIA_PCR: v->pcr = data; break;
+        case VIA_IFR: v->ifr &= ~data; break;
+        case VIA_IER:
+            if (data & 0x80) {
+                v->ier |= data & 0x7F;
+            } else {
+                v->ier &= ~data;
+            }
+            break;
+    }
+    update_irq(m, v);
+}
+
+static void via_reset(Machine *m, void *ctx) {
+    Via *v = ctx;
+    Events_cancel(m, &v->t1_event);
+    Events_cancel(m, &v->t2_event);
+    // Registers clear on reset, the timers and latches are left as they are but stop interrupting
+    v->orb = v->ora = v->ddrb = v->ddra = 0;
+    v->sr = v->acr = v->pcr = v->ifr = v->ier = 0;
+    v->t1_armed = v->t2_armed = false;
+    v->t1_start = v->t2_start = m->cpu.cycle_count;
+    update_irq(m, v);
+}
+
+static void via_destroy(Machine *m, void *ctx) {
+    Via *v = ctx;
+    Events_cancel(m, &v->t1_event);
+    Events_cancel(m, &v->t2_event);
+    Events_set_irq(m, EVENTS_IRQ_VIA, false);
+    free(v);
+}
+
+static size_t via_save(const Machine *m, const void *ctx, uint8_t *out) {
+    if (out) {
+        // Events link into the scheduler, load schedules them again
+        Via v = *(const Via *) ctx;
+        v.t1_event = v.t2_event = (Event){0};
+        memcpy(out, &v, sizeof(Via));
+    }
+    return sizeof(Via);
+}
+
+static bool via_load(Machine *m, void *ctx, const uint8_t *data, const size_t size) {
+    Via *v = ctx;
+    if (!data) {
+        via_reset(m, v);
+        return true;
+    }
+    if (size != sizeof(Via)) {
+        return false;
+    }
+    const Event t1_event = v->t1_event;
+    const Event t2_event = v->t2_event;
+    memcpy(v, data, sizeof(Via));
+    v->t1_event = t1_event;
+    v->t2_event = t2_event;
+    schedule_t1(m, v);
+    schedule_t2(m, v);
+    update_irq(m, v);
+    return true;
+}
+
+Via *Via_attach(Machine *m, const uint16_t base) {
+    check_return(!Via_get(m), "Machine already has a VIA", NULL);
+    check_return(base <= 0xFFFF - (VIA_N_REGISTERS - 1), "VIA does not fit at %04X", NULL, base);
+
+    Via *v = calloc(1, sizeof(Via));
+    check_mem_return(v, NULL);
+    v->input[VIA_PORT_A] = v->input[VIA_PORT_B] = 0xFF;
+    v->t1_event = (Event){.fire = t1_expired, .ctx = v};
+    v->t2_event = (Event){.fire = t2_expired, .ctx = v};
+
+    const Device device = {
+        .name = VIA_DEVICE_NAME,
+        .start = base,
+        .end = base + VIA_N_REGISTERS - 1,
+        .ctx = v,
+        .read = via_read,
+        .peek = via_peek,
+        .write = via_write,
+        .reset = via_reset,
+        .destroy = via_destroy,
+        .save = via_save,
+        .load = via_load,
+    };
+    if (!BUS_map_device(m, &device)) {
+        free(v);
+        return NULL;
+    }
+    return v;
+}
+
+Via *Via_get(const Machine *m) {
+    const Device *d = BUS_find_device(m, VIA_DEVICE_NAME);
+    return d ? d->ctx : NULL;
+}
+
+void Via_set_input(Via *v, const ViaPort port, const uint8_t pins) {
+    v->input[port] = pins;
+}
+
+uint8_t Via_get_output(const Via *v, const ViaPort port) {
+    return port == VIA_PORT_A ? v->ora : v->orb;
+}
@@ -0,0 +1,101 @@
+//
+// Created by johan on 2026-10-19.
+//
+
+#ifndef INC_6502_EMULATOR_VIA_H
+#define INC_6502_EMULATOR_VIA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "events.h"
+
+typedef struct Machine Machine;
+
+#define VIA_DEVICE_NAME "via"
+#define VIA_DEFAULT_BASE 0x6000
+#define VIA_N_REGISTERS 16
+
+typedef enum ViaRegister {
+    VIA_ORB,
+    VIA_ORA,
+    VIA_DDRB,
+    VIA_DDRA,
+    VIA_T1C_L,
+    VIA_T1C_H,
+    VIA_T1L_L,
+    VIA_T1L_H,
+    VIA_T2C_L,
+    VIA_T2C_H,
+    VIA_SR,
+    VIA_ACR,
+    VIA_PCR,
+    VIA_IFR,
+    VIA_IER,
+    // ORA without handshake
+    VIA_ORA_NH,
+} ViaRegister;
+
+#define VIA_IFR_T2 (1 << 5)
+#define VIA_IFR_T1 (1 << 6)
+#define VIA_IFR_IRQ (1 << 7)
+#define VIA_ACR_T2_PULSES (1 << 5)
+#define VIA_ACR_T1_CONTINUOUS (1 << 6)
+
+typedef enum ViaPort {
+    VIA_PORT_A,
+    VIA_PORT_B,
+} ViaPort;
+
+/*
+ * 6522 VIA with its two timers and I/O ports. The timers never tick: a counter is stored as the
+ * value it was loaded with and the cycle it was loaded at, reading it works out what it has
+ * counted down to since, and running out is an event scheduled for the exact cycle (see
+ * events.h), which raises the T1/T2 flag and with it IRQ when enabled in IER.
+ *
+ * Register accesses are timed at the end of the instruction making them. Not emulated: the
+ * shift register (SR is plain storage), CA1/CA2/CB1/CB2 handshaking, PB7 output and T2 pulse
+ * counting (the counter holds still in that mode).
+ */
+typedef struct Via {
+    uint8_t orb;
+    uint8_t ora;
+    uint8_t ddrb;
+    uint8_t ddra;
+    // Levels driven onto the port pins from outside, see Via_set_input
+    uint8_t input[2];
+    uint16_t t1_latch;
+    uint8_t t2_latch_lo;
+    // Counter value at *_start, it counts down by one per cycle from there
+    uint16_t t1_value;
+    uint64_t t1_start;
+    uint16_t t2_value;
+    uint64_t t2_start;
+    // Set until a one-shot timer has run out once
+    bool t1_armed;
+    bool t2_armed;
+    Event t1_event;
+    Event t2_event;
+    uint8_t sr;
+    uint8_t acr;
+    uint8_t pcr;
+    uint8_t ifr;
+    uint8_t ier;
+} Via;
+
+/**
+ * Map a VIA's registers at base..base+15. A machine has at most one, it drives EVENTS_IRQ_VIA.
+ * @return the VIA, owned by the machine until its devices are unmapped, or NULL on failure
+ */
+Via *Via_attach(Machine *m, uint16_t base);
+
+// The machine's VIA, NULL if none is mapped
+Via *Via_get(const Machine *m);
+
+// Drive the pins of `port`, the ones configured as inputs in DDRA/DDRB read back these levels
+void Via_set_input(Via *v, ViaPort port, uint8_t pins);
+
+// Output register of `port`, only the bits set in its DDR actually drive the pins
+uint8_t Via_get_output(const Via *v, ViaPort port);
+
+#endif //INC_6502_EMULATOR_VIA_H